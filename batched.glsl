@@ -0,0 +1,35 @@
+// storage buffers need opengl 4.3
+#version 430 core
+
+// the same as vertex.glsl, but for draws in a batch
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec4 colour;
+
+// which draw in the batch this is. it's an instanced attribute that's just the instance's number,
+// so it's the base instance of the draw's command, which is set to the draw's index.
+layout (location = 5) in uint drawIndex;
+
+// the same as the Draw block in vertex.glsl
+struct Draw
+{
+    vec4 transform;
+    vec4 quantization;
+};
+
+// the uniforms of every draw in the batch. a storage buffer can be as big as it needs to be, unlike
+// a uniform block.
+layout (std430, binding = 0) readonly buffer Batch
+{
+    Draw draws[];
+};
+
+out vec4 vertexColour;
+
+void main()
+{
+    Draw draw = draws[drawIndex];
+    vec3 meshPosition = position * draw.quantization.w + draw.quantization.xyz;
+    gl_Position =
+        vec4(meshPosition.xy * draw.transform.zw + draw.transform.xy, -meshPosition.z, 1.0);
+    vertexColour = colour;
+}
@@ -0,0 +1,276 @@
+// this file implements the benchmark mode, which measures how long frames take so different builds
+// (or different machines/drivers) can be compared with actual numbers
+
+#include "stuff.h"
+
+// the settings and state of the benchmark
+static uint32_t s_frameCount;  // the number of frames to measure
+static uint32_t s_warmupCount; // the number of frames to draw before measuring
+static uint32_t s_frameIndex;  // the current frame, including warmup frames
+static uint64_t s_startTime;   // when the program started
+static uint64_t s_readyTime;   // when the benchmark started (right before the first frame)
+static uint64_t s_measureTime; // when the first measured frame started
+static uint64_t s_frameStart;  // when the current frame started
+static uint64_t* s_frameTimes; // how long each measured frame took, in nanoseconds
+
+// the results, they're all in milliseconds except for fps
+typedef struct BenchmarkResults
+{
+	double startupTime;
+	double minimum;
+	double mean;
+	double p50;
+	double p95;
+	double p99;
+	double maximum;
+	double totalTime;
+	double syncTime;
+	double fps;
+} BenchmarkResults_t;
+
+// qsort needs a function that compares two elements
+static int32_t CompareTimes(const void* a, const void* b);
+
+// get the time at a percentile (0-100) of the sorted times, using the nearest rank
+static double GetPercentile(const uint64_t* sortedTimes, uint32_t count, double percentile);
+
+// write the results as json
+static void WriteResults(const char* outputName, const BenchmarkResults_t* results);
+
+// write a string as a json string, with quotes around it and anything that needs it escaped
+static void WriteJsonString(FILE* output, const char* string);
+
+void StartBenchmark(uint32_t frameCount, uint32_t warmupCount, uint64_t startTime)
+{
+	s_frameCount = frameCount;
+	s_warmupCount = warmupCount;
+	s_frameIndex = 0;
+	s_startTime = startTime;
+	s_readyTime = GetTime();
+
+	if (!s_frameCount)
+	{
+		return;
+	}
+
+	printf("Benchmarking %u frames after %u warmup frames\n", s_frameCount, s_warmupCount);
+
+	// allocating this up front means there's no allocation while measuring
+	s_frameTimes = calloc(s_frameCount, sizeof(uint64_t));
+	if (!s_frameTimes)
+	{
+		FatalError("failed to allocate %zu bytes!", s_frameCount * sizeof(uint64_t));
+	}
+}
+
+bool BeginBenchmarkFrame(void)
+{
+	if (!s_frameCount)
+	{
+		return false;
+	}
+
+	s_frameStart = GetTime();
+	if (s_frameIndex == s_warmupCount)
+	{
+		s_measureTime = s_frameStart;
+
+		// the gpu zones from warmup frames shouldn't count either. the gpu profiler belongs to the
+		// render thread, so the caller passes this on in the frame packet instead of resetting it
+		// here.
+		return true;
+	}
+	return false;
+}
+
+bool EndBenchmarkFrame(void)
+{
+	if (!s_frameCount)
+	{
+		return true;
+	}
+
+	uint64_t frameEnd = GetTime();
+	if (s_frameIndex >= s_warmupCount)
+	{
+		s_frameTimes[s_frameIndex - s_warmupCount] = frameEnd - s_frameStart;
+	}
+	s_frameIndex++;
+
+	return s_frameIndex < s_warmupCount + s_frameCount;
+}
+
+void FinishBenchmark(const char* outputName)
+{
+	if (!s_frameCount)
+	{
+		return;
+	}
+
+	// the program can be closed before it's done
+	uint32_t measuredCount = s_frameIndex > s_warmupCount ? s_frameIndex - s_warmupCount : 0;
+	if (!measuredCount)
+	{
+		printf("Benchmark stopped before any frames were measured\n");
+		free(s_frameTimes);
+		s_frameTimes = NULL;
+		return;
+	}
+
+	// opengl commands are only queued up by the driver, so the last few frames could still be
+	// getting drawn. glFinish waits until everything is actually done, so the total time includes
+	// all the work that was asked for. the software renderer is done as soon as it presents.
+	uint64_t syncStart = GetTime();
+	if (!GetSoftwareRendererName())
+	{
+		glFinish();
+	}
+	uint64_t endTime = GetTime();
+
+	// now that the gpu is done, the last few frames' gpu zones can be read without waiting
+	FlushGpuProfiler();
+
+	BenchmarkResults_t results = {0};
+	results.startupTime = (s_readyTime - s_startTime) / 1e6;
+	results.totalTime = (endTime - s_measureTime) / 1e6;
+	results.syncTime = (endTime - syncStart) / 1e6;
+	results.fps = measuredCount / (results.totalTime / 1e3);
+
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < measuredCount; i++)
+	{
+		total += s_frameTimes[i];
+	}
+	results.mean = total / (double)measuredCount / 1e6;
+
+	// sorting the times makes getting percentiles easy, and the first and last are the min and max
+	qsort(s_frameTimes, measuredCount, sizeof(uint64_t), CompareTimes);
+	results.minimum = s_frameTimes[0] / 1e6;
+	results.maximum = s_frameTimes[measuredCount - 1] / 1e6;
+	results.p50 = GetPercentile(s_frameTimes, measuredCount, 50.0);
+	results.p95 = GetPercentile(s_frameTimes, measuredCount, 95.0);
+	results.p99 = GetPercentile(s_frameTimes, measuredCount, 99.0);
+
+	printf("Benchmark results for %u frames:\n", measuredCount);
+	printf("  startup: %.3f ms\n", results.startupTime);
+	printf(
+		"  frame time: min %.3f ms, mean %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f "
+		"ms\n",
+		results.minimum, results.mean, results.p50, results.p95, results.p99, results.maximum);
+	printf(
+		"  total: %.3f ms (%.3f ms waiting for the gpu), %.2f fps\n", results.totalTime,
+		results.syncTime, results.fps);
+	for (uint32_t i = 0; i < GetGpuZoneCount(); i++)
+	{
+		printf("  gpu zone %s: %.3f ms\n", GetGpuZoneName(i), GetGpuZoneAverage(i));
+	}
+
+	if (outputName)
+	{
+		WriteResults(outputName, &results);
+	}
+
+	free(s_frameTimes);
+	s_frameTimes = NULL;
+}
+
+static int32_t CompareTimes(const void* a, const void* b)
+{
+	uint64_t first = *(const uint64_t*)a;
+	uint64_t second = *(const uint64_t*)b;
+
+	// returning first - second would overflow an int32_t, so this gives -1, 0, or 1
+	return (first > second) - (first < second);
+}
+
+static double GetPercentile(const uint64_t* sortedTimes, uint32_t count, double percentile)
+{
+	// the nearest rank is the smallest value that at least percentile% of the values are less than
+	// or equal to
+	uint32_t rank = (uint32_t)(percentile / 100.0 * count + 0.999999);
+	if (rank < 1)
+	{
+		rank = 1;
+	}
+	if (rank > count)
+	{
+		rank = count;
+	}
+
+	return sortedTimes[rank - 1] / 1e6;
+}
+
+static void WriteResults(const char* outputName, const BenchmarkResults_t* results)
+{
+	FILE* output = fopen(outputName, "wb");
+	if (!output)
+	{
+		FatalError("failed to open %s for writing!", outputName);
+	}
+
+	// json is simple enough to write with fprintf, a library would be overkill. the renderer
+	// string is included so results from different drivers can be told apart.
+	fprintf(output, "{\n");
+	const char* renderer = GetSoftwareRendererName();
+	if (!renderer)
+	{
+		renderer = (const char*)glGetString(GL_RENDERER);
+	}
+	fprintf(output, "\t\"renderer\": ");
+	WriteJsonString(output, renderer);
+	fprintf(output, ",\n");
+	fprintf(output, "\t\"width\": %d,\n", GetWindowWidth());
+	fprintf(output, "\t\"height\": %d,\n", GetWindowHeight());
+	fprintf(output, "\t\"warmup_frames\": %u,\n", s_warmupCount);
+	fprintf(output, "\t\"frames\": %u,\n", s_frameIndex - s_warmupCount);
+	fprintf(output, "\t\"startup_ms\": %.6f,\n", results->startupTime);
+	fprintf(output, "\t\"frame_ms\": {\n");
+	fprintf(output, "\t\t\"min\": %.6f,\n", results->minimum);
+	fprintf(output, "\t\t\"mean\": %.6f,\n", results->mean);
+	fprintf(output, "\t\t\"p50\": %.6f,\n", results->p50);
+	fprintf(output, "\t\t\"p95\": %.6f,\n", results->p95);
+	fprintf(output, "\t\t\"p99\": %.6f,\n", results->p99);
+	fprintf(output, "\t\t\"max\": %.6f\n", results->maximum);
+	fprintf(output, "\t},\n");
+	fprintf(output, "\t\"total_ms\": %.6f,\n", results->totalTime);
+	fprintf(output, "\t\"gpu_sync_ms\": %.6f,\n", results->syncTime);
+	fprintf(output, "\t\"fps\": %.6f,\n", results->fps);
+
+	// the average time of each gpu zone, if the gpu profiler was on
+	fprintf(output, "\t\"gpu_zones_ms\": {");
+	for (uint32_t i = 0; i < GetGpuZoneCount(); i++)
+	{
+		fprintf(output, "%s\n\t\t", i ? "," : "");
+		WriteJsonString(output, GetGpuZoneName(i));
+		fprintf(output, ": %.6f", GetGpuZoneAverage(i));
+	}
+	fprintf(output, "%s}\n", GetGpuZoneCount() ? "\n\t" : "");
+	fprintf(output, "}\n");
+
+	fclose(output);
+
+	printf("Wrote benchmark results to %s\n", outputName);
+}
+
+static void WriteJsonString(FILE* output, const char* string)
+{
+	// the renderer string comes from the driver, so it could have anything in it. quotes and
+	// backslashes get a backslash, and control characters have to be written as \u escapes.
+	fputc('"', output);
+	for (const char* c = string ? string : ""; *c; c++)
+	{
+		if (*c == '"' || *c == '\\')
+		{
+			fprintf(output, "\\%c", *c);
+		}
+		else if ((uint8_t)*c < 0x20)
+		{
+			fprintf(output, "\\u%04x", (uint8_t)*c);
+		}
+		else
+		{
+			fputc(*c, output);
+		}
+	}
+	fputc('"', output);
+}
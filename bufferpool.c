@@ -0,0 +1,467 @@
+// this file implements buffer pools. making a buffer for every mesh means binding a different
+// buffer (and a different vertex array) for every draw, and with lots of meshes that's a lot of
+// binds. instead, a few big buffers get split up between meshes, and draws use offsets into them.
+// meshes that share buffers can share a vertex array too, so drawing them only needs the offsets.
+//
+// the space in each buffer is managed with a buddy allocator. the buffer is one big block, and
+// blocks get split in half until they're the right size. when a block is freed and the other half
+// (its buddy) is free too, they get merged back together. every block is a power of 2, which wastes
+// some space, but finding and merging blocks is really fast and simple.
+//
+// an allocation that's too big for a normal pool (like a big scanned mesh) gets a pool of its own,
+// rounded up to a power of 2 so the allocator works the same. only other allocations that are too
+// big for a normal pool can go in the space it has left, so they don't take up a huge buffer with
+// small meshes.
+
+#include "stuff.h"
+
+// the size of the buffers, they're made as big as possible without going over this
+#define BUFFER_POOL_SIZE (8 * 1024 * 1024)
+
+// the smallest block, in elements (vertices or indices). 2^4 is 16.
+#define BUFFER_POOL_MIN_ORDER 4
+
+// the maximum number of buffers
+#define BUFFER_POOL_MAX_POOLS 64
+
+// the maximum number of vertex arrays shared between buffers
+#define BUFFER_POOL_MAX_VERTEX_ARRAYS 64
+
+// marks the end of a free list
+#define BUFFER_POOL_NONE UINT32_MAX
+
+// the smallest draw index buffer, it doubles from here as bigger batches need it
+#define BUFFER_POOL_MIN_DRAW_INDICES 1024
+
+// a buffer and its allocator. blocks are referred to by their offset divided by the smallest block
+// size, and the arrays are indexed by that.
+typedef struct BufferPool
+{
+	uint32_t target; // the buffer type, like GL_ARRAY_BUFFER
+	uint32_t stride; // the size of an element
+	uint32_t buffer;
+	uint32_t maxOrder; // the size of the whole buffer is 2^maxOrder elements
+	uint32_t blockCount;
+	bool dedicated; // made for an allocation that's too big for a normal pool
+
+	uint8_t* orders; // the order of the block that starts here
+	bool* free;      // whether the block that starts here is free
+	uint32_t* next;  // the next block in the free list for its order
+	uint32_t* previous;
+	uint32_t freeLists[32]; // the first free block of each order
+
+	uint64_t usedCount;      // elements in allocated blocks
+	uint64_t requestedCount; // elements that were actually asked for
+	uint32_t allocationCount;
+} BufferPool_t;
+
+// a vertex array for a pair of buffers and a vertex format
+typedef struct SharedVertexArray
+{
+	const VertexFormat_t* format;
+	uint32_t vertexBuffer;
+	uint32_t indexBuffer;
+	uint32_t vertexArray;
+} SharedVertexArray_t;
+
+// make a new pool, which is bigger than normal if count elements wouldn't fit in a normal one
+static BufferPool_t* CreatePool(uint32_t target, uint32_t stride, uint32_t count);
+
+// the order of a normal pool, the biggest power of 2 elements that fits in BUFFER_POOL_SIZE
+static uint32_t GetPoolOrder(uint32_t stride);
+
+// allocate a block with at least count elements, returns false if there isn't one big enough
+static bool AllocateBlock(BufferPool_t* pool, uint32_t count, uint32_t* offset);
+
+// free a block, and merge it with its buddy as much as possible
+static void FreeBlock(BufferPool_t* pool, uint32_t offset);
+
+// add a block to the free list for its order
+static void PushFreeBlock(BufferPool_t* pool, uint32_t block, uint32_t order);
+
+// remove a block from the free list for its order
+static void RemoveFreeBlock(BufferPool_t* pool, uint32_t block, uint32_t order);
+
+// add the draw index attribute to a shared vertex array
+static void AddDrawIndexAttribute(uint32_t vertexArray);
+
+static BufferPool_t s_pools[BUFFER_POOL_MAX_POOLS];
+static uint32_t s_poolCount;
+
+static SharedVertexArray_t s_vertexArrays[BUFFER_POOL_MAX_VERTEX_ARRAYS];
+static uint32_t s_vertexArrayCount;
+
+// the numbers from 0 to s_drawIndexCount - 1, for the draw index attribute. it's only made once
+// something batches draws, so it isn't there at all with --no-batching and without --gpu-cull.
+static uint32_t s_drawIndexBuffer;
+static uint32_t s_drawIndexCount;
+
+BufferAllocation_t AllocateBuffer(
+	uint32_t target, uint32_t stride, const void* data, uint32_t count)
+{
+	// try every pool that has the right type of element, and make a new one if none of them have
+	// enough space. dedicated pools are only for allocations that are too big for normal ones.
+	bool oversized = count > (1u << GetPoolOrder(stride));
+	BufferPool_t* pool = NULL;
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < s_poolCount; i++)
+	{
+		if (s_pools[i].target == target && s_pools[i].stride == stride &&
+			s_pools[i].dedicated == oversized && AllocateBlock(&s_pools[i], count, &offset))
+		{
+			pool = &s_pools[i];
+			break;
+		}
+	}
+	if (!pool)
+	{
+		pool = CreatePool(target, stride, count);
+		if (!AllocateBlock(pool, count, &offset))
+		{
+			FatalError("failed to allocate %u elements from a new buffer pool!", count);
+		}
+	}
+
+	// glBufferSubData changes part of a buffer. the copy write target is used so it doesn't
+	// disturb the vertex array's index buffer binding.
+	SetBuffer(GL_COPY_WRITE_BUFFER, pool->buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, (size_t)offset * stride, (size_t)count * stride, data);
+	SetBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	BufferAllocation_t allocation;
+	allocation.buffer = pool->buffer;
+	allocation.offset = offset;
+	allocation.count = count;
+	return allocation;
+}
+
+void FreeBuffer(BufferAllocation_t* allocation)
+{
+	for (uint32_t i = 0; i < s_poolCount; i++)
+	{
+		if (s_pools[i].buffer == allocation->buffer)
+		{
+			FreeBlock(&s_pools[i], allocation->offset);
+			s_pools[i].requestedCount -= allocation->count;
+			break;
+		}
+	}
+
+	memset(allocation, 0, sizeof(BufferAllocation_t));
+}
+
+uint32_t GetSharedVertexArray(
+	const VertexFormat_t* format, uint32_t vertexBuffer, uint32_t indexBuffer)
+{
+	// formats with the same stride share pools, but they each need their own vertex array
+	for (uint32_t i = 0; i < s_vertexArrayCount; i++)
+	{
+		if (s_vertexArrays[i].format == format && s_vertexArrays[i].vertexBuffer == vertexBuffer &&
+			s_vertexArrays[i].indexBuffer == indexBuffer)
+		{
+			return s_vertexArrays[i].vertexArray;
+		}
+	}
+
+	if (s_vertexArrayCount >= BUFFER_POOL_MAX_VERTEX_ARRAYS)
+	{
+		FatalError("too many shared vertex arrays!");
+	}
+
+	SharedVertexArray_t* shared = &s_vertexArrays[s_vertexArrayCount++];
+	shared->format = format;
+	shared->vertexBuffer = vertexBuffer;
+	shared->indexBuffer = indexBuffer;
+	shared->vertexArray = CreateVertexArray(format, vertexBuffer, indexBuffer);
+	if (s_drawIndexBuffer)
+	{
+		AddDrawIndexAttribute(shared->vertexArray);
+	}
+	return shared->vertexArray;
+}
+
+void ReserveDrawIndices(uint32_t count)
+{
+	if (count <= s_drawIndexCount)
+	{
+		return;
+	}
+
+	// it goes up in powers of 2, so it doesn't get remade for every slightly bigger batch
+	uint32_t newCount = s_drawIndexCount ? s_drawIndexCount : BUFFER_POOL_MIN_DRAW_INDICES;
+	while (newCount < count)
+	{
+		newCount *= 2;
+	}
+	uint32_t* indices = malloc(newCount * sizeof(uint32_t));
+	if (!indices)
+	{
+		FatalError("failed to allocate %zu bytes!", newCount * sizeof(uint32_t));
+	}
+	for (uint32_t i = 0; i < newCount; i++)
+	{
+		indices[i] = i;
+	}
+
+	// the old buffer is only deleted once no vertex array uses it anymore
+	uint32_t oldBuffer = s_drawIndexBuffer;
+	glGenBuffers(1, &s_drawIndexBuffer);
+	SetBuffer(GL_COPY_WRITE_BUFFER, s_drawIndexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newCount * sizeof(uint32_t), indices, GL_STATIC_DRAW);
+	SetBuffer(GL_COPY_WRITE_BUFFER, 0);
+	free(indices);
+	s_drawIndexCount = newCount;
+
+	for (uint32_t i = 0; i < s_vertexArrayCount; i++)
+	{
+		AddDrawIndexAttribute(s_vertexArrays[i].vertexArray);
+	}
+	glDeleteBuffers(1, &oldBuffer);
+}
+
+void PrintBufferPoolStats(void)
+{
+	for (uint32_t i = 0; i < s_poolCount; i++)
+	{
+		BufferPool_t* pool = &s_pools[i];
+		uint64_t capacity = 1ull << pool->maxOrder;
+
+		// external fragmentation is how much of the free space can't be used for one big
+		// allocation, internal fragmentation is the space wasted by rounding up to a power of 2
+		uint64_t freeCount = 0;
+		uint64_t largestFree = 0;
+		for (uint32_t order = BUFFER_POOL_MIN_ORDER; order <= pool->maxOrder; order++)
+		{
+			for (uint32_t block = pool->freeLists[order]; block != BUFFER_POOL_NONE;
+				 block = pool->next[block])
+			{
+				freeCount += 1ull << order;
+				largestFree = 1ull << order;
+			}
+		}
+
+		printf(
+			"%s pool %u (%u byte elements%s): %u allocations, %.1f%% occupied (%.2f of %.2f MiB), "
+			"%.1f%% wasted by rounding, %.1f%% of free space fragmented\n",
+			pool->target == GL_ARRAY_BUFFER ? "Vertex" : "Index", i, pool->stride,
+			pool->dedicated ? ", dedicated" : "", pool->allocationCount,
+			100.0 * pool->usedCount / capacity, pool->usedCount * pool->stride / 1048576.0,
+			capacity * pool->stride / 1048576.0,
+			pool->usedCount ? 100.0 * (pool->usedCount - pool->requestedCount) / pool->usedCount
+							: 0.0,
+			freeCount ? 100.0 * (freeCount - largestFree) / freeCount : 0.0);
+	}
+}
+
+void DestroyBufferPools(void)
+{
+	for (uint32_t i = 0; i < s_vertexArrayCount; i++)
+	{
+		glDeleteVertexArrays(1, &s_vertexArrays[i].vertexArray);
+	}
+	s_vertexArrayCount = 0;
+	glDeleteBuffers(1, &s_drawIndexBuffer);
+	s_drawIndexBuffer = 0;
+	s_drawIndexCount = 0;
+
+	for (uint32_t i = 0; i < s_poolCount; i++)
+	{
+		BufferPool_t* pool = &s_pools[i];
+		glDeleteBuffers(1, &pool->buffer);
+		free(pool->orders);
+		free(pool->free);
+		free(pool->next);
+		free(pool->previous);
+	}
+	memset(s_pools, 0, sizeof(s_pools));
+	s_poolCount = 0;
+}
+
+static void AddDrawIndexAttribute(uint32_t vertexArray)
+{
+	// a batch of draws is drawn with one command per draw, each with a base instance that says
+	// which draw it is. the base instance doesn't show up in the shader by itself (without opengl
+	// 4.6), but it's where instanced attributes start reading, so an attribute that's the
+	// instance's number in every instance gives the shader the base instance. the I version of
+	// glVertexAttribPointer keeps the numbers as integers instead of converting them to floats.
+	// draws that aren't batched always have a base instance of 0, so they just ignore it.
+	SetVertexArray(vertexArray);
+	SetBuffer(GL_ARRAY_BUFFER, s_drawIndexBuffer);
+	glVertexAttribIPointer(VertexSemanticDrawIndex, 1, GL_UNSIGNED_INT, sizeof(uint32_t), NULL);
+	glEnableVertexAttribArray(VertexSemanticDrawIndex);
+	glVertexAttribDivisor(VertexSemanticDrawIndex, 1);
+	SetVertexArray(0);
+}
+
+static BufferPool_t* CreatePool(uint32_t target, uint32_t stride, uint32_t count)
+{
+	if (s_poolCount >= BUFFER_POOL_MAX_POOLS)
+	{
+		FatalError("too many buffer pools!");
+	}
+
+	BufferPool_t* pool = &s_pools[s_poolCount];
+	memset(pool, 0, sizeof(BufferPool_t));
+	pool->target = target;
+	pool->stride = stride;
+
+	// the biggest power of 2 elements that fits, or the smallest one that fits the allocation if
+	// that's bigger
+	pool->maxOrder = GetPoolOrder(stride);
+	while ((1ull << pool->maxOrder) < count)
+	{
+		pool->maxOrder++;
+		pool->dedicated = true;
+	}
+	if (pool->maxOrder > 31 || ((size_t)1 << pool->maxOrder) * stride > PTRDIFF_MAX)
+	{
+		FatalError("%u elements of %u bytes is too big for a buffer!", count, stride);
+	}
+	pool->blockCount = 1u << (pool->maxOrder - BUFFER_POOL_MIN_ORDER);
+
+	pool->orders = calloc(pool->blockCount, sizeof(uint8_t));
+	pool->free = calloc(pool->blockCount, sizeof(bool));
+	pool->next = calloc(pool->blockCount, sizeof(uint32_t));
+	pool->previous = calloc(pool->blockCount, sizeof(uint32_t));
+	if (!pool->orders || !pool->free || !pool->next || !pool->previous)
+	{
+		FatalError("failed to allocate buffer pool bookkeeping!");
+	}
+
+	// at first, the whole buffer is one free block
+	for (uint32_t i = 0; i < 32; i++)
+	{
+		pool->freeLists[i] = BUFFER_POOL_NONE;
+	}
+	PushFreeBlock(pool, 0, pool->maxOrder);
+
+	// the data is uploaded later, NULL just reserves the space
+	size_t size = ((size_t)1 << pool->maxOrder) * stride;
+	glGenBuffers(1, &pool->buffer);
+	SetBuffer(GL_COPY_WRITE_BUFFER, pool->buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+	SetBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	char label[32] = {0};
+	int32_t labelLength = snprintf(
+		label, sizeof(label), "%s pool %u", target == GL_ARRAY_BUFFER ? "Vertex" : "Index",
+		s_poolCount);
+	glObjectLabel(GL_BUFFER, pool->buffer, labelLength, label);
+
+	printf(
+		"Created %s%s pool %u with %u elements of %u bytes (%.2f MiB)\n",
+		pool->dedicated ? "dedicated " : "", target == GL_ARRAY_BUFFER ? "vertex" : "index",
+		s_poolCount, 1u << pool->maxOrder, stride, size / 1048576.0);
+
+	s_poolCount++;
+	return pool;
+}
+
+static uint32_t GetPoolOrder(uint32_t stride)
+{
+	uint32_t order = BUFFER_POOL_MIN_ORDER;
+	while (((size_t)2 << order) * stride <= BUFFER_POOL_SIZE)
+	{
+		order++;
+	}
+	return order;
+}
+
+static bool AllocateBlock(BufferPool_t* pool, uint32_t count, uint32_t* offset)
+{
+	// find the order of the smallest block that fits
+	uint32_t order = BUFFER_POOL_MIN_ORDER;
+	while (order <= pool->maxOrder && (1u << order) < count)
+	{
+		order++;
+	}
+	if (order > pool->maxOrder)
+	{
+		return false;
+	}
+
+	// find the smallest free block that's at least that big
+	uint32_t freeOrder = order;
+	while (freeOrder <= pool->maxOrder && pool->freeLists[freeOrder] == BUFFER_POOL_NONE)
+	{
+		freeOrder++;
+	}
+	if (freeOrder > pool->maxOrder)
+	{
+		return false;
+	}
+
+	uint32_t block = pool->freeLists[freeOrder];
+	RemoveFreeBlock(pool, block, freeOrder);
+
+	// split it in half until it's the right size, the second half of each split is free
+	while (freeOrder > order)
+	{
+		freeOrder--;
+		PushFreeBlock(pool, block + (1u << (freeOrder - BUFFER_POOL_MIN_ORDER)), freeOrder);
+	}
+
+	pool->orders[block] = (uint8_t)order;
+	pool->free[block] = false;
+	pool->usedCount += 1u << order;
+	pool->requestedCount += count;
+	pool->allocationCount++;
+
+	*offset = block << BUFFER_POOL_MIN_ORDER;
+	return true;
+}
+
+static void FreeBlock(BufferPool_t* pool, uint32_t offset)
+{
+	uint32_t block = offset >> BUFFER_POOL_MIN_ORDER;
+	uint32_t order = pool->orders[block];
+	pool->usedCount -= 1u << order;
+	pool->allocationCount--;
+
+	// a block's buddy is the other half of the block it was split from, and flipping the bit for
+	// its size gives its position
+	while (order < pool->maxOrder)
+	{
+		uint32_t buddy = block ^ (1u << (order - BUFFER_POOL_MIN_ORDER));
+		if (!pool->free[buddy] || pool->orders[buddy] != order)
+		{
+			break;
+		}
+
+		RemoveFreeBlock(pool, buddy, order);
+		block = block < buddy ? block : buddy;
+		order++;
+	}
+
+	PushFreeBlock(pool, block, order);
+}
+
+static void PushFreeBlock(BufferPool_t* pool, uint32_t block, uint32_t order)
+{
+	pool->orders[block] = (uint8_t)order;
+	pool->free[block] = true;
+	pool->previous[block] = BUFFER_POOL_NONE;
+	pool->next[block] = pool->freeLists[order];
+	if (pool->freeLists[order] != BUFFER_POOL_NONE)
+	{
+		pool->previous[pool->freeLists[order]] = block;
+	}
+	pool->freeLists[order] = block;
+}
+
+static void RemoveFreeBlock(BufferPool_t* pool, uint32_t block, uint32_t order)
+{
+	if (pool->previous[block] != BUFFER_POOL_NONE)
+	{
+		pool->next[pool->previous[block]] = pool->next[block];
+	}
+	else
+	{
+		pool->freeLists[order] = pool->next[block];
+	}
+	if (pool->next[block] != BUFFER_POOL_NONE)
+	{
+		pool->previous[pool->next[block]] = pool->previous[block];
+	}
+	pool->free[block] = false;
+}
@@ -0,0 +1,440 @@
+// this file implements capturing frames without stalling the gpu
+
+#include "stuff.h"
+
+// the states a pixel buffer goes through. the gl thread moves it from free to reading to mapped,
+// the writer thread moves it from mapped to written, and then the gl thread unmaps it and it's
+// free again.
+typedef enum CaptureState
+{
+	CaptureStateFree,    // not being used
+	CaptureStateReading, // glReadPixels was called, and the gpu might not be done copying yet
+	CaptureStateMapped,  // the copy is done and the buffer is mapped, it's waiting to be written
+	CaptureStateWritten, // the writer thread is done with it, it can be unmapped
+} CaptureState_t;
+
+// one of the pixel buffers in the ring
+typedef struct CaptureSlot
+{
+	uint32_t buffer;      // the pixel buffer object
+	size_t bufferSize;    // how big the buffer is
+	GLsync fence;         // signalled by the gpu once the copy is done
+	const uint8_t* pixels; // the mapped buffer
+	int32_t width;
+	int32_t height;
+	uint64_t frame; // which frame this is
+	CaptureState_t state;
+} CaptureSlot_t;
+
+// wait for a slot to be done copying, then map it and give it to the writer thread
+static void MapSlot(CaptureSlot_t* slot, bool wait);
+
+// unmap a slot once the writer thread is done with it
+static void ReleaseSlot(CaptureSlot_t* slot);
+
+// the writer thread, it writes out slots in the order they were read
+static void WriterThread(void* data);
+
+// write one frame to the output
+static void WriteFrame(const CaptureSlot_t* slot);
+
+static CaptureSlot_t* s_slots; // the ring of pixel buffers
+static uint32_t s_slotCount;   // the size of the ring
+static uint32_t s_nextSlot;    // the slot the next frame gets read into
+static uint32_t s_writeSlot;   // the slot the writer thread writes next
+static uint64_t s_frameCount;  // the number of frames that have been read
+static uint64_t s_stallCount;  // the number of times the ring was full and the gl thread had to wait
+static uint64_t s_startTime;   // when the first frame was captured
+static uint64_t s_bytesWritten; // the number of bytes of image data written
+
+// the output
+static const char* s_outputName;
+static FILE* s_output;
+static bool s_y4m;         // if the output is a yuv4mpeg2 video instead of ppm images
+static bool s_singleFile;  // if every frame goes in the same file
+static int32_t s_y4mWidth; // the size of the video, frames that aren't this size get skipped
+static int32_t s_y4mHeight;
+static uint8_t* s_frameBuffer; // where the writer thread converts pixels before writing them
+
+// the writer thread, and what's used to tell it about new slots
+static Thread_t s_writerThread;
+static Mutex_t s_mutex;
+static Condition_t s_condition;
+static bool s_stopping;
+
+void StartCapture(const char* outputName, uint32_t ringSize)
+{
+	// with less than 3, the gpu doesn't get enough time to finish copying before the buffer is
+	// needed again
+	s_slotCount = ringSize < 3 ? 3 : ringSize;
+	s_slots = calloc(s_slotCount, sizeof(CaptureSlot_t));
+	if (!s_slots)
+	{
+		FatalError("failed to allocate %zu bytes!", s_slotCount * sizeof(CaptureSlot_t));
+	}
+
+	// the buffers get their storage when they're first used, because the window size can change
+	for (uint32_t i = 0; i < s_slotCount; i++)
+	{
+		glGenBuffers(1, &s_slots[i].buffer);
+		char label[32] = {0};
+		int32_t labelLength = snprintf(label, sizeof(label), "Capture buffer %u", i);
+		SetBuffer(GL_PIXEL_PACK_BUFFER, s_slots[i].buffer);
+		glObjectLabel(GL_BUFFER, s_slots[i].buffer, labelLength, label);
+	}
+	SetBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	s_outputName = outputName;
+	size_t nameLength = strlen(outputName);
+	s_y4m = nameLength >= 4 && strcmp(outputName + nameLength - 4, ".y4m") == 0;
+	s_singleFile = s_y4m || !strchr(outputName, '%');
+	if (s_singleFile)
+	{
+		s_output = fopen(outputName, "wb");
+		if (!s_output)
+		{
+			FatalError("failed to open %s for writing!", outputName);
+		}
+	}
+
+	s_nextSlot = 0;
+	s_writeSlot = 0;
+	s_frameCount = 0;
+	s_stallCount = 0;
+	s_bytesWritten = 0;
+	s_stopping = false;
+
+	InitMutex(&s_mutex);
+	InitCondition(&s_condition);
+	s_writerThread = StartThread(WriterThread, NULL, "Capture writer");
+
+	printf(
+		"Capturing frames to %s as %s with %u pixel buffers\n", outputName,
+		s_y4m ? "y4m" : "ppm", s_slotCount);
+}
+
+void CaptureFrame(void)
+{
+	if (!s_slots)
+	{
+		return;
+	}
+
+	if (!s_frameCount)
+	{
+		s_startTime = GetTime();
+	}
+
+	// first, go through the older frames and hand off any that the gpu is done with, and unmap any
+	// the writer thread is done with. this never waits.
+	for (uint32_t i = 0; i < s_slotCount; i++)
+	{
+		CaptureSlot_t* slot = &s_slots[(s_nextSlot + i) % s_slotCount];
+		LockMutex(&s_mutex);
+		CaptureState_t state = slot->state;
+		UnlockMutex(&s_mutex);
+
+		if (state == CaptureStateReading)
+		{
+			MapSlot(slot, false);
+		}
+		else if (state == CaptureStateWritten)
+		{
+			ReleaseSlot(slot);
+		}
+	}
+
+	// if the next slot is still in use, the ring is full. the frame in it is from s_slotCount frames
+	// ago, so waiting on it doesn't wait for the current frame, but it does mean the gpu or the
+	// disk isn't keeping up.
+	CaptureSlot_t* slot = &s_slots[s_nextSlot];
+	LockMutex(&s_mutex);
+	CaptureState_t state = slot->state;
+	UnlockMutex(&s_mutex);
+	if (state != CaptureStateFree)
+	{
+		s_stallCount++;
+		if (state == CaptureStateReading)
+		{
+			MapSlot(slot, true);
+		}
+
+		LockMutex(&s_mutex);
+		while (slot->state != CaptureStateWritten)
+		{
+			WaitCondition(&s_condition, &s_mutex);
+		}
+		UnlockMutex(&s_mutex);
+		ReleaseSlot(slot);
+	}
+
+	slot->width = GetWindowWidth();
+	slot->height = GetWindowHeight();
+	slot->frame = s_frameCount++;
+
+	// the pixels are read as rgba because that's what the framebuffer is in, so the driver can copy
+	// them without converting them. the writer thread converts them instead.
+	SetBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+	size_t size = (size_t)slot->width * slot->height * 4;
+	if (size > slot->bufferSize)
+	{
+		// stream read means it gets written once by opengl and read once by the cpu
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		slot->bufferSize = size;
+	}
+
+	// rows are tightly packed, the default is to pad them to 4 bytes (which rgba already is)
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	// when a pixel pack buffer is bound, the last parameter is an offset into it instead of a
+	// pointer, and the function returns right away instead of waiting for the copy
+	glReadPixels(0, 0, slot->width, slot->height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)(0));
+	SetBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// a fence gets signalled once the gpu gets to it, which means the copy before it is done
+	slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	LockMutex(&s_mutex);
+	slot->state = CaptureStateReading;
+	UnlockMutex(&s_mutex);
+
+	s_nextSlot = (s_nextSlot + 1) % s_slotCount;
+}
+
+void StopCapture(void)
+{
+	if (!s_slots)
+	{
+		return;
+	}
+
+	// hand off everything that's left, in order. only this thread ever sets the reading state, so
+	// it's the only one that could change it.
+	for (uint32_t i = 0; i < s_slotCount; i++)
+	{
+		CaptureSlot_t* slot = &s_slots[(s_nextSlot + i) % s_slotCount];
+		LockMutex(&s_mutex);
+		CaptureState_t state = slot->state;
+		UnlockMutex(&s_mutex);
+		if (state == CaptureStateReading)
+		{
+			MapSlot(slot, true);
+		}
+	}
+
+	// tell the writer thread to finish up and wait for it
+	LockMutex(&s_mutex);
+	s_stopping = true;
+	BroadcastCondition(&s_condition);
+	UnlockMutex(&s_mutex);
+	JoinThread(s_writerThread);
+
+	uint64_t endTime = GetTime();
+
+	for (uint32_t i = 0; i < s_slotCount; i++)
+	{
+		if (s_slots[i].state == CaptureStateWritten)
+		{
+			ReleaseSlot(&s_slots[i]);
+		}
+		glDeleteBuffers(1, &s_slots[i].buffer);
+	}
+
+	if (s_output)
+	{
+		fclose(s_output);
+		s_output = NULL;
+	}
+
+	double seconds = (endTime - s_startTime) / 1e9;
+	printf(
+		"Captured %" PRIu64 " frames (%.1f MiB) in %.3f s: %.2f fps, %.1f MiB/s, ring was full %" PRIu64
+		" times\n",
+		s_frameCount, s_bytesWritten / (1024.0 * 1024.0), seconds,
+		seconds > 0 ? s_frameCount / seconds : 0.0,
+		seconds > 0 ? s_bytesWritten / (1024.0 * 1024.0) / seconds : 0.0, s_stallCount);
+
+	DestroyCondition(&s_condition);
+	DestroyMutex(&s_mutex);
+	free(s_frameBuffer);
+	s_frameBuffer = NULL;
+	free(s_slots);
+	s_slots = NULL;
+}
+
+static void MapSlot(CaptureSlot_t* slot, bool wait)
+{
+	// a timeout of 0 just checks if it's signalled. the flush bit makes sure the fence actually gets
+	// sent to the gpu, otherwise waiting on it could wait forever.
+	GLenum result = glClientWaitSync(
+		slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		return;
+	}
+	if (result == GL_WAIT_FAILED)
+	{
+		FatalError("failed to wait for capture fence: %d!", glGetError());
+	}
+
+	glDeleteSync(slot->fence);
+	slot->fence = NULL;
+
+	// mapping gives a pointer to the buffer's memory, which any thread can read from. only
+	// unmapping has to be done on this thread.
+	SetBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+	slot->pixels = glMapBufferRange(
+		GL_PIXEL_PACK_BUFFER, 0, (size_t)slot->width * slot->height * 4, GL_MAP_READ_BIT);
+	SetBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	if (!slot->pixels)
+	{
+		FatalError("failed to map capture buffer: %d!", glGetError());
+	}
+
+	LockMutex(&s_mutex);
+	slot->state = CaptureStateMapped;
+	BroadcastCondition(&s_condition);
+	UnlockMutex(&s_mutex);
+}
+
+static void ReleaseSlot(CaptureSlot_t* slot)
+{
+	SetBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	SetBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot->pixels = NULL;
+
+	LockMutex(&s_mutex);
+	slot->state = CaptureStateFree;
+	UnlockMutex(&s_mutex);
+}
+
+static void WriterThread(void* data)
+{
+	(void)data;
+
+	LockMutex(&s_mutex);
+	while (true)
+	{
+		// frames have to be written in order, so this only ever looks at the next one
+		CaptureSlot_t* slot = &s_slots[s_writeSlot];
+		if (slot->state == CaptureStateMapped)
+		{
+			// the mutex doesn't need to be held while writing, the gl thread won't touch a slot
+			// that's mapped
+			UnlockMutex(&s_mutex);
+			CPU_ZONE_BEGIN("WriteFrame");
+			WriteFrame(slot);
+			CPU_ZONE_END();
+			LockMutex(&s_mutex);
+
+			slot->state = CaptureStateWritten;
+			s_writeSlot = (s_writeSlot + 1) % s_slotCount;
+			BroadcastCondition(&s_condition);
+		}
+		else if (s_stopping)
+		{
+			// StopCapture maps everything before stopping, so there's nothing left
+			break;
+		}
+		else
+		{
+			WaitCondition(&s_condition, &s_mutex);
+		}
+	}
+	UnlockMutex(&s_mutex);
+}
+
+static void WriteFrame(const CaptureSlot_t* slot)
+{
+	FILE* output = s_output;
+	if (!s_singleFile)
+	{
+		char name[512] = {0};
+		snprintf(name, sizeof(name), s_outputName, (uint32_t)slot->frame);
+		output = fopen(name, "wb");
+		if (!output)
+		{
+			FatalError("failed to open %s for writing!", name);
+		}
+	}
+
+	if (s_y4m)
+	{
+		// videos can't change size, so the size of the first frame is used
+		if (!s_y4mWidth)
+		{
+			s_y4mWidth = slot->width;
+			s_y4mHeight = slot->height;
+			// C444 means the colour isn't subsampled, so every pixel gets its own u and v. the frame
+			// rate doesn't matter for captures, 60 is just a reasonable guess.
+			fprintf(
+				output, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444\n", s_y4mWidth, s_y4mHeight);
+		}
+		if (slot->width != s_y4mWidth || slot->height != s_y4mHeight)
+		{
+			return;
+		}
+	}
+	else
+	{
+		// the ppm header is the type (P6 is binary rgb), the size, and the maximum value
+		fprintf(output, "P6\n%d %d\n255\n", slot->width, slot->height);
+	}
+
+	// the whole frame gets converted and then written with one fwrite, which is a lot faster than
+	// writing it a piece at a time
+	size_t pixelCount = (size_t)slot->width * slot->height;
+	size_t frameSize = pixelCount * 3;
+	uint8_t* converted = realloc(s_frameBuffer, frameSize);
+	if (!converted)
+	{
+		FatalError("failed to allocate %zu bytes!", frameSize);
+	}
+	s_frameBuffer = converted;
+
+	// y4m frames are planar, so the whole y plane, then the u plane, then the v plane
+	uint8_t* yPlane = converted;
+	uint8_t* uPlane = converted + pixelCount;
+	uint8_t* vPlane = converted + pixelCount * 2;
+
+	// opengl's origin is the bottom left, but images start at the top
+	for (int32_t y = 0; y < slot->height; y++)
+	{
+		const uint8_t* pixel = slot->pixels + (size_t)(slot->height - 1 - y) * slot->width * 4;
+		size_t rowStart = (size_t)y * slot->width;
+		for (int32_t x = 0; x < slot->width; x++, pixel += 4)
+		{
+			int32_t r = pixel[0];
+			int32_t g = pixel[1];
+			int32_t b = pixel[2];
+			size_t i = rowStart + x;
+			if (s_y4m)
+			{
+				// these are the usual bt.601 integer formulas, with the video range (16-235) that
+				// y4m expects by default
+				yPlane[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+				uPlane[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+				vPlane[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+			}
+			else
+			{
+				converted[i * 3 + 0] = (uint8_t)r;
+				converted[i * 3 + 1] = (uint8_t)g;
+				converted[i * 3 + 2] = (uint8_t)b;
+			}
+		}
+	}
+
+	if (s_y4m)
+	{
+		fprintf(output, "FRAME\n");
+	}
+	fwrite(converted, 1, frameSize, output);
+	s_bytesWritten += frameSize;
+
+	if (!s_singleFile)
+	{
+		fclose(output);
+	}
+}
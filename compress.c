@@ -0,0 +1,526 @@
+// this file implements a compression format for .pak files. it's the same format as lz4's blocks,
+// which is one of the fastest to decompress there is, because it's byte aligned and has no entropy
+// coding: the compressed data is a list of sequences, each of which is some bytes to copy as they
+// are (literals), followed by a match, which is an offset back into what's already been
+// decompressed and a length to copy from there. decompressing is basically just memcpy.
+//
+// a sequence starts with a token byte. its high 4 bits are the number of literals and its low 4
+// bits are the match length - 4 (a match has to be at least 4 bytes to be worth it). 15 means the
+// length keeps going in the bytes after it, which are added on until one isn't 255. then come the
+// literals, then the offset as 2 bytes, then the rest of the match length. the last sequence only
+// has literals.
+//
+// files get compressed in separate 64 KiB blocks, so offsets always fit in 16 bits, and blocks can
+// be decompressed in parallel. that's a bit worse at compressing than one big block, since matches
+// can't reach into the block before, but the ratio is about the same past a few KiB. a compressed
+// file starts with the compressed size of each block as 4 bytes, then the blocks. a block that
+// doesn't get any smaller is stored as it is, so a block that's the same size compressed isn't
+// compressed.
+//
+// copies are done 16 bytes at a time with sse2 when there's room to go past the end of what's being
+// copied, which is most of the time, and matches are compared 16 bytes at a time too.
+
+#include "stuff.h"
+
+// the same idea as in raster.c, sse2 is always there on x86_64, and anything else gets plain c
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define COMPRESS_SIMD_NAME "sse2"
+#else
+#define COMPRESS_SIMD_NAME "scalar"
+#endif
+
+// the number of bits in the hash of 4 bytes that the compressor uses to find matches. the table
+// has 1 << COMPRESS_HASH_BITS 16 bit positions in it, which is 16 KiB.
+#define COMPRESS_HASH_BITS 13
+
+// the shortest a match can be, anything shorter costs more than the literals would
+#define COMPRESS_MIN_MATCH 4
+
+// the last match has to start this far from the end, and the last 5 bytes are always literals. lz4
+// has the same rules, they let a decompressor copy past the end of a match without checking.
+#define COMPRESS_LAST_MATCH 12
+#define COMPRESS_LAST_LITERALS 5
+
+// copy 16 bytes, they can't overlap
+static void Copy16(uint8_t* destination, const uint8_t* source);
+
+// how many bytes are the same, starting at a and b, up to limit
+static size_t CountMatching(const uint8_t* a, const uint8_t* b, const uint8_t* limit);
+
+// write the rest of a length that's 15 or more into the token
+static uint8_t* WriteLength(uint8_t* output, size_t length);
+
+// read the rest of a length, returns false if it runs off the end of the input
+static bool ReadLength(const uint8_t** input, const uint8_t* end, size_t* length);
+
+// decompressing the blocks of a file on the job threads
+typedef struct DecompressJob
+{
+	const uint8_t* input;
+	const size_t* offsets; // where each block starts in input
+	const uint32_t* sizes; // how big each block is in input
+	uint8_t* output;
+	size_t size;
+	atomic_bool failed;
+} DecompressJob_t;
+
+// decompress one block of a file
+static void DecompressJob(void* data, uint32_t index);
+
+// find where the blocks of a file are, returns false if it's broken
+static bool FindBlocks(
+	const uint8_t* input, size_t inputSize, size_t outputSize, size_t* offsets, uint32_t* sizes);
+
+size_t GetCompressBound(size_t size)
+{
+	// incompressible data is all literals, which costs an extra byte for every 255 of them, plus
+	// the token
+	return size + size / 255 + 16;
+}
+
+uint32_t GetBlockCount(size_t size)
+{
+	return (uint32_t)((size + COMPRESS_BLOCK_SIZE - 1) / COMPRESS_BLOCK_SIZE);
+}
+
+size_t CompressBlock(const uint8_t* input, size_t size, uint8_t* output)
+{
+	const uint8_t* in = input;
+	const uint8_t* end = input + size;
+	const uint8_t* anchor = input; // where the literals for the next sequence start
+	uint8_t* out = output;
+
+	if (size > COMPRESS_LAST_MATCH)
+	{
+		// the table is where each hash was last seen. it starts at 0, which is a real position,
+		// but matches always get checked, so a wrong one just doesn't match.
+		uint16_t table[1 << COMPRESS_HASH_BITS] = {0};
+		const uint8_t* matchStartLimit = end - COMPRESS_LAST_MATCH;
+		const uint8_t* matchEndLimit = end - COMPRESS_LAST_LITERALS;
+		uint32_t misses = 0;
+
+		while (in < matchStartLimit)
+		{
+			// multiplying by a big odd number and taking the top bits is a good enough hash
+			uint32_t bytes;
+			memcpy(&bytes, in, sizeof(uint32_t));
+			uint32_t hash = (bytes * 2654435761u) >> (32 - COMPRESS_HASH_BITS);
+			const uint8_t* match = input + table[hash];
+			table[hash] = (uint16_t)(in - input);
+
+			uint32_t matchBytes;
+			memcpy(&matchBytes, match, sizeof(uint32_t));
+			if (match >= in || matchBytes != bytes)
+			{
+				// data that doesn't match much gets skipped through faster and faster, so
+				// compressing something incompressible doesn't take forever
+				in += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+
+			// extend the match backwards over literals that happen to match too
+			while (in > anchor && match > input && in[-1] == match[-1])
+			{
+				in--;
+				match--;
+			}
+			size_t matchLength = COMPRESS_MIN_MATCH;
+			matchLength += CountMatching(
+				in + COMPRESS_MIN_MATCH, match + COMPRESS_MIN_MATCH, matchEndLimit);
+
+			// the token, then the literals, then the match
+			size_t literalCount = (size_t)(in - anchor);
+			uint8_t* token = out++;
+			*token = (uint8_t)((literalCount < 15 ? literalCount : 15) << 4);
+			if (literalCount >= 15)
+			{
+				out = WriteLength(out, literalCount - 15);
+			}
+			memcpy(out, anchor, literalCount);
+			out += literalCount;
+
+			uint16_t offset = (uint16_t)(in - match);
+			*out++ = (uint8_t)offset;
+			*out++ = (uint8_t)(offset >> 8);
+			size_t extra = matchLength - COMPRESS_MIN_MATCH;
+			*token |= (uint8_t)(extra < 15 ? extra : 15);
+			if (extra >= 15)
+			{
+				out = WriteLength(out, extra - 15);
+			}
+
+			in += matchLength;
+			anchor = in;
+		}
+	}
+
+	// whatever's left is literals
+	size_t literalCount = (size_t)(end - anchor);
+	*out++ = (uint8_t)((literalCount < 15 ? literalCount : 15) << 4);
+	if (literalCount >= 15)
+	{
+		out = WriteLength(out, literalCount - 15);
+	}
+	memcpy(out, anchor, literalCount);
+	out += literalCount;
+
+	return (size_t)(out - output);
+}
+
+bool DecompressBlock(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputSize)
+{
+	const uint8_t* in = input;
+	const uint8_t* inEnd = input + inputSize;
+	uint8_t* out = output;
+	uint8_t* outEnd = output + outputSize;
+
+	// everything gets checked, so broken data fails instead of writing somewhere it shouldn't
+	while (in < inEnd)
+	{
+		uint8_t token = *in++;
+
+		// the most common sequence is a few literals and a short match that isn't too close, which
+		// can be done with a few 16 byte copies and no loops when it's not near the end
+		if ((token >> 4) < 15 && (token & 15) < 15 && inEnd - in >= 16 && outEnd - out >= 48)
+		{
+			size_t shortLiteralCount = token >> 4;
+			size_t shortOffset =
+				(size_t)in[shortLiteralCount] | (size_t)in[shortLiteralCount + 1] << 8;
+			if (shortOffset >= 16 && shortOffset <= (size_t)(out - output) + shortLiteralCount)
+			{
+				Copy16(out, in);
+				in += shortLiteralCount + 2;
+				out += shortLiteralCount;
+				Copy16(out, out - shortOffset);
+				Copy16(out + 16, out - shortOffset + 16);
+				out += (token & 15) + COMPRESS_MIN_MATCH;
+				continue;
+			}
+		}
+
+		size_t literalCount = token >> 4;
+		if (literalCount == 15 && !ReadLength(&in, inEnd, &literalCount))
+		{
+			return false;
+		}
+		if (literalCount > (size_t)(inEnd - in) || literalCount > (size_t)(outEnd - out))
+		{
+			return false;
+		}
+		if ((size_t)(inEnd - in) >= literalCount + 16 &&
+			(size_t)(outEnd - out) >= literalCount + 16)
+		{
+			// there's room to copy a bit past the end, so it can be done 16 bytes at a time. the
+			// extra bytes get written over by whatever comes next.
+			for (size_t i = 0; i < literalCount; i += 16)
+			{
+				Copy16(out + i, in + i);
+			}
+		}
+		else
+		{
+			memcpy(out, in, literalCount);
+		}
+		in += literalCount;
+		out += literalCount;
+
+		// the last sequence doesn't have a match
+		if (in == inEnd)
+		{
+			break;
+		}
+
+		if (inEnd - in < 2)
+		{
+			return false;
+		}
+		size_t offset = (size_t)in[0] | (size_t)in[1] << 8;
+		in += 2;
+		if (offset == 0 || offset > (size_t)(out - output))
+		{
+			return false;
+		}
+
+		size_t matchLength = token & 15;
+		if (matchLength == 15 && !ReadLength(&in, inEnd, &matchLength))
+		{
+			return false;
+		}
+		matchLength += COMPRESS_MIN_MATCH;
+		if (matchLength > (size_t)(outEnd - out))
+		{
+			return false;
+		}
+
+		const uint8_t* match = out - offset;
+		if ((size_t)(outEnd - out) >= matchLength + 16)
+		{
+			// a match less than 16 bytes back is repeating a short pattern (a run of zeroes is a
+			// match 1 byte back), and copying 16 bytes of it at once would read bytes that haven't
+			// been written yet. but the pattern also repeats every 2, 4, etc times its length, so
+			// once the first 16 or more bytes are written one at a time, the rest can be copied 16
+			// at a time from that far back.
+			size_t distance = offset;
+			size_t i = 0;
+			if (offset < 16)
+			{
+				while (distance < 16)
+				{
+					distance *= 2;
+				}
+				for (; i < distance && i < matchLength; i++)
+				{
+					out[i] = match[i];
+				}
+			}
+			for (; i < matchLength; i += 16)
+			{
+				Copy16(out + i, out + i - distance);
+			}
+		}
+		else
+		{
+			// near the end of the output there's no room to go past the end of the match
+			for (size_t i = 0; i < matchLength; i++)
+			{
+				out[i] = match[i];
+			}
+		}
+		out += matchLength;
+	}
+
+	return out == outEnd;
+}
+
+size_t CompressBlocks(const uint8_t* input, size_t size, uint8_t* output)
+{
+	uint32_t blockCount = GetBlockCount(size);
+	uint8_t* out = output + blockCount * sizeof(uint32_t);
+	for (uint32_t i = 0; i < blockCount; i++)
+	{
+		size_t offset = (size_t)i * COMPRESS_BLOCK_SIZE;
+		size_t blockSize =
+			size - offset < COMPRESS_BLOCK_SIZE ? size - offset : COMPRESS_BLOCK_SIZE;
+		size_t compressedSize = CompressBlock(input + offset, blockSize, out);
+		if (compressedSize >= blockSize)
+		{
+			memcpy(out, input + offset, blockSize);
+			compressedSize = blockSize;
+		}
+		uint32_t storedSize = (uint32_t)compressedSize;
+		memcpy(output + i * sizeof(uint32_t), &storedSize, sizeof(uint32_t));
+		out += compressedSize;
+	}
+	return (size_t)(out - output);
+}
+
+bool DecompressBlocks(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputSize)
+{
+	uint32_t blockCount = GetBlockCount(outputSize);
+	size_t* offsets = malloc((blockCount + 1) * sizeof(size_t));
+	uint32_t* sizes = malloc((blockCount + 1) * sizeof(uint32_t));
+	if (!offsets || !sizes)
+	{
+		FatalError("failed to allocate the offsets of %u blocks!", blockCount);
+	}
+
+	bool success = FindBlocks(input, inputSize, outputSize, offsets, sizes);
+	if (success)
+	{
+		DecompressJob_t job = {
+			.input = input,
+			.offsets = offsets,
+			.sizes = sizes,
+			.output = output,
+			.size = outputSize,
+		};
+		atomic_store(&job.failed, false);
+		RunJobs(DecompressJob, &job, blockCount);
+		success = !atomic_load(&job.failed);
+	}
+
+	free(sizes);
+	free(offsets);
+	return success;
+}
+
+void BenchmarkCompression(const char* name)
+{
+	MappedFile_t file = MapFile(name);
+	uint32_t blockCount = GetBlockCount(file.size);
+	uint8_t* compressed =
+		malloc(blockCount * (sizeof(uint32_t) + GetCompressBound(COMPRESS_BLOCK_SIZE)) + 1);
+	size_t* offsets = malloc((blockCount + 1) * sizeof(size_t));
+	uint32_t* sizes = malloc((blockCount + 1) * sizeof(uint32_t));
+	uint8_t* output = malloc(file.size + 1);
+	if (!compressed || !offsets || !sizes || !output)
+	{
+		FatalError("failed to allocate memory to benchmark compressing %s!", name);
+	}
+
+	uint64_t start = GetTime();
+	size_t compressedSize = CompressBlocks(file.data, file.size, compressed);
+	double compressTime = (GetTime() - start) / 1e9;
+
+	// decompressing is so fast it has to be done a bunch of times to measure it properly. it's
+	// done on one thread, and then on the job threads.
+	uint32_t rounds = (uint32_t)(1024 * 1024 * 1024 / (file.size + 1)) + 1;
+	rounds = rounds > 1000 ? 1000 : rounds;
+	FindBlocks(compressed, compressedSize, file.size, offsets, sizes);
+	DecompressJob_t job = {
+		.input = compressed,
+		.offsets = offsets,
+		.sizes = sizes,
+		.output = output,
+		.size = file.size,
+	};
+	atomic_store(&job.failed, false);
+	start = GetTime();
+	for (uint32_t round = 0; round < rounds; round++)
+	{
+		for (uint32_t i = 0; i < blockCount; i++)
+		{
+			DecompressJob(&job, i);
+		}
+	}
+	double singleTime = (GetTime() - start) / 1e9 / rounds;
+	bool success = !atomic_load(&job.failed) && memcmp(output, file.data, file.size) == 0;
+
+	memset(output, 0, file.size);
+	start = GetTime();
+	for (uint32_t round = 0; round < rounds; round++)
+	{
+		success &= DecompressBlocks(compressed, compressedSize, output, file.size);
+	}
+	double parallelTime = (GetTime() - start) / 1e9 / rounds;
+	if (!success || memcmp(output, file.data, file.size) != 0)
+	{
+		FatalError("decompressing %s didn't give back the same data!", name);
+	}
+
+	// the ratio is how much less has to be read from the disk, and the decompression speed is how
+	// fast the disk would have to be for reading it uncompressed to be faster
+	printf(
+		"%s: %.2f MiB to %.2f MiB (ratio %.2f), compressed at %.1f MiB/s, decompressed at %.2f "
+		"GB/s on 1 thread and %.2f GB/s on %u (%s)\n",
+		name, file.size / 1048576.0, compressedSize / 1048576.0,
+		compressedSize ? (double)file.size / compressedSize : 0.0,
+		file.size / 1048576.0 / compressTime, file.size / 1e9 / singleTime,
+		file.size / 1e9 / parallelTime, GetJobThreadCount(), COMPRESS_SIMD_NAME);
+
+	free(output);
+	free(sizes);
+	free(offsets);
+	free(compressed);
+	UnmapFile(&file);
+}
+
+static void Copy16(uint8_t* destination, const uint8_t* source)
+{
+#if defined(__SSE2__) || defined(_M_X64)
+	_mm_storeu_si128((__m128i*)destination, _mm_loadu_si128((const __m128i*)source));
+#else
+	memcpy(destination, source, 16);
+#endif
+}
+
+static size_t CountMatching(const uint8_t* a, const uint8_t* b, const uint8_t* limit)
+{
+	const uint8_t* start = a;
+
+#if defined(__SSE2__) || defined(_M_X64)
+	// compare 16 bytes at once, the mask has a bit set for each one that's the same, so the first
+	// one that isn't is the first 0 bit
+	while (limit - a >= 16)
+	{
+		__m128i equal = _mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(equal) ^ 0xffff;
+		if (mask)
+		{
+			uint32_t first = 0;
+			while (!(mask & (1u << first)))
+			{
+				first++;
+			}
+			return (size_t)(a - start) + first;
+		}
+		a += 16;
+		b += 16;
+	}
+#endif
+
+	while (a < limit && *a == *b)
+	{
+		a++;
+		b++;
+	}
+	return (size_t)(a - start);
+}
+
+static uint8_t* WriteLength(uint8_t* output, size_t length)
+{
+	while (length >= 255)
+	{
+		*output++ = 255;
+		length -= 255;
+	}
+	*output++ = (uint8_t)length;
+	return output;
+}
+
+static bool ReadLength(const uint8_t** input, const uint8_t* end, size_t* length)
+{
+	uint8_t byte;
+	do
+	{
+		if (*input >= end)
+		{
+			return false;
+		}
+		byte = *(*input)++;
+		*length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+static void DecompressJob(void* data, uint32_t index)
+{
+	DecompressJob_t* job = data;
+	size_t offset = (size_t)index * COMPRESS_BLOCK_SIZE;
+	size_t blockSize =
+		job->size - offset < COMPRESS_BLOCK_SIZE ? job->size - offset : COMPRESS_BLOCK_SIZE;
+	const uint8_t* input = job->input + job->offsets[index];
+	if (job->sizes[index] == blockSize)
+	{
+		memcpy(job->output + offset, input, blockSize);
+	}
+	else if (!DecompressBlock(input, job->sizes[index], job->output + offset, blockSize))
+	{
+		atomic_store(&job->failed, true);
+	}
+}
+
+static bool FindBlocks(
+	const uint8_t* input, size_t inputSize, size_t outputSize, size_t* offsets, uint32_t* sizes)
+{
+	uint32_t blockCount = GetBlockCount(outputSize);
+	size_t offset = blockCount * sizeof(uint32_t);
+	if (offset > inputSize)
+	{
+		return false;
+	}
+	for (uint32_t i = 0; i < blockCount; i++)
+	{
+		memcpy(&sizes[i], input + i * sizeof(uint32_t), sizeof(uint32_t));
+		offsets[i] = offset;
+		offset += sizes[i];
+		if (offset > inputSize)
+		{
+			return false;
+		}
+	}
+	return offset == inputSize;
+}
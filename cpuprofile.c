@@ -0,0 +1,287 @@
+// this file implements a cpu profiler. it's the same idea as the gpu profiler, zones are put around
+// code to see how long it takes, except the cpu can just read the time itself. the results are
+// written as a chrome trace, which chrome://tracing or ui.perfetto.dev can show as a timeline with a
+// row for every thread.
+//
+// zones have to be cheap enough to put around anything, so every thread records into its own ring
+// of zones. that way threads never wait for each other, and recording a zone is just reading the
+// time twice and writing it down. on x86 the time comes straight from the cpu's timestamp counter,
+// because asking the os takes a lot longer. when a ring fills up, the oldest zones get overwritten.
+
+#include "stuff.h"
+
+// __rdtsc reads the cpu's timestamp counter, which is much faster than asking the os for the time
+#if defined _M_X64 || defined __x86_64__
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define CPU_PROFILER_RDTSC 1
+#endif
+
+// how many zones each thread keeps, this has to be a power of 2. at 24 bytes each, it's 1.5 MiB per
+// thread, which is around 10 seconds of frames with a few dozen zones each.
+#define CPU_PROFILER_RING_SIZE (1 << 16)
+
+// the maximum depth zones can be nested to, deeper ones are ignored
+#define CPU_PROFILER_MAX_DEPTH 32
+
+// a zone that's been ended
+typedef struct CpuZone
+{
+	const char* name;
+	uint64_t start;
+	uint64_t end;
+} CpuZone_t;
+
+// each thread's zones
+typedef struct CpuThread
+{
+	CpuZone_t zones[CPU_PROFILER_RING_SIZE];
+
+	// the number of zones that have ever been written. only the thread that owns this writes to it,
+	// so it only needs to be atomic so other threads can see it while writing the trace.
+	atomic_uint_fast64_t writeIndex;
+
+	// the zones that are currently open
+	const char* openNames[CPU_PROFILER_MAX_DEPTH];
+	uint64_t openStarts[CPU_PROFILER_MAX_DEPTH];
+	uint32_t depth;
+
+	uint32_t id;
+	char name[32];
+	struct CpuThread* next;
+} CpuThread_t;
+
+// read the time in ticks, which are converted to nanoseconds when the trace gets written
+static inline uint64_t GetTicks(void);
+
+// get the current thread's ring, making it if this is the thread's first zone
+static CpuThread_t* GetCpuThread(void);
+
+// write one thread's zones to the trace, returns the number of zones written
+static uint64_t WriteThread(FILE* output, CpuThread_t* thread, bool* first, double tickLength);
+
+static bool s_enabled;
+static uint64_t s_startTime;  // when the profiler started, in nanoseconds
+static uint64_t s_startTicks; // the same time, in ticks
+static const char* s_outputName;
+
+// every thread's ring, as a linked list. new threads add themselves at the start without locking.
+static _Atomic(CpuThread_t*) s_threads;
+static atomic_uint s_nextThreadId;
+
+// the current thread's ring and name
+static THREAD_LOCAL CpuThread_t* s_thread;
+static THREAD_LOCAL char s_threadName[32];
+
+void StartCpuProfiler(const char* outputName)
+{
+	s_startTime = GetTime();
+	s_startTicks = GetTicks();
+	s_outputName = outputName;
+	s_enabled = true;
+
+#ifdef GLDEMO_PROFILE
+	NameCpuProfilerThread("Main thread");
+	printf("Started CPU profiler, the trace will be written to %s\n", outputName);
+#else
+	printf("The CPU profiler was compiled out (GLDEMO_PROFILE is off), the trace will be empty\n");
+#endif
+}
+
+void StopCpuProfiler(void)
+{
+	if (!s_enabled)
+	{
+		return;
+	}
+
+	// every other thread should be stopped by now, so nothing is using the rings anymore
+	WriteCpuTrace(s_outputName);
+	s_enabled = false;
+
+	CpuThread_t* thread = atomic_exchange(&s_threads, NULL);
+	while (thread)
+	{
+		CpuThread_t* next = thread->next;
+		free(thread);
+		thread = next;
+	}
+	s_thread = NULL;
+}
+
+void NameCpuProfilerThread(const char* name)
+{
+	snprintf(s_threadName, sizeof(s_threadName), "%s", name);
+	if (s_thread)
+	{
+		snprintf(s_thread->name, sizeof(s_thread->name), "%s", name);
+	}
+}
+
+void BeginCpuZone(const char* name)
+{
+	if (!s_enabled)
+	{
+		return;
+	}
+
+	CpuThread_t* thread = s_thread ? s_thread : GetCpuThread();
+	if (thread->depth < CPU_PROFILER_MAX_DEPTH)
+	{
+		thread->openNames[thread->depth] = name;
+		thread->openStarts[thread->depth] = GetTicks();
+	}
+	thread->depth++;
+}
+
+void EndCpuZone(void)
+{
+	if (!s_enabled)
+	{
+		return;
+	}
+
+	uint64_t end = GetTicks();
+	CpuThread_t* thread = s_thread ? s_thread : GetCpuThread();
+	if (!thread->depth)
+	{
+		FatalError("EndCpuZone called without BeginCpuZone!");
+	}
+
+	thread->depth--;
+	if (thread->depth >= CPU_PROFILER_MAX_DEPTH)
+	{
+		return;
+	}
+
+	// the zone is written before the index is updated, and the release makes sure other threads see
+	// it in that order too
+	uint64_t index = atomic_load_explicit(&thread->writeIndex, memory_order_relaxed);
+	CpuZone_t* zone = &thread->zones[index & (CPU_PROFILER_RING_SIZE - 1)];
+	zone->name = thread->openNames[thread->depth];
+	zone->start = thread->openStarts[thread->depth];
+	zone->end = end;
+	atomic_store_explicit(&thread->writeIndex, index + 1, memory_order_release);
+}
+
+void WriteCpuTrace(const char* outputName)
+{
+	if (!s_enabled)
+	{
+		return;
+	}
+
+	// the length of a tick is worked out from how many there were since the profiler started, the
+	// counter runs at a constant rate on anything from the last 15 years or so
+	uint64_t startTime = GetTime();
+	uint64_t ticks = GetTicks() - s_startTicks;
+	double tickLength = ticks ? (double)(startTime - s_startTime) / ticks : 1.0;
+
+	FILE* output = fopen(outputName, "wb");
+	if (!output)
+	{
+		FatalError("failed to open %s for writing!", outputName);
+	}
+
+	// the trace event format is a list of events, "X" events are complete zones with a start and a
+	// duration in microseconds, and "M" events are metadata like thread names
+	fprintf(output, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+	bool first = true;
+	uint64_t count = 0;
+	uint32_t threadCount = 0;
+	for (CpuThread_t* thread = atomic_load(&s_threads); thread; thread = thread->next)
+	{
+		count += WriteThread(output, thread, &first, tickLength);
+		threadCount++;
+	}
+	fprintf(output, "\n]}\n");
+	fclose(output);
+
+	printf(
+		"Wrote %" PRIu64 " CPU zones from %u threads to %s in %.3f ms\n", count, threadCount,
+		outputName, (GetTime() - startTime) / 1e6);
+}
+
+static inline uint64_t GetTicks(void)
+{
+#ifdef CPU_PROFILER_RDTSC
+	return __rdtsc();
+#else
+	return GetTime();
+#endif
+}
+
+static CpuThread_t* GetCpuThread(void)
+{
+	// this only happens once per thread, so it doesn't matter that it's slow
+	CpuThread_t* thread = calloc(1, sizeof(CpuThread_t));
+	if (!thread)
+	{
+		FatalError("failed to allocate %zu bytes!", sizeof(CpuThread_t));
+	}
+
+	thread->id = atomic_fetch_add(&s_nextThreadId, 1) + 1;
+	if (s_threadName[0])
+	{
+		snprintf(thread->name, sizeof(thread->name), "%s", s_threadName);
+	}
+	else
+	{
+		snprintf(thread->name, sizeof(thread->name), "Thread %u", thread->id);
+	}
+
+	// add it to the list. if another thread adds one at the same time, the exchange fails and
+	// updates next to the new start of the list, so it just tries again.
+	thread->next = atomic_load(&s_threads);
+	while (!atomic_compare_exchange_weak(&s_threads, &thread->next, thread))
+	{
+	}
+
+	s_thread = thread;
+	return thread;
+}
+
+static uint64_t WriteThread(FILE* output, CpuThread_t* thread, bool* first, double tickLength)
+{
+	fprintf(
+		output,
+		"%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": "
+		"\"%s\"}}",
+		*first ? "" : ",", thread->id, thread->name);
+	*first = false;
+
+	// the thread could still be recording, so only the zones up to the index at this point are
+	// read. the oldest ones could get overwritten while they're being written out, so they get
+	// checked against the index again afterwards.
+	uint64_t end = atomic_load_explicit(&thread->writeIndex, memory_order_acquire);
+	uint64_t begin = end > CPU_PROFILER_RING_SIZE ? end - CPU_PROFILER_RING_SIZE : 0;
+	uint64_t count = 0;
+	for (uint64_t i = begin; i < end; i++)
+	{
+		CpuZone_t zone = thread->zones[i & (CPU_PROFILER_RING_SIZE - 1)];
+
+		atomic_thread_fence(memory_order_acquire);
+		// the writer fills in slot i while the index is i + CPU_PROFILER_RING_SIZE, before it moves
+		// the index past it, so that counts as overwritten too
+		uint64_t newEnd = atomic_load_explicit(&thread->writeIndex, memory_order_relaxed);
+		if (newEnd - i >= CPU_PROFILER_RING_SIZE)
+		{
+			continue;
+		}
+
+		// zones that started before the profiler (which can't really happen) are clamped to 0
+		double start = zone.start > s_startTicks ? (zone.start - s_startTicks) * tickLength : 0.0;
+		double duration = (zone.end - zone.start) * tickLength;
+		fprintf(
+			output,
+			",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": "
+			"%.3f}",
+			zone.name, thread->id, start / 1e3, duration / 1e3);
+		count++;
+	}
+
+	return count;
+}
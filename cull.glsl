@@ -0,0 +1,100 @@
+// compute shaders need opengl 4.3
+#version 430 core
+
+// each invocation is one object, and they're run in groups of 64
+layout (local_size_x = 64) in;
+
+// the same as GpuCullObject_t
+struct Object
+{
+    vec4 transform;
+    vec4 sphere; // center and radius
+    uint indexCount;
+    uint firstIndex;
+    int baseVertex;
+    uint padding;
+};
+
+// the same as DrawElementsIndirectCommand_t in render.c
+struct Command
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+// the same as the Draw block in vertex.glsl
+struct Draw
+{
+    vec4 transform;
+    vec4 quantization;
+};
+
+// the transforms go where batched.glsl reads them from
+layout (std430, binding = 0) writeonly buffer Transforms
+{
+    Draw draws[];
+};
+
+layout (std430, binding = 1) readonly buffer Objects
+{
+    Object objects[];
+};
+
+layout (std430, binding = 2) writeonly buffer Commands
+{
+    Command commands[];
+};
+
+layout (std430, binding = 3) buffer Count
+{
+    uint visibleCount;
+};
+
+// the draw's transform, which moves every object, and how the mesh's positions are stored
+layout (std140, binding = 0) uniform DrawUniforms
+{
+    vec4 transform;
+    vec4 quantization;
+};
+
+uniform uint objectCount;
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= objectCount)
+    {
+        return;
+    }
+
+    // the object's transform and then the draw's, combined into one
+    Object object = objects[index];
+    vec4 combined = vec4(
+        object.transform.xy * transform.zw + transform.xy, object.transform.zw * transform.zw);
+
+    // the same test as CullMeshlets: the sphere is off screen if it's entirely past one of the
+    // sides of clip space. the sphere gets scaled by the biggest scale, so it still covers
+    // everything, and z isn't scaled at all. there's no depth buffer to check whether something
+    // in front covers it, so the screen is all there is to cull against.
+    vec2 center = object.sphere.xy * combined.zw + combined.xy;
+    float radius = object.sphere.w * max(abs(combined.z), abs(combined.w));
+    if (any(greaterThan(abs(center) - radius, vec2(1.0))) ||
+        abs(object.sphere.z) - object.sphere.w > 1.0)
+    {
+        return;
+    }
+
+    // the visible objects get packed together at the start of the buffers. atomicAdd returns
+    // the value from before adding, so every visible object gets its own slot.
+    uint slot = atomicAdd(visibleCount, 1u);
+    draws[slot].transform = combined;
+    draws[slot].quantization = quantization;
+    commands[slot].count = object.indexCount;
+    commands[slot].instanceCount = 1u;
+    commands[slot].firstIndex = object.firstIndex;
+    commands[slot].baseVertex = object.baseVertex;
+    commands[slot].baseInstance = slot;
+}
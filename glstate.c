@@ -0,0 +1,403 @@
+// this file implements a cache of opengl state. opengl doesn't check whether a call actually changes
+// anything, so binding the same program twice costs the same as binding a different one, and with
+// thousands of draws those calls add up. these functions remember what's set, and skip the call if
+// it's already set to the same thing.
+//
+// the cache only knows about calls that go through it, so anything that changes the same state
+// directly (like a glBindBuffer somewhere else) has to call InvalidateGlState afterwards.
+
+#include "stuff.h"
+
+// the number of texture units that are cached, the minimum every opengl 3.3 driver has is 16
+#define GL_STATE_TEXTURE_UNITS 16
+
+// the texture targets that are cached
+#define GL_STATE_TEXTURE_TARGETS 4
+
+// the buffer targets that are cached
+#define GL_STATE_BUFFER_TARGETS 8
+
+// the number of indexed binding points that are cached for uniform and shader storage buffers
+#define GL_STATE_BUFFER_BINDINGS 8
+
+// the capabilities (glEnable/glDisable) that are cached
+#define GL_STATE_CAPABILITIES 5
+
+// a value that no real state has, so the next call always goes through
+#define GL_STATE_UNKNOWN UINT32_MAX
+
+// a buffer range bound to an indexed binding point
+typedef struct GlBufferRange
+{
+	uint32_t buffer;
+	size_t offset;
+	size_t size;
+} GlBufferRange_t;
+
+// what the cache thinks is set
+typedef struct GlState
+{
+	uint32_t program;
+	uint32_t vertexArray;
+	uint32_t buffers[GL_STATE_BUFFER_TARGETS];
+	GlBufferRange_t ranges[2][GL_STATE_BUFFER_BINDINGS]; // uniform buffers, then storage buffers
+	uint32_t activeTexture;
+	uint32_t textures[GL_STATE_TEXTURE_UNITS][GL_STATE_TEXTURE_TARGETS];
+	uint32_t capabilities[GL_STATE_CAPABILITIES]; // GL_TRUE, GL_FALSE, or unknown
+	int32_t viewport[4];
+	int32_t scissor[4];
+	float clearColour[4];
+	float clearDepth;
+	uint32_t blendSource;
+	uint32_t blendDestination;
+	uint32_t depthFunction;
+	uint32_t depthMask;
+	bool viewportKnown;
+	bool scissorKnown;
+	bool clearColourKnown;
+	bool clearDepthKnown;
+} GlState_t;
+
+// find where a buffer target is in the cache, or -1 if it isn't cached
+static int32_t GetBufferTarget(uint32_t target);
+
+// find where a texture target is in the cache, or -1 if it isn't cached
+static int32_t GetTextureTarget(uint32_t target);
+
+// find where a capability is in the cache, or -1 if it isn't cached
+static int32_t GetCapability(uint32_t capability);
+
+static GlState_t s_state;
+
+// the number of calls that were made and skipped, in the current frame, the last frame, and in total
+static GlStateStats_t s_frameStats;
+static GlStateStats_t s_lastFrameStats;
+static GlStateStats_t s_totalStats;
+static uint64_t s_frameCount;
+
+void InvalidateGlState(void)
+{
+	// the memset makes all the uint32_ts GL_STATE_UNKNOWN (all the bits set), and the bools say
+	// the rest isn't known
+	memset(&s_state, 0xFF, sizeof(GlState_t));
+	s_state.viewportKnown = false;
+	s_state.scissorKnown = false;
+	s_state.clearColourKnown = false;
+	s_state.clearDepthKnown = false;
+}
+
+void SetProgram(uint32_t program)
+{
+	if (s_state.program == program)
+	{
+		s_frameStats.elided++;
+		return;
+	}
+
+	glUseProgram(program);
+	s_state.program = program;
+	s_frameStats.issued++;
+}
+
+void SetVertexArray(uint32_t vertexArray)
+{
+	if (s_state.vertexArray == vertexArray)
+	{
+		s_frameStats.elided++;
+		return;
+	}
+
+	glBindVertexArray(vertexArray);
+	s_state.vertexArray = vertexArray;
+	s_frameStats.issued++;
+}
+
+void SetBuffer(uint32_t target, uint32_t buffer)
+{
+	// the element array buffer binding is part of the vertex array, so it's not cached here
+	int32_t index = GetBufferTarget(target);
+	if (index >= 0 && s_state.buffers[index] == buffer)
+	{
+		s_frameStats.elided++;
+		return;
+	}
+
+	glBindBuffer(target, buffer);
+	if (index >= 0)
+	{
+		s_state.buffers[index] = buffer;
+	}
+	s_frameStats.issued++;
+}
+
+void SetBufferRange(uint32_t target, uint32_t index, uint32_t buffer, size_t offset, size_t size)
+{
+	// only uniform and shader storage buffers are cached, they're the ones that change per draw
+	GlBufferRange_t* range = NULL;
+	if (index < GL_STATE_BUFFER_BINDINGS &&
+		(target == GL_UNIFORM_BUFFER || target == GL_SHADER_STORAGE_BUFFER))
+	{
+		range = &s_state.ranges[target == GL_SHADER_STORAGE_BUFFER][index];
+		if (range->buffer == buffer && range->offset == offset && range->size == size)
+		{
+			s_frameStats.elided++;
+			return;
+		}
+	}
+
+	glBindBufferRange(target, index, buffer, (GLintptr)offset, (GLsizeiptr)size);
+	if (range)
+	{
+		range->buffer = buffer;
+		range->offset = offset;
+		range->size = size;
+	}
+
+	// this also binds the buffer to the target like glBindBuffer would
+	int32_t generic = GetBufferTarget(target);
+	if (generic >= 0)
+	{
+		s_state.buffers[generic] = buffer;
+	}
+	s_frameStats.issued++;
+}
+
+void SetTexture(uint32_t unit, uint32_t target, uint32_t texture)
+{
+	int32_t index = GetTextureTarget(target);
+	if (unit < GL_STATE_TEXTURE_UNITS && index >= 0 && s_state.textures[unit][index] == texture)
+	{
+		s_frameStats.elided++;
+		return;
+	}
+
+	// textures are bound to whichever unit is active, so that might have to change first
+	if (s_state.activeTexture != unit)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		s_state.activeTexture = unit;
+		s_frameStats.issued++;
+	}
+
+	glBindTexture(target, texture);
+	if (unit < GL_STATE_TEXTURE_UNITS && index >= 0)
+	{
+		s_state.textures[unit][index] = texture;
+	}
+	s_frameStats.issued++;
+}
+
+void SetCapability(uint32_t capability, bool enabled)
+{
+	int32_t index = GetCapability(capability);
+	if (index >= 0 && s_state.capabilities[index] == (uint32_t)enabled)
+	{
+		s_frameStats.elided++;
+		return;
+	}
+
+	if (enabled)
+	{
+		glEnable(capability);
+	}
+	else
+	{
+		glDisable(capability);
+	}
+	if (index >= 0)
+	{
+		s_state.capabilities[index] = enabled;
+	}
+	s_frameStats.issued++;
+}
+
+void SetBlendFunction(uint32_t source, uint32_t destination)
+{
+	if (s_state.blendSource == source && s_state.blendDestination == destination)
+	{
+		s_frameStats.elided++;
+		return;
+	}
+
+	glBlendFunc(source, destination);
+	s_state.blendSource = source;
+	s_state.blendDestination = destination;
+	s_frameStats.issued++;
+}
+
+void SetDepthFunction(uint32_t function)
+{
+	if (s_state.depthFunction == function)
+	{
+		s_frameStats.elided++;
+		return;
+	}
+
+	glDepthFunc(function);
+	s_state.depthFunction = function;
+	s_frameStats.issued++;
+}
+
+void SetDepthMask(bool write)
+{
+	if (s_state.depthMask == (uint32_t)write)
+	{
+		s_frameStats.elided++;
+		return;
+	}
+
+	glDepthMask(write ? GL_TRUE : GL_FALSE);
+	s_state.depthMask = write;
+	s_frameStats.issued++;
+}
+
+void SetViewport(int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	int32_t viewport[4] = {x, y, width, height};
+	if (s_state.viewportKnown && memcmp(s_state.viewport, viewport, sizeof(viewport)) == 0)
+	{
+		s_frameStats.elided++;
+		return;
+	}
+
+	glViewport(x, y, width, height);
+	memcpy(s_state.viewport, viewport, sizeof(viewport));
+	s_state.viewportKnown = true;
+	s_frameStats.issued++;
+}
+
+void SetScissor(int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	int32_t scissor[4] = {x, y, width, height};
+	if (s_state.scissorKnown && memcmp(s_state.scissor, scissor, sizeof(scissor)) == 0)
+	{
+		s_frameStats.elided++;
+		return;
+	}
+
+	glScissor(x, y, width, height);
+	memcpy(s_state.scissor, scissor, sizeof(scissor));
+	s_state.scissorKnown = true;
+	s_frameStats.issued++;
+}
+
+void SetClearColour(float red, float green, float blue, float alpha)
+{
+	float colour[4] = {red, green, blue, alpha};
+	if (s_state.clearColourKnown && memcmp(s_state.clearColour, colour, sizeof(colour)) == 0)
+	{
+		s_frameStats.elided++;
+		return;
+	}
+
+	glClearColor(red, green, blue, alpha);
+	memcpy(s_state.clearColour, colour, sizeof(colour));
+	s_state.clearColourKnown = true;
+	s_frameStats.issued++;
+}
+
+void SetClearDepth(float depth)
+{
+	if (s_state.clearDepthKnown && s_state.clearDepth == depth)
+	{
+		s_frameStats.elided++;
+		return;
+	}
+
+	glClearDepth(depth);
+	s_state.clearDepth = depth;
+	s_state.clearDepthKnown = true;
+	s_frameStats.issued++;
+}
+
+void EndGlStateFrame(void)
+{
+	s_lastFrameStats = s_frameStats;
+	s_totalStats.issued += s_frameStats.issued;
+	s_totalStats.elided += s_frameStats.elided;
+	s_frameCount++;
+	memset(&s_frameStats, 0, sizeof(GlStateStats_t));
+}
+
+GlStateStats_t GetGlStateStats(void)
+{
+	return s_lastFrameStats;
+}
+
+void PrintGlStateStats(void)
+{
+	if (!s_frameCount)
+	{
+		return;
+	}
+
+	uint64_t total = s_totalStats.issued + s_totalStats.elided;
+	printf(
+		"GL state cache: %.1f calls issued and %.1f elided per frame (%.1f%% elided)\n",
+		(double)s_totalStats.issued / s_frameCount, (double)s_totalStats.elided / s_frameCount,
+		total ? 100.0 * s_totalStats.elided / total : 0.0);
+
+	memset(&s_totalStats, 0, sizeof(GlStateStats_t));
+	s_frameCount = 0;
+}
+
+static int32_t GetBufferTarget(uint32_t target)
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER:
+		return 0;
+	case GL_UNIFORM_BUFFER:
+		return 1;
+	case GL_DRAW_INDIRECT_BUFFER:
+		return 2;
+	case GL_PIXEL_PACK_BUFFER:
+		return 3;
+	case GL_PIXEL_UNPACK_BUFFER:
+		return 4;
+	case GL_COPY_READ_BUFFER:
+		return 5;
+	case GL_COPY_WRITE_BUFFER:
+		return 6;
+	case GL_SHADER_STORAGE_BUFFER:
+		return 7;
+	default:
+		return -1;
+	}
+}
+
+static int32_t GetTextureTarget(uint32_t target)
+{
+	switch (target)
+	{
+	case GL_TEXTURE_2D:
+		return 0;
+	case GL_TEXTURE_2D_ARRAY:
+		return 1;
+	case GL_TEXTURE_CUBE_MAP:
+		return 2;
+	case GL_TEXTURE_3D:
+		return 3;
+	default:
+		return -1;
+	}
+}
+
+static int32_t GetCapability(uint32_t capability)
+{
+	switch (capability)
+	{
+	case GL_BLEND:
+		return 0;
+	case GL_DEPTH_TEST:
+		return 1;
+	case GL_CULL_FACE:
+		return 2;
+	case GL_SCISSOR_TEST:
+		return 3;
+	case GL_STENCIL_TEST:
+		return 4;
+	default:
+		return -1;
+	}
+}
@@ -0,0 +1,181 @@
+// this file implements gpu culling. culling on the cpu means looking at every object every frame
+// and then telling the gpu about the ones that are left, which gets slow with enough objects. the
+// gpu is much better at doing the same simple thing to a lot of objects, so here a compute shader
+// (cull.glsl) does the culling and writes the draw commands itself.
+//
+// the commands end up packed together, with their count in another buffer. with opengl 4.6 (or
+// GL_ARB_indirect_parameters), glMultiDrawElementsIndirectCount reads the count straight from that
+// buffer. without it, every command slot gets drawn, and the ones that weren't written to this
+// frame are cleared to 0 first, so they draw nothing.
+
+#include "stuff.h"
+
+// the size of a compute shader group, has to be the same as local_size_x in cull.glsl
+#define GPU_CULL_GROUP_SIZE 64
+
+// what glMultiDrawElementsIndirect reads for each draw, the same as the one in render.c
+typedef struct GpuCullCommand
+{
+	uint32_t count;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t baseInstance;
+} GpuCullCommand_t;
+
+// make a buffer that's only used by the gpu
+static uint32_t CreateGpuBuffer(size_t size, const void* data, const char* name);
+
+// glMultiDrawElementsIndirectCount or the ARB version of it, or NULL if neither is supported
+static PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTPROC s_drawIndirectCount;
+
+GpuCullScene_t CreateGpuCullScene(
+	const Mesh_t* mesh, const GpuCullObject_t* objects, uint32_t objectCount)
+{
+	// the draw index attribute only goes up to DRAW_BATCH_MAX
+	if (objectCount > DRAW_BATCH_MAX)
+	{
+		FatalError(
+			"%u objects is too many to cull on the gpu (the maximum is %u)!", objectCount,
+			DRAW_BATCH_MAX);
+	}
+	ReserveDrawIndices(objectCount);
+
+	// the core version and the extension version are the same function with different names
+	s_drawIndirectCount = NULL;
+	if (GLAD_GL_VERSION_4_6)
+	{
+		s_drawIndirectCount = glMultiDrawElementsIndirectCount;
+	}
+	else if (GLAD_GL_ARB_indirect_parameters)
+	{
+		s_drawIndirectCount = glMultiDrawElementsIndirectCountARB;
+	}
+
+	GpuCullScene_t scene = {0};
+	scene.objectCount = objectCount;
+	scene.vertexArray = mesh->vertexArray;
+	scene.indexType = mesh->indexType;
+	memcpy(scene.quantization, mesh->quantization, sizeof(scene.quantization));
+	scene.program = LoadComputeShader("cull.glsl");
+
+	// the object count never changes, so it's set once. glProgramUniform sets a uniform without
+	// having to use the program first.
+	glProgramUniform1ui(
+		scene.program, glGetUniformLocation(scene.program, "objectCount"), objectCount);
+
+	// every object could be visible, so the output buffers have room for all of them
+	size_t count = objectCount ? objectCount : 1;
+	scene.objectBuffer =
+		CreateGpuBuffer(count * sizeof(GpuCullObject_t), objects, "GPU cull objects");
+	scene.transformBuffer =
+		CreateGpuBuffer(count * sizeof(DrawUniforms_t), NULL, "GPU cull transforms");
+	scene.commandBuffer =
+		CreateGpuBuffer(count * sizeof(GpuCullCommand_t), NULL, "GPU cull commands");
+	scene.countBuffer = CreateGpuBuffer(sizeof(uint32_t), NULL, "GPU cull count");
+
+	printf(
+		"Created GPU cull scene with %u objects, drawing with %s\n", objectCount,
+		s_drawIndirectCount ? "glMultiDrawElementsIndirectCount" : "glMultiDrawElementsIndirect");
+	return scene;
+}
+
+void DestroyGpuCullScene(GpuCullScene_t* scene)
+{
+	// reading a buffer the gpu writes to waits for the gpu, but this only happens once
+	uint32_t visibleCount = 0;
+	SetBuffer(GL_COPY_READ_BUFFER, scene->countBuffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(uint32_t), &visibleCount);
+	SetBuffer(GL_COPY_READ_BUFFER, 0);
+	printf(
+		"GPU culling: %u of %u objects visible in the last frame (%.1f%% culled)\n", visibleCount,
+		scene->objectCount,
+		scene->objectCount ? 100.0 * (scene->objectCount - visibleCount) / scene->objectCount
+						   : 0.0);
+
+	glDeleteProgram(scene->program);
+	glDeleteBuffers(1, &scene->objectBuffer);
+	glDeleteBuffers(1, &scene->transformBuffer);
+	glDeleteBuffers(1, &scene->commandBuffer);
+	glDeleteBuffers(1, &scene->countBuffer);
+	memset(scene, 0, sizeof(GpuCullScene_t));
+}
+
+void CullGpuScene(const GpuCullScene_t* scene, size_t uniformOffset)
+{
+	// the count starts at 0 every frame, and without the count version of the draw, so do the
+	// commands. glClearBufferData fills a buffer with a value without the cpu having to upload
+	// anything.
+	uint32_t zero = 0;
+	SetBuffer(GL_COPY_WRITE_BUFFER, scene->countBuffer);
+	glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	if (!s_drawIndirectCount)
+	{
+		SetBuffer(GL_COPY_WRITE_BUFFER, scene->commandBuffer);
+		glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	}
+	SetBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// the buffers are bound to the binding points in cull.glsl, and the draw's transform is in
+	// the streaming buffer like any other draw's
+	size_t objectCount = scene->objectCount ? scene->objectCount : 1;
+	SetProgram(scene->program);
+	SetBufferRange(GL_UNIFORM_BUFFER, 0, GetStreamBuffer(), uniformOffset, sizeof(DrawUniforms_t));
+	SetBufferRange(
+		GL_SHADER_STORAGE_BUFFER, 0, scene->transformBuffer, 0,
+		objectCount * sizeof(DrawUniforms_t));
+	SetBufferRange(
+		GL_SHADER_STORAGE_BUFFER, 1, scene->objectBuffer, 0,
+		objectCount * sizeof(GpuCullObject_t));
+	SetBufferRange(
+		GL_SHADER_STORAGE_BUFFER, 2, scene->commandBuffer, 0,
+		objectCount * sizeof(GpuCullCommand_t));
+	SetBufferRange(GL_SHADER_STORAGE_BUFFER, 3, scene->countBuffer, 0, sizeof(uint32_t));
+
+	// one invocation per object, rounded up to whole groups
+	glDispatchCompute((scene->objectCount + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+
+	// the compute shader's writes have to be finished before they're used as draw commands, the
+	// count, and the transforms in the vertex shader
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void DrawGpuScene(const GpuCullScene_t* scene, uint32_t shader, bool cullBackFaces)
+{
+	// the same as drawing a batch in render.c, except the commands and transforms came from the
+	// compute shader
+	size_t objectCount = scene->objectCount ? scene->objectCount : 1;
+	SetProgram(shader);
+	SetBufferRange(
+		GL_SHADER_STORAGE_BUFFER, 0, scene->transformBuffer, 0,
+		objectCount * sizeof(DrawUniforms_t));
+	SetVertexArray(scene->vertexArray);
+	SetCapability(GL_CULL_FACE, cullBackFaces);
+	SetBuffer(GL_DRAW_INDIRECT_BUFFER, scene->commandBuffer);
+
+	if (s_drawIndirectCount)
+	{
+		// the parameter buffer is where the count gets read from, the same way the indirect
+		// buffer is where the commands get read from. the object count is the most it can be.
+		SetBuffer(GL_PARAMETER_BUFFER, scene->countBuffer);
+		s_drawIndirectCount(
+			GL_TRIANGLES, scene->indexType, NULL, 0, (int32_t)scene->objectCount, 0);
+	}
+	else
+	{
+		glMultiDrawElementsIndirect(
+			GL_TRIANGLES, scene->indexType, NULL, (int32_t)scene->objectCount, 0);
+	}
+}
+
+static uint32_t CreateGpuBuffer(size_t size, const void* data, const char* name)
+{
+	// dynamic copy means the gpu writes to it and reads from it, and the cpu doesn't touch it
+	uint32_t buffer = 0;
+	glGenBuffers(1, &buffer);
+	SetBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, data, GL_DYNAMIC_COPY);
+	SetBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glObjectLabel(GL_BUFFER, buffer, (int32_t)strlen(name), name);
+	return buffer;
+}
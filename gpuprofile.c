@@ -0,0 +1,290 @@
+// this file implements a gpu profiler. the cpu can't time how long the gpu takes to do something,
+// because opengl calls return as soon as the command is queued up. instead, timestamp queries ask
+// the gpu to write down the time when it gets to them, so a pair of them around some commands
+// measures how long the gpu spent on those commands.
+//
+// query results aren't ready until the gpu gets to them, and asking for them before that makes the
+// cpu wait. so every frame gets its own set of queries, and they're only read several frames later
+// when the gpu is done with them.
+
+#include "stuff.h"
+
+// how many frames of queries there are. results are read when a frame's queries are about to be
+// reused, so this is how many frames behind the results are.
+#define GPU_PROFILER_FRAMES 4
+
+// the maximum number of zones in a frame, and the maximum number of different zone names
+#define GPU_PROFILER_MAX_ZONES 64
+
+// the maximum depth zones can be nested to
+#define GPU_PROFILER_MAX_DEPTH 16
+
+// a frame's worth of queries
+typedef struct GpuProfilerFrame
+{
+	uint32_t queries[GPU_PROFILER_MAX_ZONES * 2]; // a begin and end timestamp for each zone
+	uint32_t zones[GPU_PROFILER_MAX_ZONES];       // the zone each pair of queries is for
+	uint32_t recordCount;                         // the number of zones recorded
+	uint32_t lastQuery;                           // the query that was submitted last
+	uint64_t frame;                               // which frame this was
+} GpuProfilerFrame_t;
+
+// the statistics for a zone name
+typedef struct GpuZone
+{
+	const char* name;
+	double lastTime;  // milliseconds in the most recent frame that was read
+	double totalTime; // milliseconds over all frames that were read since the last reset
+	uint64_t frameCount;
+} GpuZone_t;
+
+// read the results of a frame, wait is whether it's ok to wait for them
+static void CollectFrame(GpuProfilerFrame_t* frame, bool wait);
+
+// find a zone by name, or add it if it isn't there
+static uint32_t FindZone(const char* name);
+
+static bool s_started;
+static GpuProfilerFrame_t s_frames[GPU_PROFILER_FRAMES];
+static uint64_t s_frameIndex;
+static uint64_t s_statsStartFrame; // frames before this don't count towards the totals
+static uint64_t s_droppedCount;    // frames that weren't ready in time and got thrown away
+
+static GpuZone_t s_zones[GPU_PROFILER_MAX_ZONES];
+static uint32_t s_zoneCount;
+
+// the zones that are currently open, as indices into the current frame's records
+static uint32_t s_stack[GPU_PROFILER_MAX_DEPTH];
+static uint32_t s_stackDepth;
+
+void StartGpuProfiler(void)
+{
+	for (uint32_t i = 0; i < GPU_PROFILER_FRAMES; i++)
+	{
+		glGenQueries(GPU_PROFILER_MAX_ZONES * 2, s_frames[i].queries);
+		s_frames[i].recordCount = 0;
+	}
+
+	s_frameIndex = 0;
+	s_statsStartFrame = 0;
+	s_droppedCount = 0;
+	s_zoneCount = 0;
+	s_stackDepth = 0;
+	s_started = true;
+
+	printf("Started GPU profiler with %u frames of latency\n", GPU_PROFILER_FRAMES);
+}
+
+void StopGpuProfiler(void)
+{
+	if (!s_started)
+	{
+		return;
+	}
+
+	for (uint32_t i = 0; i < GPU_PROFILER_FRAMES; i++)
+	{
+		glDeleteQueries(GPU_PROFILER_MAX_ZONES * 2, s_frames[i].queries);
+	}
+
+	if (s_droppedCount)
+	{
+		printf("GPU profiler dropped %" PRIu64 " frames that weren't ready\n", s_droppedCount);
+	}
+
+	s_started = false;
+}
+
+void BeginGpuZone(const char* name)
+{
+	if (!s_started)
+	{
+		return;
+	}
+
+	GpuProfilerFrame_t* frame = &s_frames[s_frameIndex % GPU_PROFILER_FRAMES];
+	if (frame->recordCount >= GPU_PROFILER_MAX_ZONES || s_stackDepth >= GPU_PROFILER_MAX_DEPTH)
+	{
+		FatalError("too many GPU zones in one frame (at %s)!", name);
+	}
+
+	// debug groups show up in tools like renderdoc and apitrace, and in debug messages, so the
+	// commands in the zone are easy to find
+	glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, (int32_t)strlen(name), name);
+
+	uint32_t record = frame->recordCount++;
+	frame->zones[record] = FindZone(name);
+	s_stack[s_stackDepth++] = record;
+
+	// timestamps (as opposed to GL_TIME_ELAPSED) can be nested, because each one is just a point in
+	// time instead of a range
+	glQueryCounter(frame->queries[record * 2], GL_TIMESTAMP);
+}
+
+void EndGpuZone(void)
+{
+	if (!s_started)
+	{
+		return;
+	}
+	if (!s_stackDepth)
+	{
+		FatalError("EndGpuZone called without BeginGpuZone!");
+	}
+
+	GpuProfilerFrame_t* frame = &s_frames[s_frameIndex % GPU_PROFILER_FRAMES];
+	uint32_t record = s_stack[--s_stackDepth];
+	glQueryCounter(frame->queries[record * 2 + 1], GL_TIMESTAMP);
+
+	// the end of a zone is always the newest query, but with nested zones it's the outer zone that
+	// ends last, not the last one that was recorded
+	frame->lastQuery = frame->queries[record * 2 + 1];
+
+	glPopDebugGroup();
+}
+
+void EndGpuFrame(void)
+{
+	if (!s_started)
+	{
+		return;
+	}
+	if (s_stackDepth)
+	{
+		FatalError("%u GPU zones weren't ended before the end of the frame!", s_stackDepth);
+	}
+
+	// move on to the next frame's queries, and read the results from the last time they were used
+	s_frameIndex++;
+	GpuProfilerFrame_t* frame = &s_frames[s_frameIndex % GPU_PROFILER_FRAMES];
+	CollectFrame(frame, false);
+	frame->frame = s_frameIndex;
+}
+
+void FlushGpuProfiler(void)
+{
+	if (!s_started)
+	{
+		return;
+	}
+
+	// this waits, so it's only for when the gpu is known to be done (like after glFinish)
+	for (uint32_t i = 1; i <= GPU_PROFILER_FRAMES; i++)
+	{
+		CollectFrame(&s_frames[(s_frameIndex + i) % GPU_PROFILER_FRAMES], true);
+	}
+}
+
+void ResetGpuProfiler(void)
+{
+	for (uint32_t i = 0; i < s_zoneCount; i++)
+	{
+		s_zones[i].totalTime = 0.0;
+		s_zones[i].frameCount = 0;
+	}
+
+	// frames that were already recorded but haven't been read yet don't count either
+	s_statsStartFrame = s_frameIndex;
+}
+
+uint32_t GetGpuZoneCount(void)
+{
+	return s_zoneCount;
+}
+
+const char* GetGpuZoneName(uint32_t zone)
+{
+	return zone < s_zoneCount ? s_zones[zone].name : NULL;
+}
+
+double GetGpuZoneTime(uint32_t zone)
+{
+	return zone < s_zoneCount ? s_zones[zone].lastTime : 0.0;
+}
+
+double GetGpuZoneAverage(uint32_t zone)
+{
+	if (zone >= s_zoneCount || !s_zones[zone].frameCount)
+	{
+		return 0.0;
+	}
+
+	return s_zones[zone].totalTime / s_zones[zone].frameCount;
+}
+
+static void CollectFrame(GpuProfilerFrame_t* frame, bool wait)
+{
+	if (!frame->recordCount)
+	{
+		return;
+	}
+
+	// the queries finish in order, so if the last one that was submitted is done, they all are
+	uint32_t available = GL_FALSE;
+	glGetQueryObjectuiv(frame->lastQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available && !wait)
+	{
+		// waiting would stall, so this frame's results are lost
+		s_droppedCount++;
+		frame->recordCount = 0;
+		return;
+	}
+
+	// a zone can be used more than once in a frame, so the times get added up per zone first
+	double frameTimes[GPU_PROFILER_MAX_ZONES] = {0};
+	bool used[GPU_PROFILER_MAX_ZONES] = {0};
+	for (uint32_t i = 0; i < frame->recordCount; i++)
+	{
+		// the results are in nanoseconds
+		uint64_t begin = 0;
+		uint64_t end = 0;
+		glGetQueryObjectui64v(frame->queries[i * 2], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frame->queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+
+		uint32_t zone = frame->zones[i];
+		frameTimes[zone] += (end - begin) / 1e6;
+		used[zone] = true;
+	}
+
+	for (uint32_t i = 0; i < s_zoneCount; i++)
+	{
+		if (!used[i])
+		{
+			continue;
+		}
+
+		s_zones[i].lastTime = frameTimes[i];
+		if (frame->frame >= s_statsStartFrame)
+		{
+			s_zones[i].totalTime += frameTimes[i];
+			s_zones[i].frameCount++;
+		}
+	}
+
+	frame->recordCount = 0;
+}
+
+static uint32_t FindZone(const char* name)
+{
+	// there aren't many zones, so a linear search is fine. the name pointers are compared first,
+	// because zones almost always use string literals, which are the same pointer every time.
+	for (uint32_t i = 0; i < s_zoneCount; i++)
+	{
+		if (s_zones[i].name == name || strcmp(s_zones[i].name, name) == 0)
+		{
+			return i;
+		}
+	}
+
+	if (s_zoneCount >= GPU_PROFILER_MAX_ZONES)
+	{
+		FatalError("too many different GPU zones (at %s)!", name);
+	}
+
+	// the name isn't copied, so it has to stay valid (string literals always are)
+	s_zones[s_zoneCount].name = name;
+	s_zones[s_zoneCount].lastTime = 0.0;
+	s_zones[s_zoneCount].totalTime = 0.0;
+	s_zones[s_zoneCount].frameCount = 0;
+	return s_zoneCount++;
+}
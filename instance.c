@@ -0,0 +1,86 @@
+// this file implements instancing. drawing a lot of copies of the same mesh one draw at a time
+// means a draw call and a uniform update for every copy, and the driver has to check everything
+// each time. an instanced draw draws the mesh as many times as it's told to in one call instead.
+//
+// what's different about each copy (here, a transform and a colour) goes in an instance buffer.
+// it's read through vertex attributes like the vertices are, except glVertexAttribDivisor makes
+// them move on to the next element once per instance instead of once per vertex. the shader just
+// sees them as more inputs, see instanced.glsl.
+
+#include "stuff.h"
+
+// an instance, the way the gpu sees it. colours only need 8 bits per channel, like in the vertex
+// formats.
+typedef struct PackedInstance
+{
+	float transform[4];
+	uint8_t colour[4];
+} PackedInstance_t;
+
+InstanceBuffer_t CreateInstanceBuffer(
+	const Mesh_t* mesh, const Instance_t* instances, uint32_t instanceCount)
+{
+	InstanceBuffer_t instanceBuffer = {0};
+	instanceBuffer.count = instanceCount;
+
+	size_t size = (size_t)instanceCount * sizeof(PackedInstance_t);
+	PackedInstance_t* packed = malloc(size ? size : 1);
+	if (!packed)
+	{
+		FatalError("failed to allocate %zu bytes!", size);
+	}
+	for (uint32_t i = 0; i < instanceCount; i++)
+	{
+		memcpy(packed[i].transform, instances[i].transform, sizeof(packed[i].transform));
+		for (uint32_t j = 0; j < 4; j++)
+		{
+			float colour = fminf(fmaxf(instances[i].colour[j], 0.0f), 1.0f);
+			packed[i].colour[j] = (uint8_t)lroundf(colour * 255.0f);
+		}
+	}
+
+	// instance buffers get their own buffer instead of going in a pool, because there can be
+	// millions of instances, which is much bigger than a pool. like the pools, the copy write
+	// target is used so nothing else's bindings get disturbed.
+	glGenBuffers(1, &instanceBuffer.buffer);
+	SetBuffer(GL_COPY_WRITE_BUFFER, instanceBuffer.buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, packed, GL_STATIC_DRAW);
+	SetBuffer(GL_COPY_WRITE_BUFFER, 0);
+	free(packed);
+
+	// the vertex array has the mesh's attributes like usual, and the instance attributes from the
+	// instance buffer. the array buffer binding is saved in each attribute when its pointer is set,
+	// so the two can come from different buffers.
+	glGenVertexArrays(1, &instanceBuffer.vertexArray);
+	SetVertexArray(instanceBuffer.vertexArray);
+	SetBuffer(GL_ARRAY_BUFFER, mesh->vertices.buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indices.buffer);
+	SetVertexAttributes(mesh->format);
+
+	SetBuffer(GL_ARRAY_BUFFER, instanceBuffer.buffer);
+	glVertexAttribPointer(
+		VertexSemanticInstanceTransform, 4, GL_FLOAT, false, sizeof(PackedInstance_t),
+		(void*)offsetof(PackedInstance_t, transform));
+	glVertexAttribPointer(
+		VertexSemanticInstanceColour, 4, GL_UNSIGNED_BYTE, true, sizeof(PackedInstance_t),
+		(void*)offsetof(PackedInstance_t, colour));
+	glEnableVertexAttribArray(VertexSemanticInstanceTransform);
+	glEnableVertexAttribArray(VertexSemanticInstanceColour);
+	// a divisor of 1 means the attribute moves on once per instance, 0 (the default) means once
+	// per vertex
+	glVertexAttribDivisor(VertexSemanticInstanceTransform, 1);
+	glVertexAttribDivisor(VertexSemanticInstanceColour, 1);
+
+	SetVertexArray(0);
+
+	printf(
+		"Created instance buffer with %u instances (%.2f MiB)\n", instanceCount, size / 1048576.0);
+	return instanceBuffer;
+}
+
+void DestroyInstanceBuffer(InstanceBuffer_t* instanceBuffer)
+{
+	glDeleteVertexArrays(1, &instanceBuffer->vertexArray);
+	glDeleteBuffers(1, &instanceBuffer->buffer);
+	memset(instanceBuffer, 0, sizeof(InstanceBuffer_t));
+}
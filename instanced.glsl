@@ -0,0 +1,29 @@
+// the minimum version of the opengl spec for using this shader
+#version 330 core
+
+// the same as vertex.glsl, but with an instance's transform and colour as well
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec4 colour;
+
+// these move on once per instance instead of once per vertex, because of glVertexAttribDivisor.
+// their locations are after the vertex formats' (position, colour and normal).
+layout (location = 3) in vec4 instanceTransform;
+layout (location = 4) in vec4 instanceColour;
+
+// the draw's transform gets applied after the instance's, so all the instances can be moved
+// together
+layout (std140) uniform Draw
+{
+    vec4 transform;
+    vec4 quantization;
+};
+
+out vec4 vertexColour;
+
+void main()
+{
+    vec3 meshPosition = position * quantization.w + quantization.xyz;
+    vec2 instancePosition = meshPosition.xy * instanceTransform.zw + instanceTransform.xy;
+    gl_Position = vec4(instancePosition * transform.zw + transform.xy, -meshPosition.z, 1.0);
+    vertexColour = colour * instanceColour;
+}
@@ -0,0 +1,205 @@
+// this file implements a pool of threads that can run lots of small jobs in parallel. it's the
+// simplest useful kind, a "parallel for": RunJobs calls a function once for every index in a range,
+// spread across all the threads, and returns once they're all done.
+//
+// the threads are started once and then sleep until there's something to do, because starting a
+// thread is much slower than waking one up.
+
+#include "stuff.h"
+
+// the threads in the pool
+static Thread_t* s_threads;
+static uint32_t s_threadCount;
+
+// the current batch of jobs. these only change while s_mutex is locked, and only when no thread is
+// working on the previous batch.
+static JobFunction_t s_function;
+static void* s_data;
+static uint32_t s_count;
+static uint64_t s_generation; // incremented for every batch, so threads know there's a new one
+static bool s_stopping;
+
+// these change while threads are working, so they're atomic instead of being protected by the mutex
+static atomic_uint s_nextIndex; // the next index to be run
+static atomic_uint s_doneCount; // the number of indices that have been run
+
+// the number of threads working on the current batch, it's protected by the mutex
+static uint32_t s_activeCount;
+
+static Mutex_t s_mutex;
+static Condition_t s_workCondition; // signalled when there's a new batch
+static Condition_t s_doneCondition; // signalled when a thread finishes its part of a batch
+
+// only one batch can run at a time, this makes RunJobs safe to call from multiple threads
+static Mutex_t s_runMutex;
+
+// run indices from the current batch until there aren't any left
+static void RunBatch(JobFunction_t function, void* data, uint32_t count);
+
+// what the threads in the pool run
+static void JobThread(void* data);
+
+void StartJobs(uint32_t threadCount)
+{
+	// the thread calling RunJobs helps out too, so one less thread than there are cpus keeps every
+	// cpu busy without having more threads than cpus
+	if (!threadCount)
+	{
+		threadCount = GetCpuCount();
+	}
+	s_threadCount = threadCount - 1;
+
+	InitMutex(&s_mutex);
+	InitMutex(&s_runMutex);
+	InitCondition(&s_workCondition);
+	InitCondition(&s_doneCondition);
+	s_stopping = false;
+	s_generation = 0;
+
+	if (s_threadCount)
+	{
+		s_threads = calloc(s_threadCount, sizeof(Thread_t));
+		if (!s_threads)
+		{
+			FatalError("failed to allocate %zu bytes!", s_threadCount * sizeof(Thread_t));
+		}
+	}
+
+	for (uint32_t i = 0; i < s_threadCount; i++)
+	{
+		char name[32] = {0};
+		snprintf(name, sizeof(name), "Job thread %u", i);
+		s_threads[i] = StartThread(JobThread, NULL, name);
+	}
+
+	printf("Started %u job threads\n", s_threadCount);
+}
+
+void StopJobs(void)
+{
+	LockMutex(&s_mutex);
+	s_stopping = true;
+	BroadcastCondition(&s_workCondition);
+	UnlockMutex(&s_mutex);
+
+	for (uint32_t i = 0; i < s_threadCount; i++)
+	{
+		JoinThread(s_threads[i]);
+	}
+	free(s_threads);
+	s_threads = NULL;
+	s_threadCount = 0;
+
+	DestroyCondition(&s_doneCondition);
+	DestroyCondition(&s_workCondition);
+	DestroyMutex(&s_runMutex);
+	DestroyMutex(&s_mutex);
+}
+
+uint32_t GetJobThreadCount(void)
+{
+	// including the thread that calls RunJobs
+	return s_threadCount + 1;
+}
+
+void RunJobs(JobFunction_t function, void* data, uint32_t count)
+{
+	if (!count)
+	{
+		return;
+	}
+
+	// with no threads, or just one job, there's no point waking anything up
+	if (!s_threadCount || count == 1)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			function(data, i);
+		}
+		return;
+	}
+
+	LockMutex(&s_runMutex);
+
+	// a thread that woke up late for the last batch can still be running it after it finished (it
+	// only finds there's nothing left once it gets there). the counters can't be reset under it,
+	// or it would grab an index from this batch and run it with the last batch's function and data.
+	LockMutex(&s_mutex);
+	while (s_activeCount)
+	{
+		WaitCondition(&s_doneCondition, &s_mutex);
+	}
+	s_function = function;
+	s_data = data;
+	s_count = count;
+	atomic_store(&s_nextIndex, 0);
+	atomic_store(&s_doneCount, 0);
+	s_generation++;
+	BroadcastCondition(&s_workCondition);
+	UnlockMutex(&s_mutex);
+
+	RunBatch(function, data, count);
+
+	// wait for every index to be done, and for every thread that's already working on this batch to
+	// stop looking at it
+	LockMutex(&s_mutex);
+	while (atomic_load(&s_doneCount) < count || s_activeCount)
+	{
+		WaitCondition(&s_doneCondition, &s_mutex);
+	}
+	UnlockMutex(&s_mutex);
+
+	UnlockMutex(&s_runMutex);
+}
+
+static void RunBatch(JobFunction_t function, void* data, uint32_t count)
+{
+	CPU_ZONE_BEGIN("RunBatch");
+	while (true)
+	{
+		// fetch_add returns the value before adding, so every thread gets a different index
+		uint32_t index = atomic_fetch_add(&s_nextIndex, 1);
+		if (index >= count)
+		{
+			break;
+		}
+
+		function(data, index);
+		atomic_fetch_add(&s_doneCount, 1);
+	}
+	CPU_ZONE_END();
+}
+
+static void JobThread(void* data)
+{
+	(void)data;
+
+	uint64_t generation = 0;
+	LockMutex(&s_mutex);
+	while (true)
+	{
+		while (!s_stopping && s_generation == generation)
+		{
+			WaitCondition(&s_workCondition, &s_mutex);
+		}
+		if (s_stopping)
+		{
+			break;
+		}
+
+		// copy the batch while the mutex is locked, so it's the same batch the counters are for
+		generation = s_generation;
+		JobFunction_t function = s_function;
+		void* batchData = s_data;
+		uint32_t count = s_count;
+		s_activeCount++;
+		UnlockMutex(&s_mutex);
+
+		RunBatch(function, batchData, count);
+
+		LockMutex(&s_mutex);
+		s_activeCount--;
+		SignalCondition(&s_doneCondition);
+	}
+	UnlockMutex(&s_mutex);
+}
@@ -0,0 +1,529 @@
+// this file is the linux version of win32.c. the machines this runs on usually don't have a display
+// (and often don't have a gpu either, in which case mesa's llvmpipe renders on the cpu), so instead
+// of a window, the "window" is a framebuffer object on a context that has no surface at all.
+//
+// egl is used to create the context. it has platforms, which are basically what kind of display
+// it's talking to (x11, wayland, gbm, etc), and two of them don't need a display:
+// - EGL_MESA_platform_surfaceless, which works with any mesa driver including llvmpipe
+// - EGL_EXT_platform_device, which lets you pick a gpu directly (nvidia's driver has this)
+
+// this has to be defined before any system headers to get gnu extensions like pthread_setname_np
+#define _GNU_SOURCE 1
+
+#include "stuff.h"
+
+// this function uses dlsym to get the addresses of functions in libEGL.so for glad so it can load
+// egl, then uses eglGetProcAddress for everything else (same idea as the one in win32.c)
+static GLADapiproc GetGlFunction(const char* name);
+
+// this function creates the framebuffer object that gets used in place of a window
+static void CreateFramebuffer(void);
+
+// this function gets called by the system when the process is asked to stop (ctrl+c or kill), and
+// it's the closest thing to the window being closed
+static void HandleSignal(int32_t signalNumber);
+
+static void* s_eglModule;      // handle to libEGL.so, needed for getting function addresses
+static void* s_openglModule;   // handle to libOpenGL.so, for core functions egl doesn't give out
+static EGLDisplay s_display;   // the egl display, which is the connection to the driver
+static EGLContext s_glContext; // the opengl context
+static uint32_t s_framebuffer; // the framebuffer object that acts as the window
+static uint32_t s_colourBuffer; // the colour attachment of the framebuffer
+static uint32_t s_depthBuffer;  // the depth/stencil attachment of the framebuffer
+static int32_t s_windowWidth;   // the width of the "window"
+static int32_t s_windowHeight;  // the height of the "window"
+
+// set from a signal handler, so it has to be volatile sig_atomic_t (the only type that's guaranteed
+// to be safe to write from one)
+static volatile sig_atomic_t s_windowClosed;
+
+void CreateMainWindow(void)
+{
+	// there's no window manager to ask, so the size comes from the environment, with a default
+	// that's a normal-ish window size
+	const char* width = getenv("GLDEMO_WIDTH");
+	const char* height = getenv("GLDEMO_HEIGHT");
+	s_windowWidth = width ? atoi(width) : 1280;
+	s_windowHeight = height ? atoi(height) : 720;
+	if (s_windowWidth <= 0 || s_windowHeight <= 0)
+	{
+		FatalError("invalid window size %dx%d!", s_windowWidth, s_windowHeight);
+	}
+
+	printf("Creating %dx%d headless window\n", s_windowWidth, s_windowHeight);
+
+	// ctrl+c and kill are how a headless program gets closed
+	signal(SIGINT, HandleSignal);
+	signal(SIGTERM, HandleSignal);
+	s_windowClosed = false;
+}
+
+void DestroyMainWindow(void)
+{
+	if (s_framebuffer)
+	{
+		printf("Deleting framebuffer\n");
+		glDeleteFramebuffers(1, &s_framebuffer);
+		glDeleteRenderbuffers(2, (uint32_t[]){s_colourBuffer, s_depthBuffer});
+		s_framebuffer = 0;
+	}
+
+	// there's no context when the software renderer is used
+	if (s_glContext)
+	{
+		printf("Deleting OpenGL context\n");
+		eglMakeCurrent(s_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(s_display, s_glContext);
+		s_glContext = EGL_NO_CONTEXT;
+
+		// terminating the display frees everything egl has for it
+		eglTerminate(s_display);
+		s_display = EGL_NO_DISPLAY;
+	}
+}
+
+void CreateGlContext(void)
+{
+	printf("Initializing OpenGL\n");
+
+	// libEGL.so is the glvnd dispatcher, it finds the right driver (mesa, nvidia) on its own. the
+	// .1 is the abi version, the plain .so only exists when development packages are installed.
+	s_eglModule = dlopen("libEGL.so.1", RTLD_NOW | RTLD_LOCAL);
+	if (!s_eglModule)
+	{
+		FatalError("failed to load libEGL.so.1: %s!", dlerror());
+	}
+	s_openglModule = dlopen("libOpenGL.so.0", RTLD_NOW | RTLD_LOCAL);
+
+	// first, egl gets loaded without a display. this only gets the client extensions, which are
+	// the ones that say which platforms are available
+	if (!gladLoadEGL(EGL_NO_DISPLAY, GetGlFunction) || !GLAD_EGL_EXT_platform_base)
+	{
+		FatalError("failed to load EGL, or EGL_EXT_platform_base isn't supported!");
+	}
+
+	// the surfaceless platform is preferred because it works on any mesa driver, the device one is
+	// for drivers that aren't mesa
+	s_display = EGL_NO_DISPLAY;
+	if (GLAD_EGL_MESA_platform_surfaceless)
+	{
+		printf("Using EGL_MESA_platform_surfaceless\n");
+		s_display =
+			eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (s_display == EGL_NO_DISPLAY && GLAD_EGL_EXT_platform_device &&
+		GLAD_EGL_EXT_device_enumeration)
+	{
+		// this works like wglChoosePixelFormatARB, where it's asked for up to a certain number of
+		// devices and says how many there are. the first one is usually the best one.
+		EGLDeviceEXT devices[8] = {0};
+		EGLint deviceCount = 0;
+		eglQueryDevicesEXT(8, devices, &deviceCount);
+		printf("Using EGL_EXT_platform_device (found %d devices)\n", deviceCount);
+		if (deviceCount > 0)
+		{
+			s_display = eglGetPlatformDisplayEXT(EGL_PLATFORM_DEVICE_EXT, devices[0], NULL);
+		}
+	}
+	if (s_display == EGL_NO_DISPLAY)
+	{
+		FatalError("failed to get a headless EGL display: error 0x%X!", eglGetError());
+	}
+
+	EGLint eglMajor = 0;
+	EGLint eglMinor = 0;
+	if (!eglInitialize(s_display, &eglMajor, &eglMinor))
+	{
+		FatalError("failed to initialize EGL: error 0x%X!", eglGetError());
+	}
+
+	// now that there's a display, load egl again to get everything it supports
+	gladLoadEGL(s_display, GetGlFunction);
+	printf(
+		"Initialized EGL %d.%d (%s)\n", eglMajor, eglMinor, eglQueryString(s_display, EGL_VENDOR));
+
+	if (!GLAD_EGL_KHR_surfaceless_context)
+	{
+		FatalError("EGL_KHR_surfaceless_context isn't supported!");
+	}
+
+	// egl can make contexts for opengl es and openvg too, this makes the next context normal opengl
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		FatalError("failed to bind the OpenGL API: error 0x%X!", eglGetError());
+	}
+
+	// a context without a surface doesn't need a config (the equivalent of a pixel format), but
+	// not every driver knows that, so one that can render opengl gets picked otherwise
+	EGLConfig config = EGL_NO_CONFIG_KHR;
+	if (!GLAD_EGL_KHR_no_config_context)
+	{
+		// clang-format off
+		static const EGLint CONFIG_ATTRIBS[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8,
+			EGL_GREEN_SIZE, 8,
+			EGL_BLUE_SIZE, 8,
+			EGL_ALPHA_SIZE, 8,
+			EGL_DEPTH_SIZE, 24,
+			EGL_STENCIL_SIZE, 8,
+
+			// terminator
+			EGL_NONE
+		};
+		// clang-format on
+
+		EGLint configCount = 0;
+		if (!eglChooseConfig(s_display, CONFIG_ATTRIBS, &config, 1, &configCount) || !configCount)
+		{
+			FatalError("failed to choose an EGL config: error 0x%X!", eglGetError());
+		}
+	}
+
+	// unlike wgl, egl won't give a lower version than requested, so newer versions are tried first.
+	// llvmpipe only goes up to 4.5 in a lot of mesa versions, for example.
+	static const EGLint VERSIONS[][2] = {
+		{4, 6},
+		{4, 5},
+		{4, 3},
+		{3, 3},
+	};
+	s_glContext = EGL_NO_CONTEXT;
+	for (size_t i = 0; i < sizeof(VERSIONS) / sizeof(VERSIONS[0]) && !s_glContext; i++)
+	{
+		// same attributes as the ones in win32.c
+		// clang-format off
+		const EGLint contextAttribs[] = {
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_CONTEXT_MAJOR_VERSION, VERSIONS[i][0],
+			EGL_CONTEXT_MINOR_VERSION, VERSIONS[i][1],
+			EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+
+			// terminator
+			EGL_NONE
+		};
+		// clang-format on
+
+		s_glContext = eglCreateContext(s_display, config, EGL_NO_CONTEXT, contextAttribs);
+	}
+	if (!s_glContext)
+	{
+		FatalError("failed to create OpenGL context: error 0x%X!", eglGetError());
+	}
+
+	// no surfaces, the framebuffer object gets drawn to instead
+	if (!eglMakeCurrent(s_display, EGL_NO_SURFACE, EGL_NO_SURFACE, s_glContext))
+	{
+		FatalError("failed to make EGL context current: error 0x%X!", eglGetError());
+	}
+
+	// load the rest of opengl
+	CPU_ZONE_BEGIN("gladLoadGL");
+	if (!gladLoadGL(GetGlFunction))
+	{
+		FatalError("failed to load OpenGL!");
+	}
+	CPU_ZONE_END();
+
+	printf(
+		"Got %s %s OpenGL context with GLSL %s on render device %s\n", glGetString(GL_VENDOR),
+		glGetString(GL_VERSION), glGetString(GL_SHADING_LANGUAGE_VERSION),
+		glGetString(GL_RENDERER));
+
+	CreateFramebuffer();
+}
+
+bool Update(void)
+{
+	// there aren't any events to handle without a window, apart from the signals
+	return !s_windowClosed;
+}
+
+void MakeGlContextCurrent(bool current)
+{
+	// there's no surface, the framebuffer object is part of the context so it comes along with it
+	if (!eglMakeCurrent(
+			s_display, EGL_NO_SURFACE, EGL_NO_SURFACE, current ? s_glContext : EGL_NO_CONTEXT))
+	{
+		FatalError(
+			"failed to make EGL context %s: error 0x%X!", current ? "current" : "not current",
+			eglGetError());
+	}
+}
+
+void Present(void)
+{
+	// there's nothing to swap, but swapping also makes the driver start on the commands it has so
+	// far, which glFlush does on its own
+	glFlush();
+}
+
+int32_t GetWindowWidth(void)
+{
+	return s_windowWidth;
+}
+
+int32_t GetWindowHeight(void)
+{
+	return s_windowHeight;
+}
+
+uint64_t GetTime(void)
+{
+	// CLOCK_MONOTONIC is the clock that doesn't change when the system time does, and on linux
+	// it's read without a system call so it's fast enough to call a lot
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+}
+
+void SleepUntil(uint64_t time)
+{
+	// TIMER_ABSTIME sleeps until a point in time instead of for an amount of time, so a signal
+	// waking it up early doesn't make it sleep too long when it goes back to sleep
+	struct timespec until;
+	until.tv_sec = (time_t)(time / 1000000000);
+	until.tv_nsec = (long)(time % 1000000000);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR)
+	{
+	}
+}
+
+uint32_t GetCpuCount(void)
+{
+	// the affinity mask is the set of cpus this process is allowed to run on, which can be less
+	// than the number of cpus in the machine (in containers, or with taskset)
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0)
+	{
+		return (uint32_t)CPU_COUNT(&cpus);
+	}
+
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint32_t)count : 1;
+}
+
+MappedFile_t MapFile(const char* name)
+{
+	MappedFile_t file = {0};
+
+	// files in the .pak file are already mapped
+	if (FindPakFile(name, &file))
+	{
+		return file;
+	}
+
+	// O_CLOEXEC stops the file staying open in child processes, which doesn't matter here but is a
+	// good habit
+	int32_t descriptor = open(name, O_RDONLY | O_CLOEXEC);
+	if (descriptor < 0)
+	{
+		FatalError("failed to open file %s: %s!", name, strerror(errno));
+	}
+	struct stat info;
+	if (fstat(descriptor, &info) < 0)
+	{
+		FatalError("failed to get the size of file %s: %s!", name, strerror(errno));
+	}
+	file.size = (size_t)info.st_size;
+
+	// mmap can't map 0 bytes
+	file.data = "";
+	if (file.size)
+	{
+		// MAP_PRIVATE means writes wouldn't go back to the file, but the pages can't be written
+		// anyway, so it's the same as MAP_SHARED except nothing can change the mapping from outside
+		void* data = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (data == MAP_FAILED)
+		{
+			FatalError("failed to map file %s: %s!", name, strerror(errno));
+		}
+
+		// MADV_SEQUENTIAL makes the kernel read further ahead, and drop pages behind where it's
+		// being read sooner. MADV_WILLNEED starts reading the whole thing in now instead of waiting
+		// for page faults. they're only hints, so it doesn't matter if they fail.
+		madvise(data, file.size, MADV_SEQUENTIAL);
+		madvise(data, file.size, MADV_WILLNEED);
+		file.data = data;
+	}
+
+	// the mapping keeps its own reference to the file, so it stays valid after closing it
+	close(descriptor);
+
+	return file;
+}
+
+void UnmapFile(MappedFile_t* file)
+{
+	// files from the .pak file are part of its mapping, so they stay mapped until it's closed.
+	// compressed ones aren't, they got decompressed into memory of their own.
+	if (file->decompressed)
+	{
+		free(file->decompressed);
+	}
+	else if (file->size && !file->packed)
+	{
+		munmap((void*)file->data, file->size);
+	}
+	memset(file, 0, sizeof(MappedFile_t));
+}
+
+// pthreads want a function that takes and returns void*, so this is what actually gets run and it
+// calls the real function
+typedef struct ThreadStart
+{
+	ThreadFunction_t function;
+	void* data;
+	char name[32];
+} ThreadStart_t;
+
+static void* ThreadMain(void* data)
+{
+	ThreadStart_t start = *(ThreadStart_t*)data;
+	free(data);
+	NameCpuProfilerThread(start.name);
+	start.function(start.data);
+	return NULL;
+}
+
+Thread_t StartThread(ThreadFunction_t function, void* data, const char* name)
+{
+	// this has to be on the heap, because this function can return before the thread starts
+	ThreadStart_t* start = calloc(1, sizeof(ThreadStart_t));
+	if (!start)
+	{
+		FatalError("failed to allocate %zu bytes!", sizeof(ThreadStart_t));
+	}
+	start->function = function;
+	start->data = data;
+	snprintf(start->name, sizeof(start->name), "%s", name);
+
+	pthread_t thread;
+	int32_t error = pthread_create(&thread, NULL, ThreadMain, start);
+	if (error)
+	{
+		FatalError("failed to create thread %s: error %d!", name, error);
+	}
+
+	// names can only be 15 characters on linux, longer ones are an error so they get cut off
+	char shortName[16] = {0};
+	snprintf(shortName, sizeof(shortName), "%s", name);
+	pthread_setname_np(thread, shortName);
+
+	return thread;
+}
+
+void JoinThread(Thread_t thread)
+{
+	pthread_join(thread, NULL);
+}
+
+void InitMutex(Mutex_t* mutex)
+{
+	pthread_mutex_init(mutex, NULL);
+}
+
+void DestroyMutex(Mutex_t* mutex)
+{
+	pthread_mutex_destroy(mutex);
+}
+
+void LockMutex(Mutex_t* mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+void UnlockMutex(Mutex_t* mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+void InitCondition(Condition_t* condition)
+{
+	pthread_cond_init(condition, NULL);
+}
+
+void DestroyCondition(Condition_t* condition)
+{
+	pthread_cond_destroy(condition);
+}
+
+void WaitCondition(Condition_t* condition, Mutex_t* mutex)
+{
+	pthread_cond_wait(condition, mutex);
+}
+
+void SignalCondition(Condition_t* condition)
+{
+	pthread_cond_signal(condition);
+}
+
+void BroadcastCondition(Condition_t* condition)
+{
+	pthread_cond_broadcast(condition);
+}
+
+static void CreateFramebuffer(void)
+{
+	// a framebuffer object is a set of images that get rendered to. the default framebuffer (0) is
+	// the window's, but there isn't one here. renderbuffers are images that can only be rendered to
+	// (as opposed to textures, which can also be sampled in shaders).
+	glGenFramebuffers(1, &s_framebuffer);
+	glGenRenderbuffers(1, &s_colourBuffer);
+	glGenRenderbuffers(1, &s_depthBuffer);
+
+	// same formats as the pixel format in win32.c, 32 bit colour and 24 bit depth with 8 bit
+	// stencil
+	glBindRenderbuffer(GL_RENDERBUFFER, s_colourBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, s_windowWidth, s_windowHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, s_depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, s_windowWidth, s_windowHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, s_framebuffer);
+	glFramebufferRenderbuffer(
+		GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, s_colourBuffer);
+	glFramebufferRenderbuffer(
+		GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, s_depthBuffer);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		FatalError("failed to create framebuffer: status 0x%X!", status);
+	}
+
+	// it stays bound for the whole program, so everything main.c draws goes into it
+	glObjectLabel(GL_FRAMEBUFFER, s_framebuffer, 6, "Window");
+	glObjectLabel(GL_RENDERBUFFER, s_colourBuffer, 13, "Window colour");
+	glObjectLabel(GL_RENDERBUFFER, s_depthBuffer, 12, "Window depth");
+
+	printf("Created %dx%d framebuffer\n", s_windowWidth, s_windowHeight);
+}
+
+static void HandleSignal(int32_t signalNumber)
+{
+	// printf isn't safe to call in a signal handler, so this just sets the flag and Update notices
+	(void)signalNumber;
+	s_windowClosed = true;
+}
+
+static GLADapiproc GetGlFunction(const char* name)
+{
+	// first, try getting the symbol from libEGL.so directly (this is the only way to get egl
+	// functions before eglGetProcAddress is loaded)
+	void* symbol = dlsym(s_eglModule, name);
+	if (!symbol && eglGetProcAddress)
+	{
+		// now, try egl, which gives out every opengl function on mesa and nvidia
+		symbol = (void*)eglGetProcAddress(name);
+	}
+	if (!symbol && s_openglModule)
+	{
+		// lastly, libOpenGL.so has the core functions
+		symbol = dlsym(s_openglModule, name);
+	}
+
+	return (GLADapiproc)symbol;
+}
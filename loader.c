@@ -0,0 +1,274 @@
+// this file implements loading things in the background. loading everything before the first frame
+// means looking at nothing while files get read and meshes get built, so instead, loads get queued
+// and loader threads work through them while frames get drawn, and things show up once they're
+// ready.
+//
+// anything that uses opengl has to happen on the thread with the context, which is the render
+// thread (or the main thread with --no-render-thread). so a load is split in two: a loader thread
+// does the slow part and puts the request in a completion queue, and FinishLoads does the rest on
+// the context thread at the start of every frame packet.
+//
+// the completion queue is lock free, so the render thread never waits for a loader thread. it's a
+// linked list that loader threads push onto with compare and swap, and FinishLoads takes the whole
+// list at once by swapping it with NULL. that gives it the newest first, so it gets reversed to
+// finish things in the order they were loaded.
+
+#include "stuff.h"
+
+// the number of loader threads. loads mostly wait for the disk, or use RunJobs for anything heavy,
+// so a couple of threads is enough to keep them moving without fighting the job threads.
+#define LOADER_THREAD_COUNT 2
+
+// what the loader threads run
+static void LoaderThread(void* data);
+
+// finish (or throw away) a list of loaded requests
+static void FinishLoadList(LoadRequest_t* list, bool cancelAll);
+
+static Thread_t s_threads[LOADER_THREAD_COUNT];
+static bool s_started;
+
+// the loads waiting for a loader thread, in the order they were queued. these are protected by
+// s_mutex.
+static LoadRequest_t** s_queue;
+static uint32_t s_queueCount;
+static uint32_t s_queueCapacity;
+static uint32_t s_busyCount; // the number of loads loader threads are working on
+static LoadRequest_t* s_loading[LOADER_THREAD_COUNT]; // what each loader thread is working on
+static bool s_stopping;
+
+static Mutex_t s_mutex;
+static Condition_t s_workCondition; // signalled when a load is queued
+static Condition_t s_idleCondition; // signalled when a loader thread is done with a load
+
+// the completion queue, the most recently loaded request first
+static _Atomic(LoadRequest_t*) s_completed;
+
+// these are only used on the context thread
+static uint32_t s_finishedCount;
+static uint32_t s_cancelledCount;
+
+void StartLoader(void)
+{
+	InitMutex(&s_mutex);
+	InitCondition(&s_workCondition);
+	InitCondition(&s_idleCondition);
+	s_queueCount = 0;
+	s_busyCount = 0;
+	memset(s_loading, 0, sizeof(s_loading));
+	s_stopping = false;
+	atomic_store(&s_completed, NULL);
+	s_finishedCount = 0;
+	s_cancelledCount = 0;
+
+	for (uint32_t i = 0; i < LOADER_THREAD_COUNT; i++)
+	{
+		char name[32] = {0};
+		snprintf(name, sizeof(name), "Loader thread %u", i);
+		s_threads[i] = StartThread(LoaderThread, (void*)(uintptr_t)i, name);
+	}
+	s_started = true;
+
+	printf("Started %u loader threads\n", LOADER_THREAD_COUNT);
+}
+
+void StopLoader(void)
+{
+	if (!s_started)
+	{
+		return;
+	}
+
+	// anything that hasn't started loading is cancelled. the loader threads finish whatever
+	// they're in the middle of before they stop, but those get marked as cancelled too, so long
+	// loads can check and give up early instead of holding up the program closing.
+	LockMutex(&s_mutex);
+	s_stopping = true;
+	for (uint32_t i = 0; i < s_queueCount; i++)
+	{
+		atomic_store(&s_queue[i]->state, LoadStateCancelled);
+		s_cancelledCount++;
+	}
+	s_queueCount = 0;
+	for (uint32_t i = 0; i < LOADER_THREAD_COUNT; i++)
+	{
+		if (s_loading[i])
+		{
+			atomic_store(&s_loading[i]->cancelled, true);
+		}
+	}
+	BroadcastCondition(&s_workCondition);
+	UnlockMutex(&s_mutex);
+
+	for (uint32_t i = 0; i < LOADER_THREAD_COUNT; i++)
+	{
+		JoinThread(s_threads[i]);
+	}
+	s_started = false;
+
+	// whatever got loaded but not finished gets thrown away, nothing would use it now
+	FinishLoadList(atomic_exchange(&s_completed, NULL), true);
+
+	printf("Loader: %u loads finished, %u cancelled\n", s_finishedCount, s_cancelledCount);
+
+	free(s_queue);
+	s_queue = NULL;
+	s_queueCapacity = 0;
+	DestroyCondition(&s_idleCondition);
+	DestroyCondition(&s_workCondition);
+	DestroyMutex(&s_mutex);
+}
+
+void QueueLoad(LoadRequest_t* request)
+{
+	request->result = NULL;
+	request->next = NULL;
+	request->queueTime = GetTime();
+	atomic_store(&request->cancelled, false);
+
+	LockMutex(&s_mutex);
+	if (s_queueCount >= s_queueCapacity)
+	{
+		uint32_t capacity = s_queueCapacity ? s_queueCapacity * 2 : 16;
+		LoadRequest_t** queue = realloc(s_queue, capacity * sizeof(LoadRequest_t*));
+		if (!queue)
+		{
+			FatalError("failed to allocate %zu bytes!", capacity * sizeof(LoadRequest_t*));
+		}
+		s_queue = queue;
+		s_queueCapacity = capacity;
+	}
+	s_queue[s_queueCount++] = request;
+	atomic_store(&request->state, LoadStateQueued);
+	SignalCondition(&s_workCondition);
+	UnlockMutex(&s_mutex);
+}
+
+LoadState_t GetLoadState(const LoadRequest_t* request)
+{
+	// this is read on a different thread than the result gets written on, but the state is
+	// written after the result, so if the state is done, so is the result
+	return atomic_load(&((LoadRequest_t*)request)->state);
+}
+
+void FinishLoads(void)
+{
+	FinishLoadList(atomic_exchange(&s_completed, NULL), false);
+}
+
+void WaitForLoads(void)
+{
+	if (!s_started)
+	{
+		return;
+	}
+
+	// a loader thread is only done with a load after it's in the completion queue, so once
+	// nothing is queued or being loaded, everything is in there
+	LockMutex(&s_mutex);
+	while (s_queueCount || s_busyCount)
+	{
+		WaitCondition(&s_idleCondition, &s_mutex);
+	}
+	UnlockMutex(&s_mutex);
+
+	FinishLoads();
+}
+
+static void FinishLoadList(LoadRequest_t* list, bool cancelAll)
+{
+	// reverse the list, so the oldest is first
+	LoadRequest_t* reversed = NULL;
+	while (list)
+	{
+		LoadRequest_t* next = list->next;
+		list->next = reversed;
+		reversed = list;
+		list = next;
+	}
+
+	while (reversed)
+	{
+		// once the state is changed, whoever queued the request can reuse it, so next has to be
+		// read before that
+		LoadRequest_t* request = reversed;
+		reversed = request->next;
+
+		bool cancelled = cancelAll || atomic_load(&request->cancelled);
+		CPU_ZONE_BEGIN("FinishLoad");
+		request->finish(request->data, request->result, cancelled);
+		CPU_ZONE_END();
+		if (cancelled)
+		{
+			s_cancelledCount++;
+		}
+		else
+		{
+			s_finishedCount++;
+			printf(
+				"Loaded %s %.3f ms after it was queued\n", request->name,
+				(GetTime() - request->queueTime) / 1e6);
+		}
+		atomic_store(&request->state, cancelled ? LoadStateCancelled : LoadStateDone);
+	}
+}
+
+static void LoaderThread(void* data)
+{
+	uint32_t index = (uint32_t)(uintptr_t)data;
+
+	LockMutex(&s_mutex);
+	while (true)
+	{
+		while (!s_stopping && !s_queueCount)
+		{
+			WaitCondition(&s_workCondition, &s_mutex);
+		}
+		if (s_stopping)
+		{
+			break;
+		}
+
+		// take the highest priority request, or the oldest one of those. there aren't many loads
+		// at once, so looking through all of them is fine.
+		uint32_t best = 0;
+		for (uint32_t i = 1; i < s_queueCount; i++)
+		{
+			if (s_queue[i]->priority > s_queue[best]->priority)
+			{
+				best = i;
+			}
+		}
+		LoadRequest_t* request = s_queue[best];
+		memmove(
+			&s_queue[best], &s_queue[best + 1], (s_queueCount - best - 1) * sizeof(LoadRequest_t*));
+		s_queueCount--;
+		atomic_store(&request->state, LoadStateLoading);
+		s_loading[index] = request;
+		s_busyCount++;
+		UnlockMutex(&s_mutex);
+
+		// it could have been cancelled since it was taken out of the queue
+		if (!atomic_load(&request->cancelled))
+		{
+			CPU_ZONE_BEGIN("Load");
+			request->result = request->load(request->data);
+			CPU_ZONE_END();
+		}
+		atomic_store(&request->state, LoadStateLoaded);
+
+		// push it onto the completion queue. if another thread pushed something between reading
+		// the head and swapping it, the swap fails, updates head, and it tries again.
+		LoadRequest_t* head = atomic_load(&s_completed);
+		do
+		{
+			request->next = head;
+		} while (!atomic_compare_exchange_weak(&s_completed, &head, request));
+
+		LockMutex(&s_mutex);
+		s_loading[index] = NULL;
+		s_busyCount--;
+		BroadcastCondition(&s_idleCondition);
+	}
+	UnlockMutex(&s_mutex);
+}
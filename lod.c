@@ -0,0 +1,644 @@
+// this file implements levels of detail (lods). something far away only covers a few pixels, so
+// drawing all of its triangles is a waste: most of them are smaller than a pixel. a lod chain is a
+// list of simpler versions of a mesh, and every frame, the simplest one that doesn't look any
+// different at the size it's drawn gets picked.
+//
+// the simpler versions come from collapsing edges: one end of an edge is moved onto the other, and
+// the triangles that used the edge disappear. the vertex that stays is one that already exists,
+// so every lod is just a different index buffer for the same vertices.
+//
+// the edges to collapse are picked with quadric error metrics (garland and heckbert, "surface
+// simplification using quadric error metrics", 1997). every vertex keeps a quadric, which is a
+// 4x4 matrix that gives the sum of squared distances from a point to the planes of the triangles
+// around it. moving a vertex somewhere is cheap if the new spot is close to all those planes, and
+// the quadrics are added together when vertices merge, so the error carries over to later
+// collapses.
+
+#include "stuff.h"
+
+// each lod tries to have half the triangles of the one before it
+#define LOD_REDUCTION 0.5
+
+// the chain stops once a lod can't get rid of at least this much of the one before it
+#define LOD_MIN_REDUCTION 0.85
+
+// a collapse can't turn a triangle more than about 80 degrees, otherwise it could flip over. this
+// is the cosine of that.
+#define LOD_MAX_NORMAL_CHANGE 0.2
+
+// used for "no vertex"
+#define LOD_NONE UINT32_MAX
+
+// a symmetric 4x4 matrix, only the unique parts are stored. weight is the total area of the planes
+// that were added, to turn the error into an average distance.
+typedef struct Quadric
+{
+	double xx, xy, xz, xw;
+	double yy, yz, yw;
+	double zz, zw;
+	double ww;
+	double weight;
+} Quadric_t;
+
+// an edge collapse, moving from onto to
+typedef struct LodCollapse
+{
+	uint32_t from;
+	uint32_t to;
+	float cost;
+} LodCollapse_t;
+
+// a vertex's position and index, for sorting vertices by position without qsort needing the mesh
+typedef struct LodSortVertex
+{
+	float position[3];
+	uint32_t index;
+} LodSortVertex_t;
+
+// work out which vertices can't move, and which ones are copies of another vertex
+static void FindLockedVertices(
+	const MeshData_t* mesh, const uint32_t* indices, uint32_t triangleCount, uint32_t* weld,
+	bool* locked);
+
+// add a triangle's plane to the quadrics of its vertices
+static void AddTriangleQuadric(
+	Quadric_t* quadrics, const MeshData_t* mesh, const uint32_t* triangle);
+
+// the squared distance from a point to a quadric's planes, on average
+static double EvaluateQuadric(const Quadric_t* quadric, const float* point);
+
+// whether moving from onto to would flip any of from's triangles
+static bool WouldFlip(
+	const MeshData_t* mesh, const uint32_t* indices, const uint32_t* offsets,
+	const uint32_t* triangles, uint32_t from, uint32_t to);
+
+// compare collapses for qsort, cheapest first
+static int CompareCollapses(const void* a, const void* b);
+
+// compare sort vertices for qsort by position, and then index
+static int CompareSortVertices(const void* a, const void* b);
+
+// the number of frames, triangles and lods picked, for the stats
+static uint64_t s_frameCount;
+static uint64_t s_drawCount;
+static uint64_t s_fullTriangles; // what would have been drawn without lods
+static uint64_t s_drawnTriangles;
+static uint64_t s_levelCounts[LOD_MAX_LEVELS];
+
+uint32_t SimplifyMesh(
+	const MeshData_t* mesh, const Index_t* indices, uint32_t indexCount, uint32_t targetCount,
+	float maxError, Index_t* output, float* resultError, const atomic_bool* cancelled)
+{
+	CPU_ZONE_BEGIN("SimplifyMesh");
+
+	uint32_t vertexCount = mesh->vertexCount;
+	uint32_t* weld = malloc(vertexCount * sizeof(uint32_t));
+	bool* locked = calloc(vertexCount, sizeof(bool));
+	Quadric_t* quadrics = calloc(vertexCount, sizeof(Quadric_t));
+	uint32_t* offsets = malloc((vertexCount + 1) * sizeof(uint32_t));
+	uint32_t* triangles = malloc((indexCount ? indexCount : 1) * 3 * sizeof(uint32_t));
+	LodCollapse_t* collapses = malloc((indexCount ? indexCount : 1) * 3 * sizeof(LodCollapse_t));
+	uint32_t* remap = malloc(vertexCount * sizeof(uint32_t));
+	bool* touched = malloc(vertexCount * sizeof(bool));
+	if (!weld || !locked || !quadrics || !offsets || !triangles || !collapses || !remap || !touched)
+	{
+		FatalError("failed to allocate simplifier memory for %u vertices!", vertexCount);
+	}
+
+	// the output is worked on in place. vertices in the same place with the same attributes (like
+	// the seam of a uv sphere) are welded together first, otherwise they'd look like holes.
+	uint32_t* current = (uint32_t*)output;
+	FindLockedVertices(mesh, (const uint32_t*)indices, indexCount, weld, locked);
+	uint32_t triangleCount = 0;
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		uint32_t a = weld[indices[i][0]];
+		uint32_t b = weld[indices[i][1]];
+		uint32_t c = weld[indices[i][2]];
+		if (a != b && b != c && c != a)
+		{
+			current[triangleCount * 3 + 0] = a;
+			current[triangleCount * 3 + 1] = b;
+			current[triangleCount * 3 + 2] = c;
+			AddTriangleQuadric(quadrics, mesh, &current[triangleCount * 3]);
+			triangleCount++;
+		}
+	}
+
+	// quadrics measure squared distance, so the error limit gets squared too
+	double maxCost = (double)maxError * maxError;
+	double error = 0.0;
+
+	// collapsing one edge changes the triangles around it, which changes the cost of collapsing
+	// the edges near it. so each pass works out the costs, does the cheapest collapses that don't
+	// touch each other, and then starts over with the new triangles.
+	while (triangleCount > targetCount && !(cancelled && atomic_load(cancelled)))
+	{
+		BuildMeshAdjacency(current, triangleCount, vertexCount, offsets, triangles);
+
+		// every edge can collapse either way, the cheaper one that's allowed is the candidate
+		uint32_t collapseCount = 0;
+		for (uint32_t i = 0; i < triangleCount * 3; i++)
+		{
+			uint32_t a = current[i];
+			uint32_t b = current[i % 3 == 2 ? i - 2 : i + 1];
+			if (a > b)
+			{
+				// each edge is in two triangles, this only keeps one of them
+				continue;
+			}
+
+			Quadric_t sum = quadrics[a];
+			const double* add = &quadrics[b].xx;
+			double* into = &sum.xx;
+			for (uint32_t j = 0; j < sizeof(Quadric_t) / sizeof(double); j++)
+			{
+				into[j] += add[j];
+			}
+
+			double costAB = locked[a] ? DBL_MAX : EvaluateQuadric(&sum, mesh->vertices[b].position);
+			double costBA = locked[b] ? DBL_MAX : EvaluateQuadric(&sum, mesh->vertices[a].position);
+			if (costAB == DBL_MAX && costBA == DBL_MAX)
+			{
+				continue;
+			}
+
+			LodCollapse_t* collapse = &collapses[collapseCount++];
+			collapse->from = costAB <= costBA ? a : b;
+			collapse->to = costAB <= costBA ? b : a;
+			collapse->cost = (float)(costAB <= costBA ? costAB : costBA);
+		}
+		qsort(collapses, collapseCount, sizeof(LodCollapse_t), CompareCollapses);
+
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			remap[i] = i;
+		}
+		memset(touched, 0, vertexCount * sizeof(bool));
+
+		// each collapse gets rid of about 2 triangles. a collapse can't happen next to one that
+		// already happened in this pass, because its flip check would be out of date. skipping
+		// those means going further down the list, so the pass also stops at the cost of the
+		// collapse that would reach the target if none were skipped. otherwise the last pass would
+		// do expensive collapses while cheaper ones are still waiting for the next pass.
+		uint32_t needed = (triangleCount - targetCount + 1) / 2;
+		uint32_t last = needed < collapseCount ? needed : collapseCount;
+		double passCost = fmin(last ? collapses[last - 1].cost : 0.0, maxCost);
+		uint32_t removed = 0;
+		uint32_t collapsed = 0;
+		for (uint32_t i = 0; i < collapseCount && triangleCount - removed > targetCount; i++)
+		{
+			LodCollapse_t* collapse = &collapses[i];
+			if (collapse->cost > passCost)
+			{
+				break;
+			}
+			if (touched[collapse->from] || touched[collapse->to] ||
+				WouldFlip(mesh, current, offsets, triangles, collapse->from, collapse->to))
+			{
+				continue;
+			}
+
+			remap[collapse->from] = collapse->to;
+			double* into = &quadrics[collapse->to].xx;
+			const double* add = &quadrics[collapse->from].xx;
+			for (uint32_t j = 0; j < sizeof(Quadric_t) / sizeof(double); j++)
+			{
+				into[j] += add[j];
+			}
+
+			for (uint32_t j = offsets[collapse->from]; j < offsets[collapse->from + 1]; j++)
+			{
+				const uint32_t* triangle = &current[triangles[j] * 3];
+				touched[triangle[0]] = true;
+				touched[triangle[1]] = true;
+				touched[triangle[2]] = true;
+			}
+			error = fmax(error, collapse->cost);
+			removed += 2;
+			collapsed++;
+		}
+		if (!collapsed)
+		{
+			break;
+		}
+
+		// triangles that had both ends of a collapsed edge are gone now
+		uint32_t newCount = 0;
+		for (uint32_t i = 0; i < triangleCount; i++)
+		{
+			uint32_t a = remap[current[i * 3 + 0]];
+			uint32_t b = remap[current[i * 3 + 1]];
+			uint32_t c = remap[current[i * 3 + 2]];
+			if (a != b && b != c && c != a)
+			{
+				current[newCount * 3 + 0] = a;
+				current[newCount * 3 + 1] = b;
+				current[newCount * 3 + 2] = c;
+				newCount++;
+			}
+		}
+		triangleCount = newCount;
+	}
+
+	free(touched);
+	free(remap);
+	free(collapses);
+	free(triangles);
+	free(offsets);
+	free(quadrics);
+	free(locked);
+	free(weld);
+
+	if (resultError)
+	{
+		*resultError = (float)sqrt(error);
+	}
+
+	CPU_ZONE_END();
+	return triangleCount;
+}
+
+void BuildLodChain(MeshData_t* mesh, LodChain_t* chain, const atomic_bool* cancelled)
+{
+	uint64_t start = GetTime();
+	memset(chain, 0, sizeof(LodChain_t));
+
+	// the bounding sphere is used to work out how big the mesh is on screen
+	float minimum[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+	float maximum[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	for (uint32_t i = 0; i < mesh->vertexCount; i++)
+	{
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			minimum[j] = fminf(minimum[j], mesh->vertices[i].position[j]);
+			maximum[j] = fmaxf(maximum[j], mesh->vertices[i].position[j]);
+		}
+	}
+	float radiusSquared = 0.0f;
+	for (uint32_t j = 0; j < 3; j++)
+	{
+		chain->center[j] = (minimum[j] + maximum[j]) * 0.5f;
+	}
+	for (uint32_t i = 0; i < mesh->vertexCount; i++)
+	{
+		float distance = 0.0f;
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			float offset = mesh->vertices[i].position[j] - chain->center[j];
+			distance += offset * offset;
+		}
+		radiusSquared = fmaxf(radiusSquared, distance);
+	}
+	chain->radius = sqrtf(radiusSquared);
+
+	// the first level is the mesh itself
+	chain->levels[0].firstIndex = 0;
+	chain->levels[0].indexCount = mesh->indexCount * 3;
+	chain->levels[0].error = 0.0f;
+	chain->levelCount = 1;
+
+	// each level is simplified from the one before it, which is faster than starting from the
+	// full mesh every time, and they all get added to the end of the mesh's indices. the error
+	// limit is the size of the mesh, so it's really only limited by the triangle count.
+	Index_t* indices = mesh->indices;
+	uint32_t indexCount = mesh->indexCount;
+	uint32_t levelStart = 0;
+	uint32_t levelCount = mesh->indexCount;
+	while (chain->levelCount < LOD_MAX_LEVELS)
+	{
+		Index_t* simplified = malloc((levelCount ? levelCount : 1) * sizeof(Index_t));
+		if (!simplified)
+		{
+			FatalError("failed to allocate %zu bytes!", levelCount * sizeof(Index_t));
+		}
+
+		float error = 0.0f;
+		uint32_t target = (uint32_t)(levelCount * LOD_REDUCTION);
+		uint32_t count = SimplifyMesh(
+			mesh, indices + levelStart, levelCount, target, chain->radius, simplified, &error,
+			cancelled);
+		if (count == 0 || count > levelCount * LOD_MIN_REDUCTION ||
+			(cancelled && atomic_load(cancelled)))
+		{
+			free(simplified);
+			break;
+		}
+
+		Index_t* grown = realloc(indices, (indexCount + count) * sizeof(Index_t));
+		if (!grown)
+		{
+			FatalError("failed to allocate %zu bytes!", (indexCount + count) * sizeof(Index_t));
+		}
+		indices = grown;
+		memcpy(indices + indexCount, simplified, count * sizeof(Index_t));
+		free(simplified);
+
+		// errors only get bigger down the chain, even if a level happened to be lucky
+		LodLevel_t* level = &chain->levels[chain->levelCount++];
+		level->firstIndex = indexCount * 3;
+		level->indexCount = count * 3;
+		level->error = fmaxf(error, chain->levels[chain->levelCount - 2].error);
+
+		levelStart = indexCount;
+		levelCount = count;
+		indexCount += count;
+	}
+	mesh->indices = indices;
+	mesh->indexCount = indexCount;
+	if (cancelled && atomic_load(cancelled))
+	{
+		return;
+	}
+
+	printf("Built %u lods in %.3f ms:", chain->levelCount, (GetTime() - start) / 1e6);
+	for (uint32_t i = 0; i < chain->levelCount; i++)
+	{
+		printf(
+			" %u (%.4f)", chain->levels[i].indexCount / 3,
+			chain->levels[i].error / chain->radius);
+	}
+	printf(" triangles (error relative to radius)\n");
+}
+
+uint32_t SelectLod(
+	const LodChain_t* chain, const float transform[4], int32_t width, int32_t height,
+	float pixelError)
+{
+	// clip space goes from -1 to 1, so half the viewport is one unit. the projection is
+	// orthographic, so the size on screen doesn't depend on how far away the mesh is. with
+	// perspective, it would be divided by the distance to the bounding sphere.
+	float pixelsPerUnit =
+		fmaxf(fabsf(transform[2]) * width * 0.5f, fabsf(transform[3]) * height * 0.5f);
+
+	// the simplest level whose error is less than the budget once it's on screen
+	uint32_t selected = 0;
+	for (uint32_t i = 1; i < chain->levelCount; i++)
+	{
+		if (chain->levels[i].error * pixelsPerUnit <= pixelError)
+		{
+			selected = i;
+		}
+	}
+
+	s_drawCount++;
+	s_levelCounts[selected]++;
+	s_fullTriangles += chain->levels[0].indexCount / 3;
+	s_drawnTriangles += chain->levels[selected].indexCount / 3;
+	return selected;
+}
+
+void EndLodFrame(void)
+{
+	if (s_drawCount)
+	{
+		s_frameCount++;
+	}
+}
+
+void PrintLodStats(void)
+{
+	if (!s_frameCount)
+	{
+		return;
+	}
+
+	printf(
+		"LODs: %.0f of %.0f triangles drawn per frame (%.1f%%), levels picked:",
+		(double)s_drawnTriangles / s_frameCount, (double)s_fullTriangles / s_frameCount,
+		s_fullTriangles ? 100.0 * s_drawnTriangles / s_fullTriangles : 0.0);
+	for (uint32_t i = 0; i < LOD_MAX_LEVELS; i++)
+	{
+		if (s_levelCounts[i])
+		{
+			printf(" %u: %.1f%%", i, 100.0 * s_levelCounts[i] / s_drawCount);
+		}
+	}
+	printf("\n");
+
+	s_frameCount = 0;
+	s_drawCount = 0;
+	s_fullTriangles = 0;
+	s_drawnTriangles = 0;
+	memset(s_levelCounts, 0, sizeof(s_levelCounts));
+}
+
+static void FindLockedVertices(
+	const MeshData_t* mesh, const uint32_t* indices, uint32_t triangleCount, uint32_t* weld,
+	bool* locked)
+{
+	uint32_t vertexCount = mesh->vertexCount;
+	LodSortVertex_t* order = malloc((vertexCount ? vertexCount : 1) * sizeof(LodSortVertex_t));
+	uint32_t* offsets = malloc((vertexCount + 1) * sizeof(uint32_t));
+	uint32_t* triangles = malloc((triangleCount ? triangleCount : 1) * 3 * sizeof(uint32_t));
+	uint32_t* neighbours = malloc((triangleCount ? triangleCount : 1) * 3 * sizeof(uint32_t));
+	if (!order || !offsets || !triangles || !neighbours)
+	{
+		FatalError("failed to allocate simplifier memory for %u vertices!", vertexCount);
+	}
+
+	// sorting puts vertices in the same place next to each other (the comparison only has to be
+	// consistent, so comparing the bytes is fine). if they're completely the same, they're welded
+	// into one, and if they have different attributes (like a texture seam), they're locked in
+	// place, because moving them would tear the seam open. the positions are copied next to the
+	// indices, so the comparison doesn't need to know about the mesh.
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		memcpy(order[i].position, mesh->vertices[i].position, sizeof(order[i].position));
+		order[i].index = i;
+		weld[i] = i;
+	}
+	qsort(order, vertexCount, sizeof(LodSortVertex_t), CompareSortVertices);
+	for (uint32_t i = 0; i < vertexCount;)
+	{
+		uint32_t end = i + 1;
+		bool same = true;
+		while (end < vertexCount &&
+			   memcmp(order[i].position, order[end].position, sizeof(order[i].position)) == 0)
+		{
+			same = same && memcmp(
+							   &mesh->vertices[order[i].index], &mesh->vertices[order[end].index],
+							   sizeof(Vertex_t)) == 0;
+			end++;
+		}
+		for (uint32_t j = i; j < end; j++)
+		{
+			weld[order[j].index] = same ? order[i].index : order[j].index;
+			locked[order[j].index] = !same;
+		}
+		i = end;
+	}
+
+	// vertices on the edge of a hole (or the outside of a flat mesh) are locked too, because the
+	// quadrics don't know anything about the edge, so it'd get eaten away. an edge is on the
+	// border if only one triangle has it.
+	uint32_t* weldedIndices = malloc((triangleCount ? triangleCount : 1) * 3 * sizeof(uint32_t));
+	if (!weldedIndices)
+	{
+		FatalError("failed to allocate simplifier memory for %u triangles!", triangleCount);
+	}
+	for (uint32_t i = 0; i < triangleCount * 3; i++)
+	{
+		weldedIndices[i] = weld[indices[i]];
+	}
+	BuildMeshAdjacency(weldedIndices, triangleCount, vertexCount, offsets, triangles);
+
+	for (uint32_t vertex = 0; vertex < vertexCount; vertex++)
+	{
+		// count how many triangles around the vertex have each edge from it, edges in only one
+		// are on the border
+		uint32_t neighbourCount = 0;
+		for (uint32_t i = offsets[vertex]; i < offsets[vertex + 1]; i++)
+		{
+			const uint32_t* triangle = &weldedIndices[triangles[i] * 3];
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				if (triangle[j] != vertex)
+				{
+					neighbours[neighbourCount++] = triangle[j];
+				}
+			}
+		}
+		for (uint32_t i = 0; i < neighbourCount && !locked[vertex]; i++)
+		{
+			uint32_t count = 0;
+			for (uint32_t j = 0; j < neighbourCount; j++)
+			{
+				count += neighbours[j] == neighbours[i];
+			}
+			if (count == 1)
+			{
+				locked[vertex] = true;
+			}
+		}
+	}
+
+	free(weldedIndices);
+	free(neighbours);
+	free(triangles);
+	free(offsets);
+	free(order);
+}
+
+static void AddTriangleQuadric(
+	Quadric_t* quadrics, const MeshData_t* mesh, const uint32_t* triangle)
+{
+	const float* a = mesh->vertices[triangle[0]].position;
+	const float* b = mesh->vertices[triangle[1]].position;
+	const float* c = mesh->vertices[triangle[2]].position;
+	double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+	double ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+	double normal[3] = {
+		ab[1] * ac[2] - ab[2] * ac[1],
+		ab[2] * ac[0] - ab[0] * ac[2],
+		ab[0] * ac[1] - ab[1] * ac[0],
+	};
+	double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+	if (length == 0.0)
+	{
+		return;
+	}
+
+	// the plane is n.p + d = 0, and the quadric is its outer product with itself, weighted by the
+	// triangle's area so big triangles matter more
+	double area = length * 0.5;
+	double x = normal[0] / length;
+	double y = normal[1] / length;
+	double z = normal[2] / length;
+	double w = -(x * a[0] + y * a[1] + z * a[2]);
+	Quadric_t plane = {
+		x * x * area, x * y * area, x * z * area, x * w * area, y * y * area, y * z * area,
+		y * w * area, z * z * area, z * w * area, w * w * area, area};
+
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		double* into = &quadrics[triangle[i]].xx;
+		const double* add = &plane.xx;
+		for (uint32_t j = 0; j < sizeof(Quadric_t) / sizeof(double); j++)
+		{
+			into[j] += add[j];
+		}
+	}
+}
+
+static double EvaluateQuadric(const Quadric_t* quadric, const float* point)
+{
+	// this is p^T Q p with p = (x, y, z, 1), written out
+	double x = point[0];
+	double y = point[1];
+	double z = point[2];
+	double error = quadric->xx * x * x + 2.0 * quadric->xy * x * y + 2.0 * quadric->xz * x * z +
+				   2.0 * quadric->xw * x + quadric->yy * y * y + 2.0 * quadric->yz * y * z +
+				   2.0 * quadric->yw * y + quadric->zz * z * z + 2.0 * quadric->zw * z +
+				   quadric->ww;
+	return quadric->weight > 0.0 ? fabs(error) / quadric->weight : 0.0;
+}
+
+static bool WouldFlip(
+	const MeshData_t* mesh, const uint32_t* indices, const uint32_t* offsets,
+	const uint32_t* triangles, uint32_t from, uint32_t to)
+{
+	// the triangles that have both from and to disappear, the rest get from moved to to's spot
+	for (uint32_t i = offsets[from]; i < offsets[from + 1]; i++)
+	{
+		const uint32_t* triangle = &indices[triangles[i] * 3];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+		{
+			continue;
+		}
+
+		const float* before[3];
+		const float* after[3];
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			before[j] = mesh->vertices[triangle[j]].position;
+			after[j] = triangle[j] == from ? mesh->vertices[to].position : before[j];
+		}
+
+		float normals[2][3];
+		const float** corners[2] = {before, after};
+		for (uint32_t j = 0; j < 2; j++)
+		{
+			const float** p = corners[j];
+			float ab[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]};
+			float ac[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]};
+			normals[j][0] = ab[1] * ac[2] - ab[2] * ac[1];
+			normals[j][1] = ab[2] * ac[0] - ab[0] * ac[2];
+			normals[j][2] = ab[0] * ac[1] - ab[1] * ac[0];
+		}
+
+		float dot = normals[0][0] * normals[1][0] + normals[0][1] * normals[1][1] +
+					normals[0][2] * normals[1][2];
+		float lengths = sqrtf(
+			(normals[0][0] * normals[0][0] + normals[0][1] * normals[0][1] +
+			 normals[0][2] * normals[0][2]) *
+			(normals[1][0] * normals[1][0] + normals[1][1] * normals[1][1] +
+			 normals[1][2] * normals[1][2]));
+		if (dot <= LOD_MAX_NORMAL_CHANGE * lengths)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int CompareCollapses(const void* a, const void* b)
+{
+	float costA = ((const LodCollapse_t*)a)->cost;
+	float costB = ((const LodCollapse_t*)b)->cost;
+	return (costA > costB) - (costA < costB);
+}
+
+static int CompareSortVertices(const void* a, const void* b)
+{
+	// the index makes the order the same whatever order qsort looks at them in
+	const LodSortVertex_t* vertexA = a;
+	const LodSortVertex_t* vertexB = b;
+	int result = memcmp(vertexA->position, vertexB->position, sizeof(vertexA->position));
+	if (result)
+	{
+		return result;
+	}
+	return (vertexA->index > vertexB->index) - (vertexA->index < vertexB->index);
+}
@@ -9,106 +9,928 @@
 // additionally, making a function static makes it local to that object file (compiled but unlinked
 // source file), which can let the compiler optimize more
 
-// draw the scene
-static void DrawScene(void);
+// read the command line arguments
+static void ParseArguments(int32_t argc, char* argv[]);
+
+// fill in a frame packet with what to draw
+static void BuildScene(FramePacket_t* packet);
+
+// draw the scene with the software renderer
+static void DrawSoftwareScene(void);
+
+// make a sphere with a radius of 1, segments around and segments / 2 from top to bottom
+static void GenerateSphere(MeshData_t* mesh, uint32_t segments);
+
+// make a grid of small quads that covers the screen, returns an array that has to be freed
+static Instance_t* GenerateInstances(uint32_t count);
+
+// the loader thread half of loading the sphere, which builds everything but the mesh
+static void* LoadSphere(void* data);
+
+// the context thread half of loading the sphere, which uploads it
+static void FinishSphere(void* data, void* result, bool cancelled);
+
+// the loader thread half of loading the .obj file, which imports and optimizes it
+static void* LoadObj(void* data);
+
+// the context thread half of loading the .obj file, which uploads it
+static void FinishObj(void* data, void* result, bool cancelled);
+
+// draw some submeshes of a mesh at x, scaled so the bounding sphere has the same size whatever the
+// mesh is
+static void AddModelDraw(
+	FramePacket_t* packet, uint32_t shader, const Mesh_t* mesh, const Submesh_t* submeshes,
+	uint32_t submeshCount, const float center[3], float radius, float x);
+
+// the mesh that gets drawn. these vertices are in screen coordinates, you would need a math library
+// to properly transform them and project them from model space to world space to screen space. the
+// vertices get multiplied with a special transformation matrix passed into the vertex shader in a
+// uniform buffer (a way to send data to the gpu for shaders to use). the consequence of them being
+// in screen coordinates is this should-be square gets stretched to be half the window's width and
+// height.
+//
+// it's kept in an array instead of being given straight to CreateMesh because the software
+// renderer needs it too. the count is calculated from the size of the array, so it can't be wrong.
+// clang-format off
+static const Vertex_t QUAD_VERTICES[] = {
+	//  x      y      z        r     g     b     a       normal
+	{{ 0.5f,  0.5f,  0.0f}, {1.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+	{{ 0.5f, -0.5f,  0.0f}, {0.0f, 1.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+	{{-0.5f, -0.5f,  0.0f}, {0.0f, 0.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+	{{-0.5f,  0.5f,  0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+};
+#define QUAD_VERTEX_COUNT (sizeof(QUAD_VERTICES) / sizeof(QUAD_VERTICES[0]))
+
+static const Index_t QUAD_INDICES[] = {
+	{0, 1, 2}, // triangle 1
+	{0, 2, 3}  // triangle 2
+};
+#define QUAD_INDEX_COUNT (sizeof(QUAD_INDICES) / sizeof(QUAD_INDICES[0]))
+// clang-format on
 
 // much like windows, opengl uses handles. instead of defining a custom type, opengl uses integers.
 
-// vertex buffer (the vertices of the mesh)
-static uint32_t s_vertexBuffer;
-// index buffer (list of indices in the vertex buffer that form the faces of the mesh)
-static uint32_t s_indexBuffer;
-// vertex array object (ties together a vertex buffer, index buffer, and vertex attributes to reduce
-// the amount of overhead for binding a mesh to be drawn)
-static uint32_t s_vertexArray;
-// shader program
-static uint32_t s_shader;
+// the quad's mesh. it has a part of a vertex buffer (the vertices of the mesh), a part of an index
+// buffer (list of indices in the vertex buffer that form the faces of the mesh), and a vertex array
+// object (ties together a vertex buffer, index buffer, and vertex attributes to reduce the amount
+// of overhead for binding a mesh to be drawn). the buffers and vertex array are shared with any
+// other meshes.
+static Mesh_t s_quad;
+// how the mesh's vertices are stored
+static const VertexFormat_t* s_vertexFormat;
+// shader program, batched.glsl unless --no-batching was given. it's loaded in the background, like
+// the sphere and the grid's shader, and things that use them don't get drawn until they're loaded.
+static ShaderLoad_t s_shaderLoad;
+// the mesh for the software renderer
+static uint32_t s_softwareMesh;
+// the sphere, its meshlets, space for the ranges that are left after culling them, and its lods.
+// the loader thread builds it in s_sphereData.
+static LoadRequest_t s_sphereLoad;
+static MeshData_t s_sphereData;
+static Mesh_t s_sphere;
+static Meshlet_t* s_sphereMeshlets;
+static uint32_t s_sphereMeshletCount;
+static IndexRange_t* s_sphereRanges;
+static LodChain_t s_sphereLods;
+// the mesh from a mesh file for --mesh, which gets uploaded straight from the file
+static MeshFileLoad_t s_meshLoad;
+// the mesh from an .obj file for --obj, which gets imported on the loader thread, and a submesh
+// that covers all of it
+static LoadRequest_t s_objLoad;
+static MeshData_t s_objData;
+static Mesh_t s_obj;
+static Submesh_t s_objSubmesh;
+// the grid of small quads for --instances, in an instance buffer, in a gpu cull scene, or on the
+// cpu for drawing them one at a time, and the shader for the first two
+static InstanceBuffer_t s_instances;
+static GpuCullScene_t s_cullScene;
+static Instance_t* s_instanceData;
+static ShaderLoad_t s_gridShaderLoad;
+// the number of frames BuildScene has built, for moving things around
+static uint64_t s_sceneFrame;
+
+// command line options
+static uint32_t s_benchmarkFrames;    // --frames, the number of frames to benchmark (0 means forever)
+static uint32_t s_benchmarkWarmup;    // --warmup, the number of frames to draw before benchmarking
+static const char* s_benchmarkOutput; // --out, where to write the benchmark results
+static const char* s_captureOutput;   // --capture, where to write captured frames
+static uint32_t s_captureRing = 3;    // --capture-ring, the number of pixel buffers for capturing
+static bool s_software;               // --software, draw with the software renderer
+static uint32_t s_threadCount;        // --threads, the number of job threads (0 means one per cpu)
+static bool s_gpuProfile;             // --gpu-profile, measure how long the gpu takes on each pass
+static const char* s_traceOutput;     // --trace, where to write the cpu profiler's trace
+static double s_frameRate;            // --fps, the frame rate to limit to (0 means no limit)
+static bool s_noRenderThread;         // --no-render-thread, make opengl calls on the main thread
+static const char* s_formatName;      // --vertex-format, how vertices are stored on the gpu
+static uint32_t s_sphereSegments;     // --sphere, draw a sphere with this many segments (0 is none)
+static float s_lodError = 1.0f;       // --lod-error, how many pixels a lod can be off by
+static uint32_t s_instanceCount;      // --instances, draw a grid of this many small quads
+static bool s_noInstancing;           // --no-instancing, draw the grid with a draw for each quad
+static bool s_noBatching;             // --no-batching, make an opengl draw call for every draw
+static bool s_gpuCull;                // --gpu-cull, cull the grid on the gpu
+static bool s_syncLoading;            // --sync-loading, wait for everything to load before starting
+static const char* s_pakName;         // --pak, the .pak file to load files from (or assets.pak)
+static bool s_noPak;                  // --no-pak, only load loose files
+static const char* s_meshName;        // --mesh, a mesh file to draw
+static const char* s_sphereOutput;    // --save-sphere, where to write the sphere as a mesh file
+static const char* s_objName;         // --obj, an .obj file to import and draw
 
 // main is the entry point, argc is the number of command line arguments, argv is the arguments
 int32_t main(int32_t argc, char* argv[])
 {
+	// the time at the very start is needed to know how long startup takes
+	uint64_t startTime = GetTime();
+
+	ParseArguments(argc, argv);
+
+	// this is started as early as possible so startup shows up in the trace
+	if (s_traceOutput)
+	{
+		StartCpuProfiler(s_traceOutput);
+	}
+	CPU_ZONE_BEGIN("Startup");
+
 	// It's common to separate parts of a program into functions to make it easier to follow, and
 	// also putting platform specific code into a function makes avoiding ifdefs easier, which is
 	// always nice
 
+	CPU_ZONE_BEGIN("CreateMainWindow");
 	CreateMainWindow();
-	CreateGlContext();
-
-	// clang-format off
-	s_vertexBuffer = CreateVertexBuffer(
-		// you can declare structs/arrays inline like this to pass them to functions more easily.
-		// these vertices are in screen coordinates, you would need a math library to properly
-		// transform them and project them from model space to world space to screen space. the
-		// vertices get multiplied with a special transformation matrix passed into the vertex
-		// shader in a uniform buffer (a way to send data to the gpu for shaders to use). the
-		// consequence of them being in screen coordinates is this should-be square gets stretched
-		// to be half the window's width and height.
-		(Vertex_t[]){
-			//  x      y      z        r     g     b     a
-			{{ 0.5f,  0.5f,  0.0f}, {1.0f, 0.0f, 0.0f, 1.0f}},
-			{{ 0.5f, -0.5f,  0.0f}, {0.0f, 1.0f, 0.0f, 1.0f}},
-			{{-0.5f, -0.5f,  0.0f}, {0.0f, 0.0f, 1.0f, 1.0f}},
-			{{-0.5f,  0.5f,  0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
-		},
-		4
-	);
-
-	s_indexBuffer = CreateIndexBuffer(
-		(Index_t[]) {
-			{0, 1, 2}, // triangle 1
-			{0, 2, 3}  // triangle 2
-		},
-		2
-	);
-	// clang-format on
-
-	s_vertexArray = CreateVertexArray(s_vertexBuffer, s_indexBuffer);
-
-	// shaders are programs that run on the gpu. the vertex shader acts on vertices, and the
-	// fragment shader acts on groups of pixels called fragments. vertex shaders handle transforming
-	// coordinate spaces, normal maps, and other stuff related to the positions of vertices, while
-	// fragment shaders are usually used for lighting. there are other kinds of shaders, but i
-	// barely even know what they're for.
-	s_shader = LoadShaders("vertex.glsl", "fragment.glsl");
+	CPU_ZONE_END();
+	StartJobs(s_threadCount);
+
+	// files come from the .pak file instead of loose files if it's there
+	if (!s_noPak)
+	{
+		OpenPak(s_pakName ? s_pakName : "assets.pak");
+	}
+
+	if (s_software)
+	{
+		// the software renderer doesn't need opengl at all, which is the point of it
+		CreateSoftwareRenderer(GetWindowWidth(), GetWindowHeight());
+		s_softwareMesh = CreateSoftwareMesh(
+			QUAD_VERTICES, QUAD_VERTEX_COUNT, QUAD_INDICES, QUAD_INDEX_COUNT);
+	}
+	else
+	{
+		CPU_ZONE_BEGIN("CreateGlContext");
+		CreateGlContext();
+		CPU_ZONE_END();
+
+		// shaders are programs that run on the gpu. the vertex shader acts on vertices, and the
+		// fragment shader acts on groups of pixels called fragments. vertex shaders handle
+		// transforming coordinate spaces, normal maps, and other stuff related to the positions of
+		// vertices, while fragment shaders are usually used for lighting. there are other kinds of
+		// shaders, but i barely even know what they're for.
+		//
+		// they load in the background along with the sphere while the first frames get drawn.
+		// they're needed to draw anything, so they have a higher priority.
+		StartLoader();
+		CPU_ZONE_BEGIN("QueueLoads");
+		// the batched shader reads its transform from a different place, but does the same thing
+		QueueLoadShaders(
+			&s_shaderLoad, s_noBatching ? "vertex.glsl" : "batched.glsl", "fragment.glsl", 1);
+		if (s_instanceCount && s_gpuCull)
+		{
+			QueueLoadShaders(&s_gridShaderLoad, "batched.glsl", "fragment.glsl", 1);
+		}
+		else if (s_instanceCount && !s_noInstancing)
+		{
+			QueueLoadShaders(&s_gridShaderLoad, "instanced.glsl", "fragment.glsl", 1);
+		}
+		if (s_sphereSegments)
+		{
+			s_sphereLoad.name = "sphere";
+			s_sphereLoad.load = LoadSphere;
+			s_sphereLoad.finish = FinishSphere;
+			QueueLoad(&s_sphereLoad);
+		}
+		if (s_meshName)
+		{
+			QueueLoadMeshFile(&s_meshLoad, s_meshName, 0);
+		}
+		if (s_objName)
+		{
+			s_objLoad.name = s_objName;
+			s_objLoad.load = LoadObj;
+			s_objLoad.finish = FinishObj;
+			QueueLoad(&s_objLoad);
+		}
+		CPU_ZONE_END();
+
+		// meshes get optimized before they're uploaded. the quad doesn't get much out of it, but
+		// it's tiny, and everything else needs it.
+		MeshData_t quadData = {0};
+		CopyMeshData(&quadData, QUAD_VERTICES, QUAD_VERTEX_COUNT, QUAD_INDICES, QUAD_INDEX_COUNT);
+		OptimizeMeshes(&quadData, 1);
+		s_quad = CreateMesh(
+			s_vertexFormat, quadData.vertices, quadData.vertexCount, quadData.indices,
+			quadData.indexCount);
+		FreeMeshData(&quadData);
+		printf(
+			"Using vertex format %s (%u bytes per vertex, Vertex_t is %zu)\n", s_vertexFormat->name,
+			s_vertexFormat->stride, sizeof(Vertex_t));
+
+		// the grid is copies of the quad, so it uses the quad's mesh either way
+		if (s_instanceCount)
+		{
+			s_instanceData = GenerateInstances(s_instanceCount);
+			if (s_gpuCull)
+			{
+				// the quad goes from -0.5 to 0.5, so its bounding sphere is centered on 0, with the
+				// distance to a corner as the radius
+				GpuCullObject_t* objects = calloc(s_instanceCount, sizeof(GpuCullObject_t));
+				if (!objects)
+				{
+					FatalError("failed to allocate %u objects!", s_instanceCount);
+				}
+				for (uint32_t i = 0; i < s_instanceCount; i++)
+				{
+					memcpy(
+						objects[i].transform, s_instanceData[i].transform,
+						sizeof(objects[i].transform));
+					objects[i].radius = sqrtf(0.5f);
+					objects[i].indexCount = s_quad.indices.count;
+					objects[i].firstIndex = s_quad.indices.offset;
+					objects[i].baseVertex = (int32_t)s_quad.vertices.offset;
+				}
+				s_cullScene = CreateGpuCullScene(&s_quad, objects, s_instanceCount);
+				free(objects);
+			}
+			else if (!s_noInstancing)
+			{
+				s_instances = CreateInstanceBuffer(&s_quad, s_instanceData, s_instanceCount);
+			}
+			if (!s_noInstancing)
+			{
+				free(s_instanceData);
+				s_instanceData = NULL;
+			}
+			printf(
+				"Drawing %u instances %s\n", s_instanceCount,
+				s_gpuCull        ? "culled on the gpu"
+				: s_noInstancing ? "with a draw each"
+								 : "with one instanced draw");
+		}
+
+		// with --sync-loading, everything is loaded before the first frame, like it would be
+		// without the loader
+		if (s_syncLoading)
+		{
+			CPU_ZONE_BEGIN("WaitForLoads");
+			WaitForLoads();
+			CPU_ZONE_END();
+		}
+
+		if (s_captureOutput)
+		{
+			StartCapture(s_captureOutput, s_captureRing);
+		}
+		if (s_gpuProfile)
+		{
+			StartGpuProfiler();
+		}
+
+		// this has to be last, because after this the main thread can't use opengl anymore
+		StartRenderer(!s_noRenderThread);
+	}
+
+	// this does nothing unless --frames was given
+	StartBenchmark(s_benchmarkFrames, s_benchmarkWarmup, startTime);
+	StartFramePacing(s_frameRate);
+	CPU_ZONE_END();
 
 	// graphical applications typically have a function that handles window events and returns
-	// false when the window is closed
-	while (Update())
+	// false when the window is closed. the zones look a bit messy, but they show where every frame's
+	// time goes in the trace.
+	while (true)
+	{
+		// this waits until it's time for the next frame if --fps was given
+		CPU_ZONE_BEGIN("PaceFrame");
+		PaceFrame();
+		CPU_ZONE_END();
+
+		CPU_ZONE_BEGIN("Frame");
+		CPU_ZONE_BEGIN("Update");
+		bool open = Update();
+		CPU_ZONE_END();
+		if (!open)
+		{
+			CPU_ZONE_END();
+			break;
+		}
+
+		bool measureStart = BeginBenchmarkFrame();
+		if (s_software)
+		{
+			CPU_ZONE_BEGIN("DrawSoftwareScene");
+			DrawSoftwareScene();
+			CPU_ZONE_END();
+			CPU_ZONE_BEGIN("PresentSoftware");
+			PresentSoftware(); // this is where the software renderer actually draws the pixels
+			CPU_ZONE_END();
+		}
+		else
+		{
+			// the render thread draws the packet while the main thread moves on to the next frame
+			CPU_ZONE_BEGIN("BeginFramePacket");
+			FramePacket_t* packet = BeginFramePacket(); // waits if the render thread is behind
+			packet->resetGpuProfiler = measureStart;
+			CPU_ZONE_END();
+			CPU_ZONE_BEGIN("BuildScene");
+			BuildScene(packet);
+			CPU_ZONE_END();
+			SubmitFramePacket(packet);
+			EndMeshletCullFrame();
+			EndLodFrame();
+		}
+		bool more = EndBenchmarkFrame();
+		CPU_ZONE_END();
+		if (!more)
+		{
+			break;
+		}
+	}
+
+	if (!s_software)
+	{
+		StopRenderer();
+	}
+	// the benchmark ends before waiting for the loader threads, which could be in the middle of
+	// something slow that has nothing to do with the frames
+	FinishBenchmark(s_benchmarkOutput);
+	if (!s_software)
 	{
-		DrawScene(); // draws stuff
-		Present();   // presenting just means putting whatever you drew onto the screen
+		// anything that's still loading is cancelled, this needs the context back
+		StopLoader();
 	}
+	StopFramePacing();
+	StopCapture();
+	StopGpuProfiler();
 
-	// clean up opengl resources. these probably get deleted with the context so they could probably
-	// be leaked without consequence in this case, but it's better practice to clean them up.
-	glDeleteProgram(s_shader);
-	glDeleteVertexArrays(1, &s_vertexArray);
-	// you can handily delete multiple buffers of any type in one line like this
-	glDeleteBuffers(2, (uint32_t[]){s_vertexBuffer, s_indexBuffer});
+	if (s_software)
+	{
+		DestroySoftwareRenderer();
+	}
+	else
+	{
+		// clean up opengl resources. these probably get deleted with the context so they could
+		// probably be leaked without consequence in this case, but it's better practice to clean
+		// them up.
+		if (GetLoadedShaders(&s_shaderLoad))
+		{
+			glDeleteProgram(GetLoadedShaders(&s_shaderLoad));
+		}
+		if (GetLoadedShaders(&s_gridShaderLoad))
+		{
+			glDeleteProgram(GetLoadedShaders(&s_gridShaderLoad));
+		}
+		if (s_instances.buffer)
+		{
+			DestroyInstanceBuffer(&s_instances);
+		}
+		if (s_cullScene.program)
+		{
+			DestroyGpuCullScene(&s_cullScene);
+		}
+		free(s_instanceData);
+		PrintMeshletCullStats();
+		PrintLodStats();
+		PrintBufferPoolStats();
+		DestroyMesh(&s_quad);
+		if (GetLoadState(&s_sphereLoad) == LoadStateDone)
+		{
+			DestroyMesh(&s_sphere);
+			free(s_sphereMeshlets);
+			free(s_sphereRanges);
+		}
+		if (GetLoadedMeshFile(&s_meshLoad))
+		{
+			DestroyMeshFile(&s_meshLoad.mesh);
+		}
+		if (GetLoadState(&s_objLoad) == LoadStateDone)
+		{
+			DestroyMesh(&s_obj);
+		}
+		DestroyBufferPools();
+	}
 
+	ClosePak();
+	StopJobs();
 	DestroyMainWindow();
 
+	// this is last so every other thread is stopped
+	StopCpuProfiler();
+
 	// for main specifically, this line is implied at the end of the function
 	return 0;
 }
 
-void DrawScene(void)
+static void ParseArguments(int32_t argc, char* argv[])
+{
+	// argv[0] is the name of the program, so the arguments start at 1. the options that take a
+	// value use the next argument, so they check that there is one.
+	for (int32_t i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+		{
+			s_benchmarkFrames = (uint32_t)strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+		{
+			s_benchmarkWarmup = (uint32_t)strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+		{
+			s_benchmarkOutput = argv[++i];
+		}
+		else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+		{
+			s_captureOutput = argv[++i];
+		}
+		else if (strcmp(argv[i], "--capture-ring") == 0 && i + 1 < argc)
+		{
+			s_captureRing = (uint32_t)strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--software") == 0)
+		{
+			s_software = true;
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		{
+			s_threadCount = (uint32_t)strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--gpu-profile") == 0)
+		{
+			s_gpuProfile = true;
+		}
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+		{
+			s_traceOutput = argv[++i];
+		}
+		else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+		{
+			s_frameRate = strtod(argv[++i], NULL);
+		}
+		else if (strcmp(argv[i], "--no-render-thread") == 0)
+		{
+			s_noRenderThread = true;
+		}
+		else if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc)
+		{
+			s_formatName = argv[++i];
+		}
+		else if (strcmp(argv[i], "--sphere") == 0 && i + 1 < argc)
+		{
+			s_sphereSegments = (uint32_t)strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--lod-error") == 0 && i + 1 < argc)
+		{
+			s_lodError = strtof(argv[++i], NULL);
+		}
+		else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+		{
+			s_instanceCount = (uint32_t)strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--no-instancing") == 0)
+		{
+			s_noInstancing = true;
+		}
+		else if (strcmp(argv[i], "--no-batching") == 0)
+		{
+			s_noBatching = true;
+		}
+		else if (strcmp(argv[i], "--gpu-cull") == 0)
+		{
+			s_gpuCull = true;
+		}
+		else if (strcmp(argv[i], "--sync-loading") == 0)
+		{
+			s_syncLoading = true;
+		}
+		else if (strcmp(argv[i], "--pak") == 0 && i + 1 < argc)
+		{
+			s_pakName = argv[++i];
+		}
+		else if (strcmp(argv[i], "--no-pak") == 0)
+		{
+			s_noPak = true;
+		}
+		else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+		{
+			s_meshName = argv[++i];
+		}
+		else if (strcmp(argv[i], "--save-sphere") == 0 && i + 1 < argc)
+		{
+			s_sphereOutput = argv[++i];
+		}
+		else if (strcmp(argv[i], "--obj") == 0 && i + 1 < argc)
+		{
+			s_objName = argv[++i];
+		}
+		else
+		{
+			FatalError(
+				"unknown argument %s!\n"
+				"usage: %s [--frames <count>] [--warmup <count>] [--out <results.json>]\n"
+				"          [--capture <frames.ppm|frame%%04u.ppm|video.y4m>] [--capture-ring <count>]\n"
+				"          [--software] [--threads <count>] [--gpu-profile] [--trace <trace.json>]\n"
+				"          [--fps <rate>] [--no-render-thread]\n"
+				"          [--vertex-format <float|half|snorm16|lit>] [--sphere <segments>]\n"
+				"          [--lod-error <pixels>] [--instances <count>] [--no-instancing]\n"
+				"          [--no-batching] [--gpu-cull] [--sync-loading]\n"
+				"          [--pak <file.pak>] [--no-pak] [--mesh <file.gmsh>]\n"
+				"          [--save-sphere <file.gmsh>] [--obj <file.obj>]",
+				argv[i], argv[0]);
+		}
+	}
+
+	// half floats are exact for the quad's positions, and 8 bits is exact for its colours, so the
+	// compact format looks the same as float for less than half the size
+	s_vertexFormat = s_formatName ? FindVertexFormat(s_formatName)
+										: GetVertexFormat(VertexFormatHalf);
+	if (!s_vertexFormat)
+	{
+		FatalError("unknown vertex format %s!", s_formatName);
+	}
+
+	if (s_software && (s_captureOutput || s_gpuProfile || s_sphereSegments || s_instanceCount ||
+					   s_meshName || s_objName))
+	{
+		FatalError(
+			"--capture, --gpu-profile, --sphere, --instances, --mesh and --obj only work with "
+			"opengl, not --software!");
+	}
+	if (s_sphereOutput && !s_sphereSegments)
+	{
+		FatalError("--save-sphere needs --sphere!");
+	}
+	if (s_sphereSegments && s_sphereSegments < 4)
+	{
+		FatalError("the sphere needs at least 4 segments!");
+	}
+	if (s_gpuCull && (!s_instanceCount || s_noInstancing))
+	{
+		FatalError("--gpu-cull needs --instances, and doesn't work with --no-instancing!");
+	}
+	if (!(s_lodError >= 0.0f))
+	{
+		FatalError("--lod-error can't be negative!");
+	}
+}
+
+static void BuildScene(FramePacket_t* packet)
+{
+	// the background colour
+	packet->clearColour[0] = 0.5f;
+	packet->clearColour[1] = 0.5f;
+	packet->clearColour[2] = 0.5f;
+	packet->clearColour[3] = 1.0f;
+
+	// things that are still loading are skipped until they're done
+	uint32_t shader = GetLoadedShaders(&s_shaderLoad);
+	uint32_t gridShader = GetLoadedShaders(&s_gridShaderLoad);
+
+	// the grid of small quads goes behind everything else. it's either one instanced draw, or a
+	// draw for each quad, which is what it would take without instancing. those can't have their
+	// own colours, because there's only a transform in the uniforms.
+	//
+	// everything except the instanced draw gets batched unless --no-batching was given, so draws
+	// with the same state that are next to each other become one draw call.
+	//
+	// with --gpu-cull, the grid zooms in and out instead, and only the quads that are on screen
+	// get drawn. the cpu doesn't look at any of them, it just gives the gpu the zoom.
+	if (s_instanceCount && s_gpuCull && gridShader)
+	{
+		DrawCommand_t grid = {0};
+		grid.shader = gridShader;
+		float zoom = 2.0f + sinf(s_sceneFrame * 0.01f);
+		grid.transform[2] = zoom;
+		grid.transform[3] = zoom;
+		AddDrawGpuCulled(packet, &grid, &s_cullScene);
+	}
+	else if (s_instanceCount && !s_noInstancing && gridShader)
+	{
+		DrawCommand_t grid = {0};
+		grid.shader = gridShader;
+		SetDrawMesh(&grid, &s_quad);
+		grid.transform[2] = 1.0f;
+		grid.transform[3] = 1.0f;
+		AddDrawInstanced(packet, &grid, &s_instances, s_instanceCount);
+	}
+	else if (s_instanceCount && s_noInstancing && shader)
+	{
+		DrawCommand_t grid = {0};
+		grid.shader = shader;
+		grid.batched = !s_noBatching;
+		SetDrawMesh(&grid, &s_quad);
+		for (uint32_t i = 0; i < s_instanceCount; i++)
+		{
+			memcpy(grid.transform, s_instanceData[i].transform, sizeof(grid.transform));
+			AddDraw(packet, &grid);
+		}
+	}
+
+	// the quad, it isn't moved or scaled
+	if (shader)
+	{
+		DrawCommand_t quad = {0};
+		quad.shader = shader;
+		quad.batched = !s_noBatching;
+		SetDrawMesh(&quad, &s_quad);
+		quad.transform[2] = 1.0f;
+		quad.transform[3] = 1.0f;
+		AddDraw(packet, &quad);
+	}
+
+	// the sphere slides back and forth, partly off the sides of the screen, and grows and shrinks.
+	// it's scaled to be round even though the window isn't square. when it's small, a simpler lod
+	// gets drawn. when it's big enough to need the full mesh, half of it faces away, and gets
+	// culled along with whatever is off screen.
+	if (shader && GetLoadState(&s_sphereLoad) == LoadStateDone)
+	{
+		DrawCommand_t sphere = {0};
+		sphere.shader = shader;
+		sphere.batched = !s_noBatching;
+		SetDrawMesh(&sphere, &s_sphere);
+		sphere.cullBackFaces = true;
+		float scale = 0.35f + 0.25f * sinf(s_sceneFrame * 0.013f);
+		sphere.transform[0] = 1.2f * sinf(s_sceneFrame * 0.02f);
+		sphere.transform[2] = scale * packet->height / packet->width;
+		sphere.transform[3] = scale;
+		uint32_t lod = SelectLod(
+			&s_sphereLods, sphere.transform, packet->width, packet->height, s_lodError);
+		if (lod == 0)
+		{
+			uint32_t rangeCount = CullMeshlets(
+				s_sphereMeshlets, s_sphereMeshletCount, sphere.transform, true, s_sphereRanges);
+			AddDrawRanges(packet, &sphere, s_sphereRanges, rangeCount);
+		}
+		else
+		{
+			sphere.firstIndex += s_sphereLods.levels[lod].firstIndex;
+			sphere.indexCount = s_sphereLods.levels[lod].indexCount;
+			AddDraw(packet, &sphere);
+		}
+	}
+
+	// the mesh from --mesh sits on the right side of the screen, and the one from --obj on the left
+	const MeshFile_t* mesh = GetLoadedMeshFile(&s_meshLoad);
+	if (shader && mesh)
+	{
+		AddModelDraw(
+			packet, shader, &mesh->mesh, mesh->submeshes, mesh->submeshCount, mesh->center,
+			mesh->radius, 0.5f);
+	}
+	if (shader && GetLoadState(&s_objLoad) == LoadStateDone)
+	{
+		AddModelDraw(
+			packet, shader, &s_obj, &s_objSubmesh, 1, s_objSubmesh.center, s_objSubmesh.radius,
+			-0.5f);
+	}
+
+	s_sceneFrame++;
+}
+
+static void AddModelDraw(
+	FramePacket_t* packet, uint32_t shader, const Mesh_t* mesh, const Submesh_t* submeshes,
+	uint32_t submeshCount, const float center[3], float radius, float x)
+{
+	// each submesh is a draw, and they get batched together. there's no depth testing, so back
+	// faces get culled, otherwise they'd draw over the front.
+	DrawCommand_t draw = {0};
+	draw.shader = shader;
+	draw.batched = !s_noBatching;
+	SetDrawMesh(&draw, mesh);
+	draw.cullBackFaces = true;
+	float scale = radius > 0.0f ? 0.4f / radius : 1.0f;
+	draw.transform[2] = scale * packet->height / packet->width;
+	draw.transform[3] = scale;
+	draw.transform[0] = x - center[0] * draw.transform[2];
+	draw.transform[1] = -center[1] * draw.transform[3];
+	uint32_t firstIndex = draw.firstIndex;
+	for (uint32_t i = 0; i < submeshCount; i++)
+	{
+		draw.firstIndex = firstIndex + submeshes[i].firstIndex;
+		draw.indexCount = submeshes[i].indexCount;
+		AddDraw(packet, &draw);
+	}
+}
+
+static Instance_t* GenerateInstances(uint32_t count)
+{
+	Instance_t* instances = malloc(count * sizeof(Instance_t));
+	if (!instances)
+	{
+		FatalError("failed to allocate %u instances!", count);
+	}
+
+	// the grid is square (in clip space), with a gap between the quads, and the colours fade
+	// across it
+	uint32_t side = (uint32_t)ceil(sqrt((double)count));
+	float cell = 2.0f / side;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t x = i % side;
+		uint32_t y = i / side;
+		instances[i].transform[0] = -1.0f + cell * (x + 0.5f);
+		instances[i].transform[1] = -1.0f + cell * (y + 0.5f);
+		instances[i].transform[2] = cell * 0.8f;
+		instances[i].transform[3] = cell * 0.8f;
+		instances[i].colour[0] = (float)x / side;
+		instances[i].colour[1] = (float)y / side;
+		instances[i].colour[2] = 1.0f - (float)x / side;
+		instances[i].colour[3] = 1.0f;
+	}
+
+	return instances;
+}
+
+static void DrawSoftwareScene(void)
+{
+	// this is the same as BuildScene, just with the software renderer
+	ClearSoftware(0.5f, 0.5f, 0.5f, 1.0f);
+	DrawSoftwareMesh(s_softwareMesh);
+}
+
+static void GenerateSphere(MeshData_t* mesh, uint32_t segments)
+{
+	// a uv sphere, like a globe: rings of vertices from the top to the bottom. the first and last
+	// vertex of each ring are in the same place, and so are all the vertices of the top and bottom
+	// rings, but it's simpler than stitching them together.
+	uint32_t rings = segments / 2;
+	mesh->vertexCount = (rings + 1) * (segments + 1);
+	mesh->indexCount = rings * segments * 2;
+	mesh->vertices = calloc(mesh->vertexCount, sizeof(Vertex_t));
+	mesh->indices = calloc(mesh->indexCount, sizeof(Index_t));
+	if (!mesh->vertices || !mesh->indices)
+	{
+		FatalError("failed to allocate a sphere with %u segments!", segments);
+	}
+
+	const float pi = 3.14159265358979f;
+	for (uint32_t ring = 0; ring <= rings; ring++)
+	{
+		float latitude = pi * ring / rings;
+		for (uint32_t segment = 0; segment <= segments; segment++)
+		{
+			float longitude = 2.0f * pi * segment / segments;
+			Vertex_t* vertex = &mesh->vertices[ring * (segments + 1) + segment];
+			vertex->position[0] = sinf(latitude) * cosf(longitude);
+			vertex->position[1] = cosf(latitude);
+			vertex->position[2] = sinf(latitude) * sinf(longitude);
+
+			// the colour is the normal (which is the same as the position on a sphere of radius 1)
+			// moved from -1 to 1 into 0 to 1
+			for (uint32_t i = 0; i < 3; i++)
+			{
+				vertex->colour[i] = vertex->position[i] * 0.5f + 0.5f;
+				vertex->normal[i] = vertex->position[i];
+			}
+			vertex->colour[3] = 1.0f;
+		}
+	}
+
+	// two triangles for each quad between rings, counter-clockwise from the outside
+	uint32_t triangle = 0;
+	for (uint32_t ring = 0; ring < rings; ring++)
+	{
+		for (uint32_t segment = 0; segment < segments; segment++)
+		{
+			uint32_t topLeft = ring * (segments + 1) + segment;
+			uint32_t bottomLeft = topLeft + segments + 1;
+			mesh->indices[triangle][0] = topLeft;
+			mesh->indices[triangle][1] = topLeft + 1;
+			mesh->indices[triangle][2] = bottomLeft;
+			triangle++;
+			mesh->indices[triangle][0] = topLeft + 1;
+			mesh->indices[triangle][1] = bottomLeft + 1;
+			mesh->indices[triangle][2] = bottomLeft;
+			triangle++;
+		}
+	}
+}
+
+static void* LoadSphere(void* data)
+{
+	(void)data;
+
+	// a big sphere takes seconds to build, so if the program is closed in the meantime, this stops
+	// after whatever step it's on. FinishSphere throws away what got built.
+	GenerateSphere(&s_sphereData, s_sphereSegments);
+	if (atomic_load(&s_sphereLoad.cancelled))
+	{
+		return NULL;
+	}
+	OptimizeMeshes(&s_sphereData, 1);
+	if (atomic_load(&s_sphereLoad.cancelled))
+	{
+		return NULL;
+	}
+
+	// the sphere gets split into meshlets, so the parts facing away or off screen can be culled
+	// every frame
+	s_sphereMeshletCount = BuildMeshlets(&s_sphereData, &s_sphereMeshlets);
+	s_sphereRanges = calloc(s_sphereMeshletCount, sizeof(IndexRange_t));
+	if (!s_sphereRanges)
+	{
+		FatalError("failed to allocate sphere draw ranges!");
+	}
+	uint32_t triangleCount = s_sphereData.indexCount;
+	// the lods go after the full mesh in the same index buffer, so the meshlets (which only cover
+	// the full mesh) have to be built first
+	BuildLodChain(&s_sphereData, &s_sphereLods, &s_sphereLoad.cancelled);
+	if (atomic_load(&s_sphereLoad.cancelled))
+	{
+		return NULL;
+	}
+	printf(
+		"Built %u meshlets from a sphere with %u triangles\n", s_sphereMeshletCount, triangleCount);
+
+	// the full mesh (without the lods) can be written out, for drawing it with --mesh without
+	// building it
+	if (s_sphereOutput)
+	{
+		WriteMeshFile(
+			s_sphereOutput, s_vertexFormat, s_sphereData.vertices, s_sphereData.vertexCount,
+			s_sphereData.indices, triangleCount, NULL, 0);
+	}
+
+	return NULL;
+}
+
+static void FinishSphere(void* data, void* result, bool cancelled)
 {
-	// glClearColor and glClearDepth set the clear value for those buffers, glClear clears the
-	// specified buffers
-	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
-	glClearDepth(1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	// use the shader program
-	glUseProgram(s_shader);
-	// bind the vertex array
-	glBindVertexArray(s_vertexArray);
-	// draw the mesh
-	// parameters:
-	// type of face to draw
-	// number of indices (should be faces * verts per face)
-	// the data type of the indices
-	// the offset into the index buffer
-	glDrawElements(GL_TRIANGLES, 2 * 3, GL_UNSIGNED_INT, (void*)(0));
+	(void)data;
+	(void)result;
+
+	if (cancelled)
+	{
+		free(s_sphereMeshlets);
+		free(s_sphereRanges);
+		s_sphereMeshlets = NULL;
+		s_sphereRanges = NULL;
+	}
+	else
+	{
+		s_sphere = CreateMesh(
+			s_vertexFormat, s_sphereData.vertices, s_sphereData.vertexCount, s_sphereData.indices,
+			s_sphereData.indexCount);
+	}
+	FreeMeshData(&s_sphereData);
+}
+
+static void* LoadObj(void* data)
+{
+	(void)data;
+
+	ImportObj(s_objName, &s_objData);
+	OptimizeMeshes(&s_objData, 1);
+
+	// the bounding sphere is around the middle of the bounding box, which is close enough to the
+	// smallest one for fitting it on the screen
+	float boundsMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+	float boundsMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	for (uint32_t i = 0; i < s_objData.vertexCount; i++)
+	{
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			boundsMin[j] = fminf(boundsMin[j], s_objData.vertices[i].position[j]);
+			boundsMax[j] = fmaxf(boundsMax[j], s_objData.vertices[i].position[j]);
+		}
+	}
+	float radiusSquared = 0.0f;
+	for (uint32_t j = 0; j < 3; j++)
+	{
+		s_objSubmesh.center[j] =
+			s_objData.vertexCount ? (boundsMin[j] + boundsMax[j]) * 0.5f : 0.0f;
+	}
+	for (uint32_t i = 0; i < s_objData.vertexCount; i++)
+	{
+		const float* position = s_objData.vertices[i].position;
+		float dx = position[0] - s_objSubmesh.center[0];
+		float dy = position[1] - s_objSubmesh.center[1];
+		float dz = position[2] - s_objSubmesh.center[2];
+		radiusSquared = fmaxf(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	s_objSubmesh.radius = sqrtf(radiusSquared);
+	s_objSubmesh.firstIndex = 0;
+	s_objSubmesh.indexCount = s_objData.indexCount * 3;
+
+	return NULL;
+}
+
+static void FinishObj(void* data, void* result, bool cancelled)
+{
+	(void)data;
+	(void)result;
+
+	if (!cancelled)
+	{
+		s_obj = CreateMesh(
+			s_vertexFormat, s_objData.vertices, s_objData.vertexCount, s_objData.indices,
+			s_objData.indexCount);
+	}
+	FreeMeshData(&s_objData);
 }
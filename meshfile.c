@@ -0,0 +1,421 @@
+// this file implements mesh files, which have a mesh's vertices and indices in exactly the layout
+// they have on the gpu. building a mesh normally means generating or parsing Vertex_ts, converting
+// them to the vertex format, and narrowing the indices, which all takes time and memory every time
+// the program starts. a mesh file has all that done ahead of time, so loading one is mapping it,
+// checking the header, and handing the driver pointers into the mapping.
+//
+// a mesh file is a header, then the submeshes, then the vertices, then the indices. the header says
+// everything about the layout, so nothing has to be worked out from the data itself: the vertex
+// format (its id and all of its attributes, so a file from before a format changed gets caught),
+// the index type, the counts, where the vertices and indices start, how the positions are quantized
+// (see GetVertexQuantization), and the bounds. submeshes are
+// ranges of the indices with their own bounding spheres, for things like parts with different
+// materials.
+//
+// the vertices and indices start on 16 byte boundaries, and the mapping is page aligned (and so is
+// a file in a .pak file), so they're aligned enough for anything. they have to come from a loose
+// file or an uncompressed entry in a .pak file to be used straight from the mapping, a compressed
+// entry gets decompressed into memory first.
+//
+// everything is little endian, like .pak files.
+
+#include "stuff.h"
+
+// the first 4 bytes of a mesh file
+#define MESH_FILE_MAGIC "GMSH"
+
+// changes whenever the format does
+#define MESH_FILE_VERSION 2
+
+// what the vertices and indices are aligned to in the file
+#define MESH_FILE_ALIGNMENT 16
+
+// an attribute of the vertex format, a VertexAttribute_t with fixed size fields
+typedef struct MeshFileAttribute
+{
+	uint32_t semantic;
+	uint32_t type;
+	uint32_t components;
+	uint32_t offset;
+} MeshFileAttribute_t;
+
+// the start of the file
+typedef struct MeshFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t vertexOffset; // from the start of the file
+	uint64_t indexOffset;
+	uint32_t formatId; // a VertexFormatId_t
+	uint32_t stride;
+	uint32_t attributeCount;
+	MeshFileAttribute_t attributes[VERTEX_MAX_ATTRIBUTES];
+	uint32_t indexType;   // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	uint32_t vertexCount;
+	uint32_t indexCount; // in triangles, like everywhere else
+	uint32_t submeshCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	float center[3]; // the bounding sphere
+	float radius;
+	float quantization[4]; // how the positions are stored, see GetVertexQuantization
+	uint32_t padding;
+} MeshFileHeader_t;
+
+// work out the bounding box and sphere of some of a mesh's triangles
+static void ComputeBounds(
+	const Vertex_t* vertices, const uint32_t* indices, uint32_t count, float boundsMin[3],
+	float boundsMax[3], float center[3], float* radius);
+
+// check that a mapped mesh file makes sense, and return its header
+static const MeshFileHeader_t* CheckMeshFile(const char* name, const MappedFile_t* file);
+
+// upload a mesh file that's been checked, straight from the mapping
+static void UploadMeshFile(const char* name, const MappedFile_t* file, MeshFile_t* mesh);
+
+void WriteMeshFile(
+	const char* name, const VertexFormat_t* format, const Vertex_t* vertices, uint32_t vertexCount,
+	const Index_t* indices, uint32_t indexCount, const IndexRange_t* submeshes,
+	uint32_t submeshCount)
+{
+	// the format's id is what gets stored, so it has to be one of the formats in the table
+	uint32_t formatId = 0;
+	while (formatId < VertexFormatCount && GetVertexFormat(formatId) != format)
+	{
+		formatId++;
+	}
+	if (formatId == VertexFormatCount)
+	{
+		FatalError("%s can't be written, its vertex format isn't a known one!", name);
+	}
+
+	// no submeshes means the whole mesh is one
+	IndexRange_t wholeMesh = {0, indexCount * 3};
+	if (!submeshCount)
+	{
+		submeshes = &wholeMesh;
+		submeshCount = 1;
+	}
+
+	// the indices are 16 bits if they fit, the same as CreateIndexBuffer does
+	const uint32_t* values = (const uint32_t*)indices;
+	uint32_t count = indexCount * 3;
+	uint32_t maxIndex = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (values[i] >= vertexCount)
+		{
+			FatalError("%s can't be written, index %u is past the end of the vertices!", name, i);
+		}
+		maxIndex = values[i] > maxIndex ? values[i] : maxIndex;
+	}
+	uint32_t indexSize = maxIndex > UINT16_MAX ? sizeof(uint32_t) : sizeof(uint16_t);
+
+	MeshFileHeader_t header = {0};
+	memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+	header.version = MESH_FILE_VERSION;
+	header.formatId = formatId;
+	header.stride = format->stride;
+	header.attributeCount = format->attributeCount;
+	for (uint32_t i = 0; i < format->attributeCount; i++)
+	{
+		header.attributes[i].semantic = format->attributes[i].semantic;
+		header.attributes[i].type = format->attributes[i].type;
+		header.attributes[i].components = format->attributes[i].components;
+		header.attributes[i].offset = format->attributes[i].offset;
+	}
+	header.indexType = indexSize == sizeof(uint32_t) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	header.vertexCount = vertexCount;
+	header.indexCount = indexCount;
+	header.submeshCount = submeshCount;
+	ComputeBounds(
+		vertices, values, count, header.boundsMin, header.boundsMax, header.center,
+		&header.radius);
+	GetVertexQuantization(format, vertices, vertexCount, header.quantization);
+
+	size_t submeshEnd = sizeof(MeshFileHeader_t) + submeshCount * sizeof(Submesh_t);
+	header.vertexOffset =
+		(submeshEnd + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+	uint64_t vertexEnd = header.vertexOffset + (uint64_t)vertexCount * format->stride;
+	header.indexOffset =
+		(vertexEnd + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+
+	// everything gets converted to what it'll be on the gpu
+	Submesh_t* fileSubmeshes = calloc(submeshCount, sizeof(Submesh_t));
+	void* packedVertices = malloc((size_t)vertexCount * format->stride + 1);
+	void* packedIndices = malloc((size_t)count * indexSize + 1);
+	if (!fileSubmeshes || !packedVertices || !packedIndices)
+	{
+		FatalError("failed to allocate memory to write %s!", name);
+	}
+	for (uint32_t i = 0; i < submeshCount; i++)
+	{
+		if (submeshes[i].firstIndex > count || submeshes[i].indexCount > count ||
+			submeshes[i].firstIndex + submeshes[i].indexCount > count)
+		{
+			FatalError("%s can't be written, submesh %u is past the end of the indices!", name, i);
+		}
+		fileSubmeshes[i].firstIndex = submeshes[i].firstIndex;
+		fileSubmeshes[i].indexCount = submeshes[i].indexCount;
+		float boundsMin[3];
+		float boundsMax[3];
+		ComputeBounds(
+			vertices, values + submeshes[i].firstIndex, submeshes[i].indexCount, boundsMin,
+			boundsMax, fileSubmeshes[i].center, &fileSubmeshes[i].radius);
+	}
+	ConvertVertices(format, vertices, vertexCount, header.quantization, packedVertices);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (indexSize == sizeof(uint16_t))
+		{
+			((uint16_t*)packedIndices)[i] = (uint16_t)values[i];
+		}
+		else
+		{
+			((uint32_t*)packedIndices)[i] = values[i];
+		}
+	}
+
+	FILE* output = fopen(name, "wb");
+	if (!output)
+	{
+		FatalError("failed to open %s for writing!", name);
+	}
+
+	static const uint8_t padding[MESH_FILE_ALIGNMENT] = {0};
+	fwrite(&header, sizeof(MeshFileHeader_t), 1, output);
+	fwrite(fileSubmeshes, sizeof(Submesh_t), submeshCount, output);
+	fwrite(padding, 1, (size_t)(header.vertexOffset - submeshEnd), output);
+	fwrite(packedVertices, format->stride, vertexCount, output);
+	fwrite(padding, 1, (size_t)(header.indexOffset - vertexEnd), output);
+	fwrite(packedIndices, indexSize, count, output);
+	if (ferror(output))
+	{
+		FatalError("failed to write %s!", name);
+	}
+	fclose(output);
+
+	printf(
+		"Wrote mesh %s (%u vertices in format %s, %u triangles with %u bit indices, %u submeshes, "
+		"%.2f KiB)\n",
+		name, vertexCount, format->name, indexCount, indexSize * 8, submeshCount,
+		(header.indexOffset + (uint64_t)count * indexSize) / 1024.0);
+
+	free(packedIndices);
+	free(packedVertices);
+	free(fileSubmeshes);
+}
+
+void LoadMeshFile(const char* name, MeshFile_t* mesh)
+{
+	uint64_t start = GetTime();
+	MappedFile_t file = MapFile(name);
+	CheckMeshFile(name, &file);
+	UploadMeshFile(name, &file, mesh);
+
+	// the driver has its own copy now
+	UnmapFile(&file);
+
+	printf("Loaded mesh %s in %.3f ms\n", name, (GetTime() - start) / 1e6);
+}
+
+void DestroyMeshFile(MeshFile_t* mesh)
+{
+	DestroyMesh(&mesh->mesh);
+	free(mesh->submeshes);
+	memset(mesh, 0, sizeof(MeshFile_t));
+}
+
+// the loader thread half of QueueLoadMeshFile, which maps the file and checks it
+static void* LoadMeshFileData(void* data)
+{
+	MeshFileLoad_t* load = data;
+	load->file = MapFile(load->name);
+	CheckMeshFile(load->name, &load->file);
+	return NULL;
+}
+
+// the context thread half, which uploads it
+static void FinishMeshFile(void* data, void* result, bool cancelled)
+{
+	(void)result;
+
+	MeshFileLoad_t* load = data;
+	if (!cancelled)
+	{
+		UploadMeshFile(load->name, &load->file, &load->mesh);
+	}
+	if (load->file.data)
+	{
+		UnmapFile(&load->file);
+	}
+}
+
+void QueueLoadMeshFile(MeshFileLoad_t* load, const char* name, int32_t priority)
+{
+	memset(load, 0, sizeof(MeshFileLoad_t));
+	load->name = name;
+	load->request.name = name;
+	load->request.load = LoadMeshFileData;
+	load->request.finish = FinishMeshFile;
+	load->request.data = load;
+	load->request.priority = priority;
+	QueueLoad(&load->request);
+}
+
+const MeshFile_t* GetLoadedMeshFile(const MeshFileLoad_t* load)
+{
+	return GetLoadState(&load->request) == LoadStateDone ? &load->mesh : NULL;
+}
+
+static void ComputeBounds(
+	const Vertex_t* vertices, const uint32_t* indices, uint32_t count, float boundsMin[3],
+	float boundsMax[3], float center[3], float* radius)
+{
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		boundsMin[i] = count ? FLT_MAX : 0.0f;
+		boundsMax[i] = count ? -FLT_MAX : 0.0f;
+	}
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const float* position = vertices[indices[i]].position;
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			boundsMin[j] = fminf(boundsMin[j], position[j]);
+			boundsMax[j] = fmaxf(boundsMax[j], position[j]);
+		}
+	}
+
+	// the sphere is around the middle of the box, which isn't the smallest one, but it's close
+	// enough for culling
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		center[i] = (boundsMin[i] + boundsMax[i]) * 0.5f;
+	}
+	float radiusSquared = 0.0f;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const float* position = vertices[indices[i]].position;
+		float dx = position[0] - center[0];
+		float dy = position[1] - center[1];
+		float dz = position[2] - center[2];
+		radiusSquared = fmaxf(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	*radius = sqrtf(radiusSquared);
+}
+
+static const MeshFileHeader_t* CheckMeshFile(const char* name, const MappedFile_t* file)
+{
+	// everything gets checked before anything is uploaded, so a broken file can't make the driver
+	// read past the end of the mapping
+	const MeshFileHeader_t* header = file->data;
+	if (file->size < sizeof(MeshFileHeader_t) ||
+		memcmp(header->magic, MESH_FILE_MAGIC, sizeof(header->magic)) != 0)
+	{
+		FatalError("%s isn't a mesh file!", name);
+	}
+	if (header->version != MESH_FILE_VERSION)
+	{
+		FatalError(
+			"%s is version %u, but version %u is needed! it has to be written again.", name,
+			header->version, MESH_FILE_VERSION);
+	}
+
+	// the format has to be the same as the one with its id now, or the vertices would be read wrong
+	if (header->formatId >= VertexFormatCount)
+	{
+		FatalError("%s has an unknown vertex format %u!", name, header->formatId);
+	}
+	const VertexFormat_t* format = GetVertexFormat(header->formatId);
+	bool sameFormat =
+		header->stride == format->stride && header->attributeCount == format->attributeCount;
+	for (uint32_t i = 0; sameFormat && i < format->attributeCount; i++)
+	{
+		sameFormat = header->attributes[i].semantic == (uint32_t)format->attributes[i].semantic &&
+					 header->attributes[i].type == (uint32_t)format->attributes[i].type &&
+					 header->attributes[i].components == format->attributes[i].components &&
+					 header->attributes[i].offset == format->attributes[i].offset;
+	}
+	if (!sameFormat)
+	{
+		FatalError(
+			"%s was written with a different version of vertex format %s! it has to be written "
+			"again.",
+			name, format->name);
+	}
+	if (!(header->quantization[3] > 0.0f) || !isfinite(header->quantization[0]) ||
+		!isfinite(header->quantization[1]) || !isfinite(header->quantization[2]) ||
+		!isfinite(header->quantization[3]))
+	{
+		FatalError("%s has a broken quantization!", name);
+	}
+
+	uint64_t indexSize = header->indexType == GL_UNSIGNED_INT     ? sizeof(uint32_t)
+						 : header->indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t)
+																  : 0;
+	uint64_t count = (uint64_t)header->indexCount * 3;
+	uint64_t submeshEnd =
+		sizeof(MeshFileHeader_t) + (uint64_t)header->submeshCount * sizeof(Submesh_t);
+	uint64_t vertexSize = (uint64_t)header->vertexCount * header->stride;
+	if (!indexSize || header->vertexOffset % MESH_FILE_ALIGNMENT ||
+		header->indexOffset % MESH_FILE_ALIGNMENT || header->vertexOffset < submeshEnd ||
+		header->vertexOffset > file->size || vertexSize > file->size - header->vertexOffset ||
+		header->indexOffset < header->vertexOffset + vertexSize ||
+		header->indexOffset > file->size || count * indexSize > file->size - header->indexOffset)
+	{
+		FatalError("%s has a broken layout!", name);
+	}
+
+	const Submesh_t* submeshes = (const Submesh_t*)(header + 1);
+	for (uint32_t i = 0; i < header->submeshCount; i++)
+	{
+		if (submeshes[i].firstIndex > count ||
+			submeshes[i].indexCount > count - submeshes[i].firstIndex)
+		{
+			FatalError("%s has a broken submesh %u!", name, i);
+		}
+	}
+
+	return header;
+}
+
+static void UploadMeshFile(const char* name, const MappedFile_t* file, MeshFile_t* mesh)
+{
+	// the vertices and indices go to the pools straight from the mapping, so the only copy is the
+	// one the driver makes. the indices aren't checked against the vertex count, because that would
+	// mean reading all of them, so mesh files have to come from WriteMeshFile (which does check).
+	const MeshFileHeader_t* header = file->data;
+	const uint8_t* data = file->data;
+	const VertexFormat_t* format = GetVertexFormat(header->formatId);
+	uint32_t indexSize = header->indexType == GL_UNSIGNED_INT ? sizeof(uint32_t) : sizeof(uint16_t);
+
+	memset(mesh, 0, sizeof(MeshFile_t));
+	mesh->mesh.format = format;
+	mesh->mesh.vertices = AllocateBuffer(
+		GL_ARRAY_BUFFER, format->stride, data + header->vertexOffset, header->vertexCount);
+	mesh->mesh.indices = AllocateBuffer(
+		GL_ELEMENT_ARRAY_BUFFER, indexSize, data + header->indexOffset, header->indexCount * 3);
+	mesh->mesh.indexType = header->indexType;
+	memcpy(mesh->mesh.quantization, header->quantization, sizeof(mesh->mesh.quantization));
+	mesh->mesh.vertexArray =
+		GetSharedVertexArray(format, mesh->mesh.vertices.buffer, mesh->mesh.indices.buffer);
+
+	// the submeshes are tiny, so they get copied so the file can be unmapped
+	mesh->submeshCount = header->submeshCount;
+	mesh->submeshes = malloc((header->submeshCount ? header->submeshCount : 1) * sizeof(Submesh_t));
+	if (!mesh->submeshes)
+	{
+		FatalError("failed to allocate %u submeshes!", header->submeshCount);
+	}
+	memcpy(mesh->submeshes, header + 1, header->submeshCount * sizeof(Submesh_t));
+	memcpy(mesh->boundsMin, header->boundsMin, sizeof(mesh->boundsMin));
+	memcpy(mesh->boundsMax, header->boundsMax, sizeof(mesh->boundsMax));
+	memcpy(mesh->center, header->center, sizeof(mesh->center));
+	mesh->radius = header->radius;
+
+	printf(
+		"Uploaded mesh %s (%u vertices in format %s, %u triangles, %u submeshes) from its "
+		"mapping\n",
+		name, header->vertexCount, format->name, header->indexCount, header->submeshCount);
+}
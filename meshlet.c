@@ -0,0 +1,285 @@
+// this file implements meshlets, which are small clusters of a mesh's triangles. culling whole
+// objects is cheap but coarse: if any part of an object might be visible, all of it gets drawn. a
+// big dense mesh is usually half facing away from the camera and partly off screen, so splitting it
+// into meshlets that can each be culled on their own skips a lot of triangles for not much work.
+//
+// each meshlet has a bounding sphere, for checking whether it's on screen, and a normal cone: an
+// axis and an angle that every triangle's normal is within. if the whole cone faces away from the
+// camera, so does every triangle in the meshlet.
+//
+// the camera in this program is orthographic, looking down -z (vertex.glsl doesn't do perspective),
+// so the direction to the camera is the same everywhere and the cone doesn't need an apex.
+
+#include "stuff.h"
+
+// the limits on meshlet size. these are the numbers nvidia recommends for mesh shaders, 124
+// triangles instead of 128 leaves room for a header in a 4 KiB block of 8 bit indices.
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// how many triangles got culled, in the current frame, the last frame, and in total
+static MeshletCullStats_t s_frameStats;
+static MeshletCullStats_t s_lastFrameStats;
+static MeshletCullStats_t s_totalStats;
+static uint64_t s_frameCount;
+static double s_minRejected; // the lowest and highest fraction of triangles culled in a frame
+static double s_maxRejected;
+
+// work out a meshlet's bounding sphere and normal cone
+static void ComputeMeshletBounds(
+	const MeshData_t* mesh, Meshlet_t* meshlet, const uint32_t* vertices, uint32_t vertexCount);
+
+uint32_t BuildMeshlets(const MeshData_t* mesh, Meshlet_t** meshlets)
+{
+	// there can't be more meshlets than triangles
+	*meshlets = malloc((mesh->indexCount ? mesh->indexCount : 1) * sizeof(Meshlet_t));
+	uint32_t* stamps = calloc(mesh->vertexCount ? mesh->vertexCount : 1, sizeof(uint32_t));
+	if (!*meshlets || !stamps)
+	{
+		FatalError("failed to allocate meshlet memory!");
+	}
+
+	// the triangles are taken in order, and a meshlet ends when the next triangle wouldn't fit.
+	// after OptimizeMesh, triangles next to each other in the index buffer are next to each other
+	// in the mesh too, so this makes compact meshlets, and their triangles are already contiguous
+	// so they can be drawn as a range of the index buffer. stamps say which meshlet last used each
+	// vertex (plus one, so 0 means none).
+	const uint32_t* indices = (const uint32_t*)mesh->indices;
+	uint32_t vertices[MESHLET_MAX_VERTICES];
+	uint32_t vertexCount = 0;
+	uint32_t meshletCount = 0;
+	Meshlet_t* meshlet = NULL;
+	for (uint32_t i = 0; i < mesh->indexCount; i++)
+	{
+		uint32_t newVertices = 0;
+		if (meshlet)
+		{
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				newVertices += stamps[indices[i * 3 + j]] != meshletCount;
+			}
+		}
+
+		if (!meshlet || meshlet->triangleCount >= MESHLET_MAX_TRIANGLES ||
+			vertexCount + newVertices > MESHLET_MAX_VERTICES)
+		{
+			if (meshlet)
+			{
+				ComputeMeshletBounds(mesh, meshlet, vertices, vertexCount);
+			}
+			meshlet = &(*meshlets)[meshletCount++];
+			memset(meshlet, 0, sizeof(Meshlet_t));
+			meshlet->firstIndex = i * 3;
+			vertexCount = 0;
+		}
+
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			uint32_t vertex = indices[i * 3 + j];
+			if (stamps[vertex] != meshletCount)
+			{
+				stamps[vertex] = meshletCount;
+				vertices[vertexCount++] = vertex;
+			}
+		}
+		meshlet->triangleCount++;
+	}
+	if (meshlet)
+	{
+		ComputeMeshletBounds(mesh, meshlet, vertices, vertexCount);
+	}
+
+	free(stamps);
+	return meshletCount;
+}
+
+uint32_t CullMeshlets(
+	const Meshlet_t* meshlets, uint32_t meshletCount, const float transform[4], bool cullBackFaces,
+	IndexRange_t* ranges)
+{
+	CPU_ZONE_BEGIN("CullMeshlets");
+
+	// scaling by a negative number mirrors the mesh, which flips which way its triangles face.
+	// spheres get scaled by the biggest scale, so they still cover everything.
+	float facing = transform[2] * transform[3] < 0.0f ? -1.0f : 1.0f;
+	float scale = fmaxf(fabsf(transform[2]), fabsf(transform[3]));
+
+	uint32_t rangeCount = 0;
+	for (uint32_t i = 0; i < meshletCount; i++)
+	{
+		const Meshlet_t* meshlet = &meshlets[i];
+		s_frameStats.meshletCount++;
+		s_frameStats.triangleCount += meshlet->triangleCount;
+
+		// off screen means the sphere is entirely outside one of the sides of clip space
+		float x = meshlet->center[0] * transform[2] + transform[0];
+		float y = meshlet->center[1] * transform[3] + transform[1];
+		float z = meshlet->center[2];
+		float radius = meshlet->radius * scale;
+		if (x + radius < -1.0f || x - radius > 1.0f || y + radius < -1.0f || y - radius > 1.0f ||
+			z + meshlet->radius < -1.0f || z - meshlet->radius > 1.0f)
+		{
+			s_frameStats.offScreenTriangles += meshlet->triangleCount;
+			continue;
+		}
+
+		// the camera is towards +z, so a triangle faces away if its normal points towards -z. the
+		// whole cone does if the angle between the axis and -z plus the cone's angle is less than
+		// 90 degrees, which is what the cutoff works out.
+		if (cullBackFaces && -facing * meshlet->coneAxis[2] >= meshlet->coneCutoff)
+		{
+			s_frameStats.backFacingTriangles += meshlet->triangleCount;
+			continue;
+		}
+
+		// meshlets next to each other in the index buffer get merged into one range
+		if (rangeCount &&
+			ranges[rangeCount - 1].firstIndex + ranges[rangeCount - 1].indexCount ==
+				meshlet->firstIndex)
+		{
+			ranges[rangeCount - 1].indexCount += meshlet->triangleCount * 3;
+		}
+		else
+		{
+			ranges[rangeCount].firstIndex = meshlet->firstIndex;
+			ranges[rangeCount].indexCount = meshlet->triangleCount * 3;
+			rangeCount++;
+		}
+	}
+	s_frameStats.rangeCount += rangeCount;
+
+	CPU_ZONE_END();
+	return rangeCount;
+}
+
+void EndMeshletCullFrame(void)
+{
+	if (s_frameStats.triangleCount)
+	{
+		double rejected =
+			(double)(s_frameStats.backFacingTriangles + s_frameStats.offScreenTriangles) /
+			s_frameStats.triangleCount;
+		s_minRejected = s_frameCount ? fmin(s_minRejected, rejected) : rejected;
+		s_maxRejected = s_frameCount ? fmax(s_maxRejected, rejected) : rejected;
+
+		s_totalStats.meshletCount += s_frameStats.meshletCount;
+		s_totalStats.triangleCount += s_frameStats.triangleCount;
+		s_totalStats.backFacingTriangles += s_frameStats.backFacingTriangles;
+		s_totalStats.offScreenTriangles += s_frameStats.offScreenTriangles;
+		s_totalStats.rangeCount += s_frameStats.rangeCount;
+		s_frameCount++;
+	}
+
+	s_lastFrameStats = s_frameStats;
+	memset(&s_frameStats, 0, sizeof(MeshletCullStats_t));
+}
+
+MeshletCullStats_t GetMeshletCullStats(void)
+{
+	return s_lastFrameStats;
+}
+
+void PrintMeshletCullStats(void)
+{
+	if (!s_frameCount)
+	{
+		return;
+	}
+
+	double triangles = (double)s_totalStats.triangleCount;
+	printf(
+		"Meshlet culling: %.0f of %.0f triangles culled per frame (%.1f%%, %.1f%% to %.1f%%), "
+		"%.1f%% facing away, %.1f%% off screen, %.1f draw ranges per frame\n",
+		(s_totalStats.backFacingTriangles + s_totalStats.offScreenTriangles) /
+			(double)s_frameCount,
+		triangles / s_frameCount,
+		100.0 * (s_totalStats.backFacingTriangles + s_totalStats.offScreenTriangles) / triangles,
+		100.0 * s_minRejected, 100.0 * s_maxRejected,
+		100.0 * s_totalStats.backFacingTriangles / triangles,
+		100.0 * s_totalStats.offScreenTriangles / triangles,
+		(double)s_totalStats.rangeCount / s_frameCount);
+
+	memset(&s_totalStats, 0, sizeof(MeshletCullStats_t));
+	s_frameCount = 0;
+}
+
+static void ComputeMeshletBounds(
+	const MeshData_t* mesh, Meshlet_t* meshlet, const uint32_t* vertices, uint32_t vertexCount)
+{
+	// the sphere is centred on the middle of the bounding box, which isn't the smallest sphere, but
+	// it's close and it's simple
+	float minimum[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+	float maximum[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		const float* position = mesh->vertices[vertices[i]].position;
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			minimum[j] = fminf(minimum[j], position[j]);
+			maximum[j] = fmaxf(maximum[j], position[j]);
+		}
+	}
+	float radiusSquared = 0.0f;
+	for (uint32_t j = 0; j < 3; j++)
+	{
+		meshlet->center[j] = (minimum[j] + maximum[j]) * 0.5f;
+	}
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		const float* position = mesh->vertices[vertices[i]].position;
+		float dx = position[0] - meshlet->center[0];
+		float dy = position[1] - meshlet->center[1];
+		float dz = position[2] - meshlet->center[2];
+		radiusSquared = fmaxf(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	meshlet->radius = sqrtf(radiusSquared);
+
+	// the cone's axis is the average normal, and its angle is the biggest angle between it and any
+	// of the normals. normals are counter-clockwise, like opengl's front faces.
+	const uint32_t* indices = (const uint32_t*)mesh->indices + meshlet->firstIndex;
+	float normals[MESHLET_MAX_TRIANGLES][3];
+	float axis[3] = {0.0f, 0.0f, 0.0f};
+	for (uint32_t i = 0; i < meshlet->triangleCount; i++)
+	{
+		const float* a = mesh->vertices[indices[i * 3 + 0]].position;
+		const float* b = mesh->vertices[indices[i * 3 + 1]].position;
+		const float* c = mesh->vertices[indices[i * 3 + 2]].position;
+		float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+		float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+		float* normal = normals[i];
+		normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+		normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+		normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+		float length =
+			sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			normal[j] = length > 0.0f ? normal[j] / length : 0.0f;
+			axis[j] += normal[j];
+		}
+	}
+	float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	float minimumDot = 1.0f;
+	for (uint32_t j = 0; j < 3; j++)
+	{
+		meshlet->coneAxis[j] = axisLength > 0.0f ? axis[j] / axisLength : 0.0f;
+	}
+	for (uint32_t i = 0; i < meshlet->triangleCount; i++)
+	{
+		float dot = normals[i][0] * meshlet->coneAxis[0] + normals[i][1] * meshlet->coneAxis[1] +
+					normals[i][2] * meshlet->coneAxis[2];
+		minimumDot = fminf(minimumDot, dot);
+	}
+
+	// if the normals are spread over more than a hemisphere (or there's no axis), some triangle
+	// always faces the camera, and a cutoff above 1 means the test never passes. otherwise, the
+	// cutoff is the sine of the cone's angle, which is the cosine of 90 degrees minus it.
+	if (minimumDot <= 0.0f || axisLength == 0.0f)
+	{
+		meshlet->coneCutoff = 2.0f;
+	}
+	else
+	{
+		meshlet->coneCutoff = sqrtf(1.0f - minimumDot * minimumDot);
+	}
+}
@@ -0,0 +1,582 @@
+// this file implements mesh optimization. the order of a mesh's triangles and vertices doesn't
+// change what it looks like, but it does change how fast it draws:
+//
+// - the gpu keeps the last few vertices it transformed in a cache, so if triangles that share
+//   vertices are next to each other, the vertex shader runs fewer times. this is measured as the
+//   average cache miss ratio (acmr, vertex shader runs per triangle, 0.5 is perfect for big grids
+//   and 3 is the worst) and the average transformed vertex ratio (atvr, runs per vertex, 1 is
+//   perfect).
+// - pixels that get drawn over by something closer are wasted work (overdraw). drawing the parts of
+//   a mesh that are most likely to be in front first means more pixels behind them get skipped by
+//   the depth test.
+// - vertices are read from memory in whatever order the indices use them, so if they're stored in
+//   that order, the reads are sequential and the memory cache works better.
+//
+// the triangle order comes from tipsify (sander, nehab and barczak, "fast triangle reordering for
+// vertex locality and reduced overdraw", 2007). it walks the mesh by fanning around one vertex at a
+// time, and picks the next vertex to fan around from the ones that are still in the cache. it's
+// linear time, so it's fine for big meshes. the places where it jumps somewhere else in the mesh
+// split it into clusters, and the clusters get sorted so the ones facing outwards are drawn first.
+
+#include "stuff.h"
+
+// the size of the vertex cache being optimized for. gpus are different, but a fifo of 16 is close
+// enough to most of them, and optimizing for it works on all of them.
+#define MESH_CACHE_SIZE 16
+
+// clusters are split further once their acmr is this close to the whole mesh's. smaller clusters
+// mean better overdraw, but worse cache use at the edges of each one.
+#define MESH_CLUSTER_THRESHOLD 1.05
+
+// used for "no vertex"
+#define MESH_NONE UINT32_MAX
+
+// a cluster of triangles, and how far it faces out from the middle of the mesh
+typedef struct MeshCluster
+{
+	uint32_t start;
+	uint32_t count;
+	float sortKey;
+} MeshCluster_t;
+
+// the meshes and stats for OptimizeMeshes' jobs
+typedef struct MeshOptimizeBatch
+{
+	MeshData_t* meshes;
+	MeshOptimizeStats_t* stats;
+} MeshOptimizeBatch_t;
+
+// reorder the triangles for the vertex cache, and write where the clusters start. returns the
+// number of clusters.
+static uint32_t Tipsify(
+	const uint32_t* indices, uint32_t triangleCount, uint32_t vertexCount, uint32_t* output,
+	uint32_t* clusterStarts);
+
+// split clusters more where the cache has warmed up, returns the new number of clusters
+static uint32_t SplitClusters(
+	const uint32_t* indices, uint32_t triangleCount, uint32_t vertexCount, uint32_t* clusterStarts,
+	uint32_t clusterCount, double threshold);
+
+// sort clusters so the ones that face out the most go first
+static void SortClusters(
+	const Vertex_t* vertices, const uint32_t* indices, uint32_t triangleCount, uint32_t* output,
+	const uint32_t* clusterStarts, uint32_t clusterCount);
+
+// renumber the vertices in the order they're first used, returns the new vertex count
+static uint32_t RemapVertices(MeshData_t* mesh);
+
+// count the vertices that are actually used
+static uint32_t CountUsedVertices(
+	const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount);
+
+// compare clusters for qsort, descending
+static int CompareClusters(const void* a, const void* b);
+
+// optimize one mesh, for RunJobs
+static void OptimizeMeshJob(void* data, uint32_t index);
+
+void OptimizeMesh(MeshData_t* mesh, MeshOptimizeStats_t* stats)
+{
+	CPU_ZONE_BEGIN("OptimizeMesh");
+	uint64_t start = GetTime();
+
+	uint32_t* indices = (uint32_t*)mesh->indices;
+	uint32_t triangleCount = mesh->indexCount;
+
+	MeshOptimizeStats_t result = {0};
+	result.triangleCount = triangleCount;
+	result.vertexCountBefore = CountUsedVertices(indices, triangleCount * 3, mesh->vertexCount);
+	result.missesBefore = SimulateVertexCache(mesh->indices, triangleCount, mesh->vertexCount);
+
+	if (triangleCount)
+	{
+		uint32_t* reordered = malloc(triangleCount * 3 * sizeof(uint32_t));
+		uint32_t* clusterStarts = malloc((triangleCount + 1) * sizeof(uint32_t));
+		if (!reordered || !clusterStarts)
+		{
+			FatalError("failed to allocate mesh optimizer memory!");
+		}
+
+		// there's one cluster for every place tipsify had to jump, and then they get split up more
+		// once the cache has warmed up enough that it doesn't cost much to start over
+		uint32_t clusterCount =
+			Tipsify(indices, triangleCount, mesh->vertexCount, reordered, clusterStarts);
+		double acmr = (double)SimulateVertexCache(
+						  (const Index_t*)reordered, triangleCount, mesh->vertexCount) /
+					  triangleCount;
+		clusterCount = SplitClusters(
+			reordered, triangleCount, mesh->vertexCount, clusterStarts, clusterCount,
+			acmr * MESH_CLUSTER_THRESHOLD);
+
+		SortClusters(
+			mesh->vertices, reordered, triangleCount, indices, clusterStarts, clusterCount);
+		result.clusterCount = clusterCount;
+
+		free(clusterStarts);
+		free(reordered);
+	}
+
+	// the vertices go last, because they're put in the order of the final indices
+	mesh->vertexCount = RemapVertices(mesh);
+
+	result.vertexCountAfter = mesh->vertexCount;
+	result.missesAfter = SimulateVertexCache(mesh->indices, triangleCount, mesh->vertexCount);
+	result.time = GetTime() - start;
+	if (stats)
+	{
+		*stats = result;
+	}
+
+	CPU_ZONE_END();
+}
+
+void OptimizeMeshes(MeshData_t* meshes, uint32_t meshCount)
+{
+	MeshOptimizeStats_t* stats = malloc((meshCount ? meshCount : 1) * sizeof(MeshOptimizeStats_t));
+	if (!stats)
+	{
+		FatalError("failed to allocate %zu bytes!", meshCount * sizeof(MeshOptimizeStats_t));
+	}
+
+	// each mesh is independent, so they can all be done at once
+	uint64_t start = GetTime();
+	MeshOptimizeBatch_t batch = {meshes, stats};
+	RunJobs(OptimizeMeshJob, &batch, meshCount);
+	uint64_t time = GetTime() - start;
+
+	MeshOptimizeStats_t total = {0};
+	for (uint32_t i = 0; i < meshCount; i++)
+	{
+		total.triangleCount += stats[i].triangleCount;
+		total.vertexCountBefore += stats[i].vertexCountBefore;
+		total.vertexCountAfter += stats[i].vertexCountAfter;
+		total.missesBefore += stats[i].missesBefore;
+		total.missesAfter += stats[i].missesAfter;
+		total.clusterCount += stats[i].clusterCount;
+		total.time += stats[i].time;
+	}
+	free(stats);
+
+	double triangles = total.triangleCount ? (double)total.triangleCount : 1.0;
+	printf(
+		"Optimized %u meshes (%" PRIu64 " triangles, %" PRIu64 " clusters) in %.3f ms (%.3f ms "
+		"of work): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		meshCount, total.triangleCount, total.clusterCount, time / 1e6, total.time / 1e6,
+		total.missesBefore / triangles, total.missesAfter / triangles,
+		total.vertexCountBefore ? (double)total.missesBefore / total.vertexCountBefore : 0.0,
+		total.vertexCountAfter ? (double)total.missesAfter / total.vertexCountAfter : 0.0);
+}
+
+uint64_t SimulateVertexCache(const Index_t* indices, uint32_t indexCount, uint32_t vertexCount)
+{
+	// a fifo cache can be simulated with a timestamp per vertex: the time only goes up on a miss,
+	// so a vertex is still in the cache if fewer than MESH_CACHE_SIZE misses happened since its own
+	uint32_t* timestamps = calloc(vertexCount ? vertexCount : 1, sizeof(uint32_t));
+	if (!timestamps)
+	{
+		FatalError("failed to allocate %zu bytes!", vertexCount * sizeof(uint32_t));
+	}
+
+	const uint32_t* values = (const uint32_t*)indices;
+	uint32_t time = MESH_CACHE_SIZE + 1;
+	uint64_t misses = 0;
+	for (uint32_t i = 0; i < indexCount * 3; i++)
+	{
+		uint32_t vertex = values[i];
+		if (time - timestamps[vertex] > MESH_CACHE_SIZE)
+		{
+			timestamps[vertex] = time++;
+			misses++;
+		}
+	}
+
+	free(timestamps);
+	return misses;
+}
+
+void CopyMeshData(
+	MeshData_t* mesh, const Vertex_t* vertices, uint32_t vertexCount, const Index_t* indices,
+	uint32_t indexCount)
+{
+	mesh->vertices = malloc((vertexCount ? vertexCount : 1) * sizeof(Vertex_t));
+	mesh->indices = malloc((indexCount ? indexCount : 1) * sizeof(Index_t));
+	if (!mesh->vertices || !mesh->indices)
+	{
+		FatalError(
+			"failed to allocate %zu bytes!",
+			vertexCount * sizeof(Vertex_t) + indexCount * sizeof(Index_t));
+	}
+	memcpy(mesh->vertices, vertices, vertexCount * sizeof(Vertex_t));
+	memcpy(mesh->indices, indices, indexCount * sizeof(Index_t));
+	mesh->vertexCount = vertexCount;
+	mesh->indexCount = indexCount;
+}
+
+void FreeMeshData(MeshData_t* mesh)
+{
+	free(mesh->vertices);
+	free(mesh->indices);
+	memset(mesh, 0, sizeof(MeshData_t));
+}
+
+void BuildMeshAdjacency(
+	const uint32_t* indices, uint32_t triangleCount, uint32_t vertexCount, uint32_t* offsets,
+	uint32_t* triangles)
+{
+	// count the triangles for each vertex, then add them up so each vertex knows where its list
+	// starts
+	memset(offsets, 0, (vertexCount + 1) * sizeof(uint32_t));
+	for (uint32_t i = 0; i < triangleCount * 3; i++)
+	{
+		offsets[indices[i] + 1]++;
+	}
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		offsets[i + 1] += offsets[i];
+	}
+
+	// filling in the lists moves each vertex's offset to the start of the next one's list, so they
+	// get moved back afterwards
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			triangles[offsets[indices[i * 3 + j]]++] = i;
+		}
+	}
+	for (uint32_t i = vertexCount; i > 0; i--)
+	{
+		offsets[i] = offsets[i - 1];
+	}
+	offsets[0] = 0;
+}
+
+static uint32_t Tipsify(
+	const uint32_t* indices, uint32_t triangleCount, uint32_t vertexCount, uint32_t* output,
+	uint32_t* clusterStarts)
+{
+	uint32_t* offsets = malloc((vertexCount + 1) * sizeof(uint32_t));
+	uint32_t* triangles = malloc(triangleCount * 3 * sizeof(uint32_t));
+	uint32_t* live = malloc(vertexCount * sizeof(uint32_t));
+	uint32_t* timestamps = calloc(vertexCount ? vertexCount : 1, sizeof(uint32_t));
+	bool* emitted = calloc(triangleCount, sizeof(bool));
+	uint32_t* deadEnds = malloc(triangleCount * 3 * sizeof(uint32_t));
+	uint32_t* candidates = malloc(triangleCount * 3 * sizeof(uint32_t));
+	if (!offsets || !triangles || !live || !timestamps || !emitted || !deadEnds || !candidates)
+	{
+		FatalError("failed to allocate mesh optimizer memory!");
+	}
+
+	// live is the number of triangles each vertex is in that haven't been output yet
+	BuildMeshAdjacency(indices, triangleCount, vertexCount, offsets, triangles);
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		live[i] = offsets[i + 1] - offsets[i];
+	}
+
+	uint32_t time = MESH_CACHE_SIZE + 1;
+	uint32_t deadEndCount = 0;
+	uint32_t cursor = 0; // every vertex before this has no live triangles
+	uint32_t outputCount = 0;
+	uint32_t clusterCount = 0;
+	uint32_t fanning = MESH_NONE;
+
+	while (true)
+	{
+		if (fanning == MESH_NONE)
+		{
+			// nothing good is in the cache, so it has to jump: first to a recent vertex that still
+			// has triangles (the dead end stack), and if there aren't any, to the first vertex that
+			// does. jumping starts a new cluster.
+			while (deadEndCount && !live[deadEnds[deadEndCount - 1]])
+			{
+				deadEndCount--;
+			}
+			if (deadEndCount)
+			{
+				fanning = deadEnds[--deadEndCount];
+			}
+			else
+			{
+				while (cursor < vertexCount && !live[cursor])
+				{
+					cursor++;
+				}
+				if (cursor == vertexCount)
+				{
+					break;
+				}
+				fanning = cursor;
+			}
+			clusterStarts[clusterCount++] = outputCount / 3;
+		}
+
+		// output every triangle around the vertex that hasn't been already
+		uint32_t candidateCount = 0;
+		for (uint32_t i = offsets[fanning]; i < offsets[fanning + 1]; i++)
+		{
+			uint32_t triangle = triangles[i];
+			if (emitted[triangle])
+			{
+				continue;
+			}
+			emitted[triangle] = true;
+
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				uint32_t vertex = indices[triangle * 3 + j];
+				output[outputCount++] = vertex;
+				deadEnds[deadEndCount++] = vertex;
+				candidates[candidateCount++] = vertex;
+				live[vertex]--;
+				if (time - timestamps[vertex] > MESH_CACHE_SIZE)
+				{
+					timestamps[vertex] = time++;
+				}
+			}
+		}
+
+		// the next vertex is the one that's been in the cache the longest, as long as all its
+		// triangles would fit before it gets pushed out (each one can add up to 2 new vertices)
+		uint32_t next = MESH_NONE;
+		int64_t bestPriority = -1;
+		for (uint32_t i = 0; i < candidateCount; i++)
+		{
+			uint32_t vertex = candidates[i];
+			if (!live[vertex])
+			{
+				continue;
+			}
+
+			int64_t priority = 0;
+			if (time - timestamps[vertex] + 2 * live[vertex] <= MESH_CACHE_SIZE)
+			{
+				priority = time - timestamps[vertex];
+			}
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+		fanning = next;
+	}
+
+	free(candidates);
+	free(deadEnds);
+	free(emitted);
+	free(timestamps);
+	free(live);
+	free(triangles);
+	free(offsets);
+	return clusterCount;
+}
+
+static uint32_t SplitClusters(
+	const uint32_t* indices, uint32_t triangleCount, uint32_t vertexCount, uint32_t* clusterStarts,
+	uint32_t clusterCount, double threshold)
+{
+	uint32_t* timestamps = calloc(vertexCount ? vertexCount : 1, sizeof(uint32_t));
+	uint32_t* splitStarts = malloc((triangleCount + 1) * sizeof(uint32_t));
+	if (!timestamps || !splitStarts)
+	{
+		FatalError("failed to allocate mesh optimizer memory!");
+	}
+
+	// this walks each cluster with an empty cache, and ends the cluster as soon as its acmr is down
+	// to the threshold. bumping the time by the cache size is the same as emptying the cache.
+	uint32_t time = MESH_CACHE_SIZE + 1;
+	uint32_t splitCount = 0;
+	for (uint32_t i = 0; i < clusterCount; i++)
+	{
+		uint32_t end = i + 1 < clusterCount ? clusterStarts[i + 1] : triangleCount;
+		uint32_t start = clusterStarts[i];
+		splitStarts[splitCount++] = start;
+		time += MESH_CACHE_SIZE + 1;
+
+		uint32_t misses = 0;
+		for (uint32_t triangle = start; triangle < end; triangle++)
+		{
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				uint32_t vertex = indices[triangle * 3 + j];
+				if (time - timestamps[vertex] > MESH_CACHE_SIZE)
+				{
+					timestamps[vertex] = time++;
+					misses++;
+				}
+			}
+
+			if (triangle + 1 < end && misses <= threshold * (triangle + 1 - start))
+			{
+				start = triangle + 1;
+				splitStarts[splitCount++] = start;
+				misses = 0;
+				time += MESH_CACHE_SIZE + 1;
+			}
+		}
+	}
+
+	memcpy(clusterStarts, splitStarts, splitCount * sizeof(uint32_t));
+	free(splitStarts);
+	free(timestamps);
+	return splitCount;
+}
+
+static void SortClusters(
+	const Vertex_t* vertices, const uint32_t* indices, uint32_t triangleCount, uint32_t* output,
+	const uint32_t* clusterStarts, uint32_t clusterCount)
+{
+	MeshCluster_t* clusters = malloc(clusterCount * sizeof(MeshCluster_t));
+	float(*centroids)[3] = malloc(clusterCount * sizeof(float[3]));
+	float(*normals)[3] = malloc(clusterCount * sizeof(float[3]));
+	if (!clusters || !centroids || !normals)
+	{
+		FatalError("failed to allocate mesh optimizer memory!");
+	}
+
+	// the middle of each cluster and the direction it faces are the averages of its triangles',
+	// weighted by area. the length of a triangle's cross product is twice its area, so adding
+	// those up does the weighting for free.
+	float meshCentroid[3] = {0.0f, 0.0f, 0.0f};
+	float meshArea = 0.0f;
+	for (uint32_t i = 0; i < clusterCount; i++)
+	{
+		MeshCluster_t* cluster = &clusters[i];
+		cluster->start = clusterStarts[i];
+		cluster->count =
+			(i + 1 < clusterCount ? clusterStarts[i + 1] : triangleCount) - clusterStarts[i];
+
+		float centroid[3] = {0.0f, 0.0f, 0.0f};
+		float normal[3] = {0.0f, 0.0f, 0.0f};
+		float area = 0.0f;
+		for (uint32_t triangle = cluster->start; triangle < cluster->start + cluster->count;
+			 triangle++)
+		{
+			const float* a = vertices[indices[triangle * 3 + 0]].position;
+			const float* b = vertices[indices[triangle * 3 + 1]].position;
+			const float* c = vertices[indices[triangle * 3 + 2]].position;
+			float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+			float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+			float cross[3] = {
+				ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2],
+				ab[0] * ac[1] - ab[1] * ac[0]};
+			float triangleArea =
+				sqrtf(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				centroid[j] += (a[j] + b[j] + c[j]) / 3.0f * triangleArea;
+				normal[j] += cross[j];
+			}
+			area += triangleArea;
+		}
+
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			meshCentroid[j] += centroid[j];
+			centroids[i][j] = area > 0.0f ? centroid[j] / area : 0.0f;
+			normals[i][j] = normal[j];
+		}
+		meshArea += area;
+	}
+	for (uint32_t j = 0; j < 3; j++)
+	{
+		meshCentroid[j] = meshArea > 0.0f ? meshCentroid[j] / meshArea : 0.0f;
+	}
+
+	// a cluster that's far out from the middle and facing away from it is likely to be in front of
+	// the rest of the mesh from most directions, so it should be drawn first
+	for (uint32_t i = 0; i < clusterCount; i++)
+	{
+		float length = sqrtf(
+			normals[i][0] * normals[i][0] + normals[i][1] * normals[i][1] +
+			normals[i][2] * normals[i][2]);
+		float key = 0.0f;
+		if (length > 0.0f)
+		{
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				key += (centroids[i][j] - meshCentroid[j]) * normals[i][j] / length;
+			}
+		}
+		clusters[i].sortKey = key;
+	}
+	qsort(clusters, clusterCount, sizeof(MeshCluster_t), CompareClusters);
+
+	uint32_t outputCount = 0;
+	for (uint32_t i = 0; i < clusterCount; i++)
+	{
+		memcpy(
+			output + outputCount, indices + clusters[i].start * 3,
+			clusters[i].count * 3 * sizeof(uint32_t));
+		outputCount += clusters[i].count * 3;
+	}
+
+	free(normals);
+	free(centroids);
+	free(clusters);
+}
+
+static uint32_t RemapVertices(MeshData_t* mesh)
+{
+	uint32_t* remap = malloc((mesh->vertexCount ? mesh->vertexCount : 1) * sizeof(uint32_t));
+	Vertex_t* vertices = malloc((mesh->vertexCount ? mesh->vertexCount : 1) * sizeof(Vertex_t));
+	if (!remap || !vertices)
+	{
+		FatalError("failed to allocate mesh optimizer memory!");
+	}
+	memset(remap, 0xFF, mesh->vertexCount * sizeof(uint32_t));
+
+	// vertices that aren't used by any triangle get dropped
+	uint32_t* indices = (uint32_t*)mesh->indices;
+	uint32_t vertexCount = 0;
+	for (uint32_t i = 0; i < mesh->indexCount * 3; i++)
+	{
+		uint32_t vertex = indices[i];
+		if (remap[vertex] == MESH_NONE)
+		{
+			remap[vertex] = vertexCount;
+			vertices[vertexCount++] = mesh->vertices[vertex];
+		}
+		indices[i] = remap[vertex];
+	}
+
+	free(mesh->vertices);
+	mesh->vertices = vertices;
+	free(remap);
+	return vertexCount;
+}
+
+static uint32_t CountUsedVertices(
+	const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount)
+{
+	bool* used = calloc(vertexCount ? vertexCount : 1, sizeof(bool));
+	if (!used)
+	{
+		FatalError("failed to allocate mesh optimizer memory!");
+	}
+
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		count += !used[indices[i]];
+		used[indices[i]] = true;
+	}
+
+	free(used);
+	return count;
+}
+
+static int CompareClusters(const void* a, const void* b)
+{
+	float keyA = ((const MeshCluster_t*)a)->sortKey;
+	float keyB = ((const MeshCluster_t*)b)->sortKey;
+	return (keyA < keyB) - (keyA > keyB);
+}
+
+static void OptimizeMeshJob(void* data, uint32_t index)
+{
+	MeshOptimizeBatch_t* batch = data;
+	OptimizeMesh(&batch->meshes[index], &batch->stats[index]);
+}
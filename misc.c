@@ -17,7 +17,12 @@ void FatalError(const char* message, ...)
 	// the snprintf functions tell you how many characters they would write when
 	// given an empty buffer, which is useful for dynamically allocating the
 	// buffer to make sure it fits
-	int32_t count = vsnprintf(NULL, 0, message, args);
+	//
+	// a va_list can only be gone through once, so the first call gets a copy
+	va_list countArgs;
+	va_copy(countArgs, args);
+	int32_t count = vsnprintf(NULL, 0, message, countArgs);
+	va_end(countArgs);
 
 	// generally, it's a bad idea to allocate memory at all in an error
 	// function, but this is a useful illustration of how to use vsnprintf
@@ -41,6 +46,7 @@ void FatalError(const char* message, ...)
 	// this can be checked by comparing it to buffer, because local arrays decay
 	// to pointers to stack memory (static/global arrays are in the bss section)
 	vsnprintf(formattedMsg, formattedMsg == buffer ? sizeof(buffer) : count + 1, message, args);
+	va_end(args);
 
 	// print the message to stderr (%s is used in case % is used in the
 	// formatted message)
@@ -72,20 +78,11 @@ void* LoadFile(const char* name, size_t* size)
 		return NULL;
 	}
 
-	// open the file in binary read mode (to prevent it from messing with carriage return/newline
-	// characters)
-	FILE* file = fopen(name, "rb");
-	if (!file) // fopen returns null on failure
-	{
-		FatalError("failed to read file %s!\n", name);
-	}
-
-	// get the size of the file by going to the end, getting the current position, and then going
-	// back
-	fseek(file, 0, SEEK_END);
-	*size = ftell(file); // dereferencing a pointer allows reading/writing to the memory it points
-						 // to. this line lets the caller of the function know the size of the file.
-	fseek(file, 0, SEEK_SET); // can also use rewind() for this
+	// map the file, which is the one copy that has to happen anyway (from the file cache into the
+	// buffer), instead of fread copying it through stdio's buffer
+	MappedFile_t file = MapFile(name);
+	*size = file.size; // dereferencing a pointer allows reading/writing to the memory it points
+					   // to. this line lets the caller of the function know the size of the file.
 
 	// allocate a buffer to hold the file, with a nul terminator in case it's text
 	void* buffer = calloc(*size + 1, 1);
@@ -94,11 +91,11 @@ void* LoadFile(const char* name, size_t* size)
 		FatalError("failed to allocate %zu bytes!\n", *size + 1);
 	}
 
-	// read into the buffer
-	fread(buffer, 1, *size, file);
+	// copy it into the buffer
+	memcpy(buffer, file.data, *size);
 
-	// close the file
-	fclose(file);
+	// unmap the file
+	UnmapFile(&file);
 
 	return buffer;
 }
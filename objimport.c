@@ -0,0 +1,577 @@
+// this file implements importing wavefront .obj files, which is what most scanning and modelling
+// tools can export. an obj file is text, one thing per line:
+//
+//   v x y z [r g b]   a position, with a colour after it in files from a lot of scanners
+//   vn x y z          a normal
+//   f a b c ...       a face, each corner is v, v/vt, v//vn or v/vt/vn, 1 based (or negative,
+//                     counting back from the most recent one)
+//
+// and a bunch of other things (texture coordinates, groups, materials) that don't matter here. the
+// usual way of reading one is a line at a time with sscanf or strtod, which manages tens of MB/s,
+// and scanned meshes can be gigabytes. so instead:
+//
+// - the file is mapped, and split into chunks at line boundaries, which get parsed in parallel on
+//   the job threads. a chunk has to know how many positions and normals come before it, both for
+//   negative indices and to know where to put its own, so there's a quick pass that only counts
+//   lines first.
+// - floats and integers are parsed by hand. strtod handles locales, hex floats, infinity and a lot
+//   more, and has to find the end of the number by itself, which all adds up.
+// - a vertex in an obj file is a combination of a position and a normal (and a texture coordinate,
+//   but Vertex_t doesn't have one, so those are ignored), and the same combination shows up in
+//   every face around it. they get merged by looking through the vertices already made from the
+//   same position, so each one becomes one vertex.
+//
+// the colour comes from the file if it has them, otherwise from the normal like the sphere's,
+// otherwise from where the vertex is in the mesh's bounding box. vertices without a normal get one
+// from the triangles around them, for the lit vertex format.
+
+#include "stuff.h"
+
+// roughly how big chunks are. each one is a job, so there should be several for each thread to
+// even out the work, but not so many that they're tiny.
+#define OBJ_CHUNK_SIZE (1024 * 1024)
+
+// the most digits of a number that affect its value, past this they're beyond float precision
+#define OBJ_MAX_DIGITS 18
+
+// used for "no normal", and the end of a position's list of vertices
+#define OBJ_NONE UINT32_MAX
+
+// a piece of the file, and what got parsed from it
+typedef struct ObjChunk
+{
+	const char* start;
+	const char* end;
+
+	// from the counting pass
+	uint32_t positionCount;
+	uint32_t normalCount;
+	uint32_t firstPosition; // the number of positions and normals in the chunks before this one
+	uint32_t firstNormal;
+
+	// from parsing. a corner is a position index in the low 32 bits and a normal index (or
+	// OBJ_NONE) in the high ones, 3 for each triangle.
+	uint64_t* corners;
+	uint32_t triangleCount;
+	uint32_t triangleCapacity;
+	bool hasColours;
+	float boundsMin[3];
+	float boundsMax[3];
+} ObjChunk_t;
+
+// everything the jobs need
+typedef struct ObjImport
+{
+	const char* name;
+	const char* data; // the start of the file, for errors
+	ObjChunk_t* chunks;
+	uint32_t positionCount;
+	uint32_t normalCount;
+	float (*positions)[3];
+	float (*colours)[3];
+	float (*normals)[3];
+} ObjImport_t;
+
+// count the positions and normals in a chunk, for RunJobs
+static void CountObjChunk(void* data, uint32_t index);
+
+// parse a chunk, for RunJobs
+static void ParseObjChunk(void* data, uint32_t index);
+
+// parse a float, returns where it ended or NULL if there isn't one
+static const char* ParseFloat(const char* c, const char* end, float* value);
+
+// parse an integer, returns where it ended or NULL if there isn't one
+static const char* ParseInteger(const char* c, const char* end, int64_t* value);
+
+// skip spaces and tabs (and carriage returns, which windows puts at the end of every line)
+static const char* SkipSpaces(const char* c, const char* end);
+
+// turn a 1 based or negative index into a 0 based one, returns false if it's out of range
+static bool ResolveIndex(int64_t index, uint32_t before, uint32_t total, uint32_t* resolved);
+
+// add a triangle to a chunk
+static void AddObjTriangle(ObjChunk_t* chunk, uint64_t a, uint64_t b, uint64_t c);
+
+// the powers of 10 that are exact as doubles
+static const double POW10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+							   1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+							   1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+#define POW10_COUNT (sizeof(POW10) / sizeof(POW10[0]))
+
+void ImportObj(const char* name, MeshData_t* mesh)
+{
+	uint64_t start = GetTime();
+	MappedFile_t file = MapFile(name);
+	const char* data = file.data;
+
+	// split the file into chunks, moving each split to just after the end of a line
+	uint32_t chunkCount = (uint32_t)(file.size / OBJ_CHUNK_SIZE) + 1;
+	ObjChunk_t* chunks = calloc(chunkCount, sizeof(ObjChunk_t));
+	if (!chunks)
+	{
+		FatalError("failed to allocate %u chunks to import %s!", chunkCount, name);
+	}
+	const char* end = data + file.size;
+	const char* chunkStart = data;
+	for (uint32_t i = 0; i < chunkCount; i++)
+	{
+		const char* chunkEnd = i + 1 < chunkCount ? data + (i + 1) * (size_t)OBJ_CHUNK_SIZE : end;
+		chunkEnd = chunkEnd > chunkStart ? chunkEnd : chunkStart;
+		const char* newline = memchr(chunkEnd, '\n', (size_t)(end - chunkEnd));
+		chunkEnd = newline && i + 1 < chunkCount ? newline + 1 : end;
+		chunks[i].start = chunkStart;
+		chunks[i].end = chunkEnd;
+		chunkStart = chunkEnd;
+	}
+
+	// count everything first, so every chunk knows where its positions and normals go
+	ObjImport_t import = {
+		.name = name,
+		.data = data,
+		.chunks = chunks,
+	};
+	RunJobs(CountObjChunk, &import, chunkCount);
+	for (uint32_t i = 0; i < chunkCount; i++)
+	{
+		chunks[i].firstPosition = import.positionCount;
+		chunks[i].firstNormal = import.normalCount;
+		if ((uint64_t)import.positionCount + chunks[i].positionCount > UINT32_MAX ||
+			(uint64_t)import.normalCount + chunks[i].normalCount > UINT32_MAX)
+		{
+			FatalError("%s has too many vertices!", name);
+		}
+		import.positionCount += chunks[i].positionCount;
+		import.normalCount += chunks[i].normalCount;
+	}
+	uint64_t countTime = GetTime();
+
+	import.positions = malloc((import.positionCount + 1) * sizeof(float[3]));
+	import.colours = malloc((import.positionCount + 1) * sizeof(float[3]));
+	import.normals = malloc((import.normalCount + 1) * sizeof(float[3]));
+	if (!import.positions || !import.colours || !import.normals)
+	{
+		FatalError("failed to allocate %u positions to import %s!", import.positionCount, name);
+	}
+	RunJobs(ParseObjChunk, &import, chunkCount);
+	uint64_t parseTime = GetTime();
+
+	bool hasColours = false;
+	uint64_t triangleCount = 0;
+	float boundsMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+	float boundsMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	for (uint32_t i = 0; i < chunkCount; i++)
+	{
+		hasColours |= chunks[i].hasColours;
+		triangleCount += chunks[i].triangleCount;
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			boundsMin[j] = fminf(boundsMin[j], chunks[i].boundsMin[j]);
+			boundsMax[j] = fmaxf(boundsMax[j], chunks[i].boundsMax[j]);
+		}
+	}
+	if (triangleCount > UINT32_MAX / 3)
+	{
+		FatalError("%s has too many triangles!", name);
+	}
+
+	// merge the corners that have the same position and normal. each position has a list of the
+	// vertices made from it, which is almost always one long, since most positions only have one
+	// normal. that's faster than a hash table, because faces use positions near each other in the
+	// file, so looking them up stays in the cache, where a hash would be all over memory.
+	uint32_t* firstVertices = malloc((import.positionCount + 1) * sizeof(uint32_t));
+	uint32_t* nextVertices = malloc((size_t)(triangleCount * 3 + 1) * sizeof(uint32_t));
+	uint64_t* unique = malloc((size_t)(triangleCount * 3 + 1) * sizeof(uint64_t));
+	mesh->indices = malloc((size_t)(triangleCount + 1) * sizeof(Index_t));
+	if (!firstVertices || !nextVertices || !unique || !mesh->indices)
+	{
+		FatalError("failed to allocate %" PRIu64 " triangles to import %s!", triangleCount, name);
+	}
+	memset(firstVertices, 0xff, import.positionCount * sizeof(uint32_t));
+	uint32_t uniqueCount = 0;
+	uint32_t* indices = (uint32_t*)mesh->indices;
+	for (uint32_t i = 0; i < chunkCount; i++)
+	{
+		for (uint32_t j = 0; j < chunks[i].triangleCount * 3; j++)
+		{
+			uint64_t corner = chunks[i].corners[j];
+			uint32_t position = (uint32_t)corner;
+			uint32_t vertex = firstVertices[position];
+			while (vertex != OBJ_NONE && unique[vertex] != corner)
+			{
+				vertex = nextVertices[vertex];
+			}
+			if (vertex == OBJ_NONE)
+			{
+				vertex = uniqueCount++;
+				unique[vertex] = corner;
+				nextVertices[vertex] = firstVertices[position];
+				firstVertices[position] = vertex;
+			}
+			*indices++ = vertex;
+		}
+		free(chunks[i].corners);
+	}
+	uint64_t mergeTime = GetTime();
+
+	// now the vertices can be made
+	mesh->vertexCount = uniqueCount;
+	mesh->indexCount = (uint32_t)triangleCount;
+	mesh->vertices = malloc((uniqueCount + 1) * sizeof(Vertex_t));
+	if (!mesh->vertices)
+	{
+		FatalError("failed to allocate %u vertices to import %s!", uniqueCount, name);
+	}
+	for (uint32_t i = 0; i < uniqueCount; i++)
+	{
+		uint32_t position = (uint32_t)unique[i];
+		uint32_t normal = (uint32_t)(unique[i] >> 32);
+		Vertex_t* vertex = &mesh->vertices[i];
+		memcpy(vertex->position, import.positions[position], sizeof(vertex->position));
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			vertex->normal[j] = normal != OBJ_NONE ? import.normals[normal][j] : 0.0f;
+			float size = boundsMax[j] - boundsMin[j];
+			vertex->colour[j] = hasColours         ? import.colours[position][j]
+								: normal != OBJ_NONE ? import.normals[normal][j] * 0.5f + 0.5f
+								: size > 0.0f        ? (vertex->position[j] - boundsMin[j]) / size
+													 : 1.0f;
+		}
+		vertex->colour[3] = 1.0f;
+	}
+
+	// vertices without a normal in the file get the sum of the normals of the triangles around
+	// them. the cross product's length is twice the triangle's area, so bigger triangles count
+	// more, and ConvertVertices doesn't care how long a normal is.
+	bool missingNormals = false;
+	for (uint32_t i = 0; i < uniqueCount && !missingNormals; i++)
+	{
+		missingNormals = (uint32_t)(unique[i] >> 32) == OBJ_NONE;
+	}
+	for (uint32_t i = 0; missingNormals && i < mesh->indexCount; i++)
+	{
+		const uint32_t* triangle = mesh->indices[i];
+		const float* a = mesh->vertices[triangle[0]].position;
+		const float* b = mesh->vertices[triangle[1]].position;
+		const float* c = mesh->vertices[triangle[2]].position;
+		float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+		float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+		float normal[3] = {
+			ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2],
+			ab[0] * ac[1] - ab[1] * ac[0]};
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			if ((uint32_t)(unique[triangle[j]] >> 32) == OBJ_NONE)
+			{
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					mesh->vertices[triangle[j]].normal[k] += normal[k];
+				}
+			}
+		}
+	}
+	uint64_t endTime = GetTime();
+
+	free(unique);
+	free(nextVertices);
+	free(firstVertices);
+	free(import.normals);
+	free(import.colours);
+	free(import.positions);
+	free(chunks);
+	size_t fileSize = file.size;
+	UnmapFile(&file);
+
+	// the speed is what matters for big files, so it's in MB/s of the file and triangles per
+	// second, like other importers get measured
+	double seconds = (endTime - start) / 1e9;
+	printf(
+		"Imported %s (%.2f MB) in %.3f ms on %u threads: %.1f MB/s, %.2f M triangles/s\n", name,
+		fileSize / 1e6, seconds * 1e3, GetJobThreadCount(), fileSize / 1e6 / seconds,
+		mesh->indexCount / 1e6 / seconds);
+	printf(
+		"  %u triangles, %u vertices from %u positions and %u normals\n", mesh->indexCount,
+		mesh->vertexCount, import.positionCount, import.normalCount);
+	printf(
+		"  counting %.3f ms, parsing %u chunks %.3f ms, merging vertices %.3f ms, making "
+		"vertices %.3f ms\n",
+		(countTime - start) / 1e6, chunkCount, (parseTime - countTime) / 1e6,
+		(mergeTime - parseTime) / 1e6, (endTime - mergeTime) / 1e6);
+}
+
+static void CountObjChunk(void* data, uint32_t index)
+{
+	ObjImport_t* import = data;
+	ObjChunk_t* chunk = &import->chunks[index];
+	for (const char* c = chunk->start; c < chunk->end;)
+	{
+		const char* lineEnd = memchr(c, '\n', (size_t)(chunk->end - c));
+		lineEnd = lineEnd ? lineEnd : chunk->end;
+		c = SkipSpaces(c, lineEnd);
+		if (lineEnd - c >= 2 && c[0] == 'v' && (c[1] == ' ' || c[1] == '\t'))
+		{
+			chunk->positionCount++;
+		}
+		else if (lineEnd - c >= 3 && c[0] == 'v' && c[1] == 'n' && (c[2] == ' ' || c[2] == '\t'))
+		{
+			chunk->normalCount++;
+		}
+		c = lineEnd + 1;
+	}
+}
+
+static void ParseObjChunk(void* data, uint32_t index)
+{
+	ObjImport_t* import = data;
+	ObjChunk_t* chunk = &import->chunks[index];
+	uint32_t positionCount = chunk->firstPosition;
+	uint32_t normalCount = chunk->firstNormal;
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		chunk->boundsMin[i] = FLT_MAX;
+		chunk->boundsMax[i] = -FLT_MAX;
+	}
+
+	for (const char* c = chunk->start; c < chunk->end;)
+	{
+		const char* lineEnd = memchr(c, '\n', (size_t)(chunk->end - c));
+		lineEnd = lineEnd ? lineEnd : chunk->end;
+		const char* lineStart = c;
+		c = SkipSpaces(c, lineEnd);
+		bool broken = false;
+
+		if (lineEnd - c >= 2 && c[0] == 'v' && (c[1] == ' ' || c[1] == '\t'))
+		{
+			// a position, which can have a w after it (which doesn't matter here), or a colour
+			float* position = import->positions[positionCount];
+			float* colour = import->colours[positionCount];
+			c += 2;
+			for (uint32_t i = 0; i < 3 && c; i++)
+			{
+				c = ParseFloat(c, lineEnd, &position[i]);
+			}
+			float extra[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+			uint32_t extraCount = 0;
+			while (c && extraCount < 4 && (c = SkipSpaces(c, lineEnd)) < lineEnd)
+			{
+				c = ParseFloat(c, lineEnd, &extra[extraCount++]);
+			}
+			broken = !c || extraCount == 2;
+			memcpy(colour, extra, sizeof(float[3]));
+			chunk->hasColours |= extraCount >= 3;
+			for (uint32_t i = 0; i < 3 && !broken; i++)
+			{
+				chunk->boundsMin[i] = fminf(chunk->boundsMin[i], position[i]);
+				chunk->boundsMax[i] = fmaxf(chunk->boundsMax[i], position[i]);
+			}
+			positionCount++;
+		}
+		else if (lineEnd - c >= 3 && c[0] == 'v' && c[1] == 'n' && (c[2] == ' ' || c[2] == '\t'))
+		{
+			float* normal = import->normals[normalCount++];
+			c += 3;
+			for (uint32_t i = 0; i < 3 && c; i++)
+			{
+				c = ParseFloat(c, lineEnd, &normal[i]);
+			}
+			broken = !c;
+		}
+		else if (lineEnd - c >= 2 && c[0] == 'f' && (c[1] == ' ' || c[1] == '\t'))
+		{
+			// a face, which gets split into a fan of triangles around its first corner
+			c += 2;
+			uint64_t first = 0;
+			uint64_t previous = 0;
+			uint32_t cornerCount = 0;
+			while (!broken && (c = SkipSpaces(c, lineEnd)) < lineEnd)
+			{
+				int64_t value = 0;
+				uint32_t position = 0;
+				uint32_t normal = OBJ_NONE;
+				c = ParseInteger(c, lineEnd, &value);
+				broken = !c ||
+						 !ResolveIndex(value, positionCount, import->positionCount, &position);
+				if (!broken && c < lineEnd && *c == '/')
+				{
+					// the texture coordinate is skipped, it might not be there (v//vn)
+					c++;
+					while (c < lineEnd && *c != '/' && *c != ' ' && *c != '\t' && *c != '\r')
+					{
+						c++;
+					}
+					if (c < lineEnd && *c == '/')
+					{
+						c = ParseInteger(c + 1, lineEnd, &value);
+						broken =
+							!c || !ResolveIndex(value, normalCount, import->normalCount, &normal);
+					}
+				}
+
+				uint64_t corner = (uint64_t)position | (uint64_t)normal << 32;
+				if (cornerCount == 0)
+				{
+					first = corner;
+				}
+				else if (cornerCount >= 2)
+				{
+					AddObjTriangle(chunk, first, previous, corner);
+				}
+				previous = corner;
+				cornerCount++;
+			}
+			broken |= cornerCount < 3;
+		}
+
+		if (broken)
+		{
+			FatalError(
+				"%s has a broken line at byte %zu: %.*s", import->name,
+				(size_t)(lineStart - import->data), (int)(lineEnd - lineStart), lineStart);
+		}
+		c = lineEnd + 1;
+	}
+}
+
+static const char* ParseFloat(const char* c, const char* end, float* value)
+{
+	c = SkipSpaces(c, end);
+	bool negative = c < end && *c == '-';
+	if (c < end && (*c == '-' || *c == '+'))
+	{
+		c++;
+	}
+
+	// the digits go into an integer, and the decimal point just changes the exponent, so 1.25 is
+	// 125 * 10^-2. that's exact up to 18 digits, and floats only have about 7.
+	uint64_t mantissa = 0;
+	int32_t exponent = 0;
+	uint32_t digits = 0;
+	uint32_t significantDigits = 0;
+	for (; c < end && *c >= '0' && *c <= '9'; c++, digits++)
+	{
+		if (significantDigits < OBJ_MAX_DIGITS)
+		{
+			mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+			significantDigits += mantissa != 0;
+		}
+		else
+		{
+			exponent++;
+		}
+	}
+	if (c < end && *c == '.')
+	{
+		for (c++; c < end && *c >= '0' && *c <= '9'; c++, digits++)
+		{
+			if (significantDigits < OBJ_MAX_DIGITS)
+			{
+				mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+				significantDigits += mantissa != 0;
+				exponent--;
+			}
+		}
+	}
+	if (!digits)
+	{
+		return NULL;
+	}
+	if (c < end && (*c == 'e' || *c == 'E'))
+	{
+		int64_t power = 0;
+		c = ParseInteger(c + 1, end, &power);
+		if (!c)
+		{
+			return NULL;
+		}
+		power = power < -1000 ? -1000 : power > 1000 ? 1000 : power;
+		exponent += (int32_t)power;
+	}
+
+	// a number has to end at a space or the end of the line
+	if (c < end && *c != ' ' && *c != '\t' && *c != '\r')
+	{
+		return NULL;
+	}
+
+	// multiplying or dividing by an exact power of 10 is one rounding, which is plenty for a
+	// float. anything past 10^22 is way outside what a float can hold anyway, so it gets there in
+	// steps.
+	double result = (double)mantissa;
+	while (exponent > 0)
+	{
+		int32_t step = exponent < (int32_t)POW10_COUNT ? exponent : (int32_t)POW10_COUNT - 1;
+		result *= POW10[step];
+		exponent -= step;
+	}
+	while (exponent < 0)
+	{
+		int32_t step = -exponent < (int32_t)POW10_COUNT ? -exponent : (int32_t)POW10_COUNT - 1;
+		result /= POW10[step];
+		exponent += step;
+	}
+	*value = (float)(negative ? -result : result);
+	return c;
+}
+
+static const char* ParseInteger(const char* c, const char* end, int64_t* value)
+{
+	bool negative = c < end && *c == '-';
+	if (c < end && (*c == '-' || *c == '+'))
+	{
+		c++;
+	}
+	const char* start = c;
+	int64_t result = 0;
+	for (; c < end && *c >= '0' && *c <= '9'; c++)
+	{
+		// anything this big is out of range anyway, this just stops it overflowing
+		result = result < INT32_MAX ? result * 10 + (*c - '0') : result;
+	}
+	if (c == start)
+	{
+		return NULL;
+	}
+	*value = negative ? -result : result;
+	return c;
+}
+
+static const char* SkipSpaces(const char* c, const char* end)
+{
+	while (c < end && (*c == ' ' || *c == '\t' || *c == '\r'))
+	{
+		c++;
+	}
+	return c;
+}
+
+static bool ResolveIndex(int64_t index, uint32_t before, uint32_t total, uint32_t* resolved)
+{
+	// positive indices count from the start of the file, negative ones from the most recent one,
+	// and 0 isn't allowed
+	int64_t result = index > 0 ? index - 1 : (int64_t)before + index;
+	if (index == 0 || result < 0 || result >= total)
+	{
+		return false;
+	}
+	*resolved = (uint32_t)result;
+	return true;
+}
+
+static void AddObjTriangle(ObjChunk_t* chunk, uint64_t a, uint64_t b, uint64_t c)
+{
+	if (chunk->triangleCount >= chunk->triangleCapacity)
+	{
+		uint32_t capacity = chunk->triangleCapacity ? chunk->triangleCapacity * 2 : 4096;
+		uint64_t* corners = realloc(chunk->corners, (size_t)capacity * 3 * sizeof(uint64_t));
+		if (!corners)
+		{
+			FatalError("failed to allocate %u triangles!", capacity);
+		}
+		chunk->corners = corners;
+		chunk->triangleCapacity = capacity;
+	}
+	uint64_t* corner = &chunk->corners[chunk->triangleCount++ * 3];
+	corner[0] = a;
+	corner[1] = b;
+	corner[2] = c;
+}
@@ -1,54 +1,86 @@
 #include "stuff.h"
 
-uint32_t CreateVertexBuffer(const Vertex_t* vertices, uint32_t vertexCount)
+BufferAllocation_t CreateVertexBuffer(
+	const VertexFormat_t* format, const Vertex_t* vertices, uint32_t vertexCount,
+	const float quantization[4])
 {
-	// special value to know if the buffer was created successfully, the glGen* functions don't
-	// modify the value when an error happens
-	uint32_t buffer = GL_INVALID_VALUE;
-	// creates a buffer resource on the gpu
-	glGenBuffers(1, &buffer);
-	if (buffer == GL_INVALID_VALUE)
+	// the vertices get packed into the format first
+	void* packed = malloc((size_t)vertexCount * format->stride);
+	if (!packed)
 	{
-		// glGetError gives an error code, like GetLastError()
-		FatalError("failed to create vertex buffer: %d!", glGetError());
+		FatalError("failed to allocate %zu bytes!", (size_t)vertexCount * format->stride);
 	}
+	ConvertVertices(format, vertices, vertexCount, quantization, packed);
 
-	// resources have to be bound in order to manipulate or use them. the buffer is bound as the
-	// array buffer, which is used for vertex buffers.
-	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	// upload the data, static draw means they don't get changed, telling the driver
-	// this lets it use the optimal type of memory here
-	glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex_t), vertices, GL_STATIC_DRAW);
-	// unbind it by binding nothing
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	// label the buffer as a vertex buffer, not super useful but narrows it down a little
-	// in error/debug messages
-	glObjectLabel(GL_BUFFER, buffer, 13, "Vertex buffer");
-
-	return buffer;
+	// then they go in a buffer pool, along with other meshes' vertices. the pool does the
+	// glBufferSubData to upload them (static draw buffers can still be changed, it just tells the
+	// driver they won't be very often, which lets it use the optimal type of memory).
+	BufferAllocation_t allocation =
+		AllocateBuffer(GL_ARRAY_BUFFER, format->stride, packed, vertexCount);
+	free(packed);
+	return allocation;
 }
 
-uint32_t CreateIndexBuffer(const Index_t* indices, uint32_t indexCount)
+BufferAllocation_t CreateIndexBuffer(
+	const Index_t* indices, uint32_t indexCount, uint32_t* indexType)
 {
-	uint32_t buffer = GL_INVALID_VALUE;
-	glGenBuffers(1, &buffer);
-	if (buffer == GL_INVALID_VALUE)
+	// if every index fits in 16 bits, the indices can be stored in half the space. most meshes
+	// have less than 65536 vertices, so this is the usual case.
+	const uint32_t* values = (const uint32_t*)indices;
+	uint32_t count = indexCount * 3; // the allocation counts individual indices, not triangles
+	uint32_t maxIndex = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		maxIndex = values[i] > maxIndex ? values[i] : maxIndex;
+	}
+	if (maxIndex > UINT16_MAX)
+	{
+		*indexType = GL_UNSIGNED_INT;
+		return AllocateBuffer(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t), indices, count);
+	}
+
+	uint16_t* shortIndices = malloc(count * sizeof(uint16_t));
+	if (!shortIndices)
 	{
-		FatalError("failed to create index buffer: %d!", glGetError());
+		FatalError("failed to allocate %zu bytes!", count * sizeof(uint16_t));
+	}
+	for (uint32_t i = 0; i < count; i++)
+	{
+		shortIndices[i] = (uint16_t)values[i];
 	}
 
-	// the element array buffer is used for indices
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(Index_t), indices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	// 16 bit indices have their own pool, because offsets into a pool are in elements
+	*indexType = GL_UNSIGNED_SHORT;
+	BufferAllocation_t allocation =
+		AllocateBuffer(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t), shortIndices, count);
+	free(shortIndices);
+	return allocation;
+}
 
-	glObjectLabel(GL_BUFFER, buffer, 12, "Index buffer");
+Mesh_t CreateMesh(
+	const VertexFormat_t* format, const Vertex_t* vertices, uint32_t vertexCount,
+	const Index_t* indices, uint32_t indexCount)
+{
+	Mesh_t mesh;
+	mesh.format = format;
+	GetVertexQuantization(format, vertices, vertexCount, mesh.quantization);
+	mesh.vertices = CreateVertexBuffer(format, vertices, vertexCount, mesh.quantization);
+	mesh.indices = CreateIndexBuffer(indices, indexCount, &mesh.indexType);
+	// every mesh in the same pools with the same format can use the same vertex array, the offsets
+	// are given when drawing
+	mesh.vertexArray = GetSharedVertexArray(format, mesh.vertices.buffer, mesh.indices.buffer);
+	return mesh;
+}
 
-	return buffer;
+void DestroyMesh(Mesh_t* mesh)
+{
+	// the vertex array is shared, so it stays around until DestroyBufferPools
+	FreeBuffer(&mesh->vertices);
+	FreeBuffer(&mesh->indices);
+	mesh->vertexArray = 0;
 }
 
-uint32_t CreateVertexArray(uint32_t vertexBuffer, uint32_t indexBuffer)
+uint32_t CreateVertexArray(const VertexFormat_t* format, uint32_t vertexBuffer, uint32_t indexBuffer)
 {
 	uint32_t vertexArray = GL_INVALID_VALUE;
 	glGenVertexArrays(1, &vertexArray);
@@ -60,52 +92,32 @@ uint32_t CreateVertexArray(uint32_t vertexBuffer, uint32_t indexBuffer)
 	// while a vertex array is bound, certain bindings will attach resources to it.
 	// they store the state necessary to draw things, and make binding all the resources needed at
 	// once easier for the programmer and the driver.
-	glBindVertexArray(vertexArray);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	// the array buffer binding isn't part of the vertex array, so it goes through the state cache.
+	// the element array buffer binding is, so it doesn't.
+	SetVertexArray(vertexArray);
+	SetBuffer(GL_ARRAY_BUFFER, vertexBuffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
 
-	// vertex attributes describe each part of a vertex, so the driver knows how to understand the
-	// vertex data it's given. more complex renderers often have many of these for different types
-	// of objects that get drawn, to make the best use of memory.
-	// parameters:
-	// index (basically an id for this attribute)
-	// count (the number of elements in this attribute)
-	// type (the type of data)
-	// normalized (whether to clamp the value to [-1.0, 1.0]
-	// vertex size
-	// offset (into a vertex)
-
-	// position
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex_t), (void*)(0));
-	glEnableVertexAttribArray(0);
-
-	// colour
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_TRUE, sizeof(Vertex_t), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
+	// vertex attributes describe each part of a vertex. more complex renderers often have many of
+	// these for different types of objects that get drawn, to make the best use of memory, so they
+	// come from the format instead of being written out here.
+	SetVertexAttributes(format);
 
 	// unbind the vertex array
-	glBindVertexArray(0);
+	SetVertexArray(0);
 
 	return vertexArray;
 }
 
-// reads a file in and compiles it as a shader
-static uint32_t LoadShader(const char* name, GLenum shaderType)
+// compiles a shader from source that's already been read in, the name is for errors and the label
+static uint32_t CompileShader(const char* name, const MappedFile_t* source, GLenum shaderType)
 {
-	printf("Loading shader %s\n", name);
-
-	// read in the shader
-	size_t shaderSize = 0;
-	void* shaderData = LoadFile(name, &shaderSize);
-
 	// create an empty shader resource
 	uint32_t shader = glCreateShader(shaderType);
 
-	// set the source for the shader
-	glShaderSource(shader, 1, (const char*[]){shaderData}, (int32_t[]){(int32_t)shaderSize});
-
-	// the shader source code isn't needed anymore, it's been given to the driver
-	free(shaderData);
+	// set the source for the shader. glShaderSource takes the length of the source, so it doesn't
+	// need a nul terminator and can read it straight from a mapping.
+	glShaderSource(shader, 1, (const char*[]){source->data}, (int32_t[]){(int32_t)source->size});
 
 	// compile the shader
 	glCompileShader(shader);
@@ -130,10 +142,41 @@ static uint32_t LoadShader(const char* name, GLenum shaderType)
 	return shader;
 }
 
+// reads a file in and compiles it as a shader
+static uint32_t LoadShader(const char* name, GLenum shaderType)
+{
+	printf("Loading shader %s\n", name);
+
+	MappedFile_t shaderFile = MapFile(name);
+	uint32_t shader = CompileShader(name, &shaderFile, shaderType);
+
+	// the shader source code isn't needed anymore, it's been given to the driver
+	UnmapFile(&shaderFile);
+
+	return shader;
+}
+
 uint32_t LoadShaders(const char* vertexName, const char* fragmentName)
 {
-	uint32_t vertexShader = LoadShader(vertexName, GL_VERTEX_SHADER);
-	uint32_t fragmentShader = LoadShader(fragmentName, GL_FRAGMENT_SHADER);
+	printf("Loading shaders %s and %s\n", vertexName, fragmentName);
+
+	MappedFile_t vertexFile = MapFile(vertexName);
+	MappedFile_t fragmentFile = MapFile(fragmentName);
+	uint32_t program = CreateShaderProgram(vertexName, &vertexFile, fragmentName, &fragmentFile);
+
+	// the shader source code isn't needed anymore, it's been given to the driver
+	UnmapFile(&vertexFile);
+	UnmapFile(&fragmentFile);
+
+	return program;
+}
+
+uint32_t CreateShaderProgram(
+	const char* vertexName, const MappedFile_t* vertexSource, const char* fragmentName,
+	const MappedFile_t* fragmentSource)
+{
+	uint32_t vertexShader = CompileShader(vertexName, vertexSource, GL_VERTEX_SHADER);
+	uint32_t fragmentShader = CompileShader(fragmentName, fragmentSource, GL_FRAGMENT_SHADER);
 
 	// a shader program combines multiple stages (you need at least a vertex and fragment shader 99%
 	// of the time)
@@ -168,3 +211,79 @@ uint32_t LoadShaders(const char* vertexName, const char* fragmentName)
 
 	return program;
 }
+
+// the loader thread half of QueueLoadShaders, which maps the files
+static void* LoadShaderFiles(void* data)
+{
+	ShaderLoad_t* load = data;
+	printf("Loading shaders %s and %s\n", load->vertexName, load->fragmentName);
+	load->vertexFile = MapFile(load->vertexName);
+	load->fragmentFile = MapFile(load->fragmentName);
+	return NULL;
+}
+
+// the context thread half, which compiles them
+static void FinishShaderFiles(void* data, void* result, bool cancelled)
+{
+	(void)result;
+
+	// the files are still mapped, so the driver reads the source straight from the file cache
+	ShaderLoad_t* load = data;
+	if (!cancelled)
+	{
+		load->program = CreateShaderProgram(
+			load->vertexName, &load->vertexFile, load->fragmentName, &load->fragmentFile);
+	}
+	if (load->vertexFile.data)
+	{
+		UnmapFile(&load->vertexFile);
+		UnmapFile(&load->fragmentFile);
+	}
+}
+
+void QueueLoadShaders(
+	ShaderLoad_t* load, const char* vertexName, const char* fragmentName, int32_t priority)
+{
+	memset(load, 0, sizeof(ShaderLoad_t));
+	load->vertexName = vertexName;
+	load->fragmentName = fragmentName;
+	load->request.name = vertexName;
+	load->request.load = LoadShaderFiles;
+	load->request.finish = FinishShaderFiles;
+	load->request.data = load;
+	load->request.priority = priority;
+	QueueLoad(&load->request);
+}
+
+uint32_t GetLoadedShaders(const ShaderLoad_t* load)
+{
+	return GetLoadState(&load->request) == LoadStateDone ? load->program : 0;
+}
+
+uint32_t LoadComputeShader(const char* name)
+{
+	// a compute shader is a program by itself, it doesn't go with any other stages
+	uint32_t computeShader = LoadShader(name, GL_COMPUTE_SHADER);
+	uint32_t program = glCreateProgram();
+	if (program == GL_INVALID_VALUE)
+	{
+		FatalError("failed to create shader program: %d!\n", glGetError());
+	}
+
+	glAttachShader(program, computeShader);
+	glLinkProgram(program);
+
+	int32_t success = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		char errorLog[512] = {0};
+		glGetProgramInfoLog(program, sizeof(errorLog), NULL, errorLog);
+		FatalError("failed to link compute shader program from %s: %s\n", name, errorLog);
+	}
+
+	glDetachShader(program, computeShader);
+	glDeleteShader(computeShader);
+
+	return program;
+}
@@ -0,0 +1,141 @@
+// this file implements frame pacing. without it, the main loop draws as fast as it can, which uses
+// a whole cpu even when the frame takes almost no time to draw.
+//
+// sleeping is the obvious way to wait, but the os decides when the thread actually wakes up, and
+// that's usually a bit late. spinning (checking the time in a loop) is precise, but it's just as
+// wasteful as not waiting at all. so this sleeps until a little before the deadline (the margin),
+// and spins for the rest. the margin is based on how late the sleeps have been waking up, so it's
+// as short as it can be on a quiet machine, and longer on a busy one.
+
+#include "stuff.h"
+
+// the limits on the margin, in nanoseconds. even a very good sleep isn't more precise than 50
+// microseconds, and if sleeps are worse than 4 milliseconds late then spinning isn't worth it.
+#define PACING_MIN_MARGIN 50000.0
+#define PACING_MAX_MARGIN 4000000.0
+
+// the margin starts at 1 millisecond, and adjusts from there
+#define PACING_START_MARGIN 1000000.0
+
+// how much each new oversleep changes the average (out of 1). this is the same kind of smoothing
+// tcp uses to estimate round trip times, a small weight ignores one-off spikes.
+#define PACING_WEIGHT 0.125
+
+static uint64_t s_period;        // nanoseconds between frames, 0 means pacing is off
+static uint64_t s_deadline;      // when the next frame should start
+static uint64_t s_lastFrame;     // when the last frame started
+static double s_oversleep;       // the average of how late sleeps wake up
+static double s_deviation;       // the average difference between an oversleep and the average
+static double s_margin;          // how long before the deadline to wake up
+static uint64_t s_frameCount;    // the number of frames that were paced
+static uint64_t s_lateCount;     // frames where the deadline was already missed after sleeping
+static uint64_t s_sleepTime;     // total time spent sleeping
+static uint64_t s_spinTime;      // total time spent spinning
+static double s_intervalMean;    // the mean time between frames
+static double s_intervalSquares; // the sum of squared differences from the mean (for the variance)
+
+void StartFramePacing(double rate)
+{
+	s_period = rate > 0.0 ? (uint64_t)(1e9 / rate) : 0;
+	s_deadline = 0;
+	s_lastFrame = 0;
+	s_oversleep = 0.0;
+	s_deviation = 0.0;
+	s_margin = PACING_START_MARGIN;
+	s_frameCount = 0;
+	s_lateCount = 0;
+	s_sleepTime = 0;
+	s_spinTime = 0;
+	s_intervalMean = 0.0;
+	s_intervalSquares = 0.0;
+
+	if (s_period)
+	{
+		printf("Limiting to %.2f fps (%.3f ms per frame)\n", rate, s_period / 1e6);
+	}
+}
+
+void PaceFrame(void)
+{
+	if (!s_period)
+	{
+		return;
+	}
+
+	uint64_t now = GetTime();
+	if (!s_deadline)
+	{
+		// the first frame doesn't wait, it just sets up the deadlines
+		s_deadline = now + s_period;
+		s_lastFrame = now;
+		return;
+	}
+
+	// if a frame took so long the deadline already passed, there's no point trying to catch up by
+	// rushing the next few frames, so the deadlines restart from now
+	if (now >= s_deadline)
+	{
+		s_deadline = now;
+	}
+
+	// sleep until the margin before the deadline, and measure how late the os woke the thread up
+	uint64_t wakeTime = s_deadline - (uint64_t)s_margin;
+	if (wakeTime > now)
+	{
+		SleepUntil(wakeTime);
+		uint64_t woke = GetTime();
+		s_sleepTime += woke - now;
+
+		// this is the same as how tcp estimates round trip time: a smoothed average, and a smoothed
+		// average of how far off it is. the margin is the average plus a few deviations, so almost
+		// every sleep wakes up before the deadline.
+		double oversleep = (double)(woke - wakeTime);
+		s_deviation += PACING_WEIGHT * (fabs(oversleep - s_oversleep) - s_deviation);
+		s_oversleep += PACING_WEIGHT * (oversleep - s_oversleep);
+		s_margin =
+			fmin(fmax(s_oversleep + 4.0 * s_deviation, PACING_MIN_MARGIN), PACING_MAX_MARGIN);
+
+		if (woke > s_deadline)
+		{
+			s_lateCount++;
+		}
+		now = woke;
+	}
+
+	// spin for the rest
+	uint64_t spinStart = now;
+	while (now < s_deadline)
+	{
+		now = GetTime();
+	}
+	s_spinTime += now - spinStart;
+
+	// welford's algorithm keeps a running mean and variance without storing every interval
+	double interval = (double)(now - s_lastFrame);
+	s_frameCount++;
+	double difference = interval - s_intervalMean;
+	s_intervalMean += difference / s_frameCount;
+	s_intervalSquares += difference * (interval - s_intervalMean);
+
+	s_lastFrame = now;
+	s_deadline += s_period;
+}
+
+void StopFramePacing(void)
+{
+	if (!s_period || !s_frameCount)
+	{
+		return;
+	}
+
+	double deviation = sqrt(s_intervalSquares / s_frameCount);
+	printf(
+		"Frame pacing: %" PRIu64 " frames, interval %.3f ms (target %.3f ms), deviation %.3f ms, "
+		"%" PRIu64 " late\n",
+		s_frameCount, s_intervalMean / 1e6, s_period / 1e6, deviation / 1e6, s_lateCount);
+	printf(
+		"  slept %.3f ms, spun %.3f ms, average oversleep %.3f ms, final margin %.3f ms\n",
+		s_sleepTime / 1e6, s_spinTime / 1e6, s_oversleep / 1e6, s_margin / 1e6);
+
+	s_period = 0;
+}
@@ -0,0 +1,38 @@
+// this file is the packer, a separate program that puts files in a .pak file (see pak.c). the
+// build runs it on the shaders, and the names they're stored under are the ones given here, so it
+// should be run from the directory the program loads them from. it can also benchmark the
+// compression on some files instead (see compress.c).
+
+#include "stuff.h"
+
+int32_t main(int32_t argc, char* argv[])
+{
+	const char* usage = "usage: %s [--compress] <output.pak> [files...]\n"
+						"       %s --benchmark <files...>";
+	if (argc < 2)
+	{
+		FatalError(usage, argv[0], argv[0]);
+	}
+
+	if (strcmp(argv[1], "--benchmark") == 0)
+	{
+		// decompressing in parallel uses the job threads
+		StartJobs(0);
+		for (int32_t i = 2; i < argc; i++)
+		{
+			BenchmarkCompression(argv[i]);
+		}
+		StopJobs();
+		return 0;
+	}
+
+	bool compress = strcmp(argv[1], "--compress") == 0;
+	int32_t first = compress ? 2 : 1;
+	if (argc <= first)
+	{
+		FatalError(usage, argv[0], argv[0]);
+	}
+	WritePak(
+		argv[first], (const char* const*)&argv[first + 1], (uint32_t)(argc - first - 1), compress);
+	return 0;
+}
@@ -0,0 +1,326 @@
+// this file implements .pak files, which are a bunch of files in one. opening a file costs a system
+// call or two (the os has to find it in its directory, check permissions, etc), which adds up with
+// a lot of files. so the packer (packer.c) puts them all in one file, which gets mapped once at
+// startup, and MapFile looks in it before looking for a loose file.
+//
+// a .pak file starts with a header, then a hash table of the files in it, then the files. the
+// table has a power of 2 number of slots and is at most half full, so a name's hash & (slot count
+// - 1) is the slot to start looking in, and the file is almost always in that slot or one of the
+// next few (linear probing). the names are in the table too, so a collision just means checking
+// the next slot.
+//
+// every file starts on a 4 KiB boundary, which is the size of a page, so reading one file doesn't
+// read in the end of the one before it, and its data is aligned enough for anything, including
+// uploading it to the gpu straight from the mapping.
+//
+// files can be compressed too (see compress.c), which the packer only does if it makes them
+// smaller. a compressed file can't be used straight from the mapping, so FindPakFile decompresses
+// it into memory of its own, with its blocks spread across the job threads. decompressing is faster
+// than most disks can read, so less to read is usually a win, but anything that needs to be used
+// straight from the mapping has to be packed without compression.
+//
+// everything is little endian, because every cpu this runs on is.
+
+#include "stuff.h"
+
+// the first 4 bytes of a .pak file
+#define PAK_MAGIC "GPAK"
+
+// changes whenever the format does
+#define PAK_VERSION 2
+
+// what every file's offset is a multiple of
+#define PAK_ALIGNMENT 4096
+
+// the most bytes a name can have, including the nul terminator. this makes an entry 128 bytes.
+#define PAK_NAME_SIZE 96
+
+// the start of the file
+typedef struct PakHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t fileCount;
+	uint32_t slotCount; // the number of slots in the hash table, a power of 2
+} PakHeader_t;
+
+// a slot in the hash table
+typedef struct PakEntry
+{
+	uint64_t hash;   // 0 if the slot is empty
+	uint64_t offset; // from the start of the .pak file
+	uint64_t size;
+	uint64_t storedSize; // less than size if it's compressed
+	char name[PAK_NAME_SIZE];
+} PakEntry_t;
+
+// FNV-1a, which is simple and good enough for names. 0 means an empty slot, so it's never 0.
+static uint64_t HashName(const char* name);
+
+// the .pak file that's open, and its hash table
+static MappedFile_t s_pak;
+static const char* s_pakName;
+static const PakEntry_t* s_table;
+static uint32_t s_slotCount;
+static atomic_uint s_readCount;         // the number of files that were found in it
+static atomic_uint s_decompressedCount; // the number of those that were compressed
+
+void WritePak(const char* outputName, const char* const* names, uint32_t count, bool compress)
+{
+	// the table has at least twice as many slots as files
+	uint32_t slotCount = 1;
+	while (slotCount < count * 2)
+	{
+		slotCount *= 2;
+	}
+	PakEntry_t* table = calloc(slotCount, sizeof(PakEntry_t));
+	uint64_t* offsets = calloc(count ? count : 1, sizeof(uint64_t));
+	MappedFile_t* files = calloc(count ? count : 1, sizeof(MappedFile_t));
+	uint64_t* storedSizes = calloc(count ? count : 1, sizeof(uint64_t));
+	uint8_t** compressed = calloc(count ? count : 1, sizeof(uint8_t*));
+	if (!table || !offsets || !files || !storedSizes || !compressed)
+	{
+		FatalError("failed to allocate the table for %u files!", count);
+	}
+
+	// the files go after the table in the order they were given
+	size_t tableEnd = sizeof(PakHeader_t) + slotCount * sizeof(PakEntry_t);
+	uint64_t offset = (tableEnd + PAK_ALIGNMENT - 1) / PAK_ALIGNMENT * PAK_ALIGNMENT;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		size_t nameLength = strlen(names[i]);
+		if (nameLength >= PAK_NAME_SIZE)
+		{
+			FatalError("%s has too long of a name to go in a .pak file!", names[i]);
+		}
+
+		files[i] = MapFile(names[i]);
+		storedSizes[i] = files[i].size;
+		if (compress && files[i].size)
+		{
+			// it's only kept compressed if that's smaller, including the table of block sizes
+			compressed[i] = malloc(
+				GetBlockCount(files[i].size) *
+				(sizeof(uint32_t) + GetCompressBound(COMPRESS_BLOCK_SIZE)));
+			if (!compressed[i])
+			{
+				FatalError("failed to allocate memory to compress %s!", names[i]);
+			}
+			size_t compressedSize = CompressBlocks(files[i].data, files[i].size, compressed[i]);
+			if (compressedSize < files[i].size)
+			{
+				storedSizes[i] = compressedSize;
+			}
+			else
+			{
+				free(compressed[i]);
+				compressed[i] = NULL;
+			}
+		}
+
+		offsets[i] = offset;
+		offset = (offset + storedSizes[i] + PAK_ALIGNMENT - 1) / PAK_ALIGNMENT * PAK_ALIGNMENT;
+
+		uint64_t hash = HashName(names[i]);
+		uint32_t slot = (uint32_t)hash & (slotCount - 1);
+		while (table[slot].hash)
+		{
+			if (table[slot].hash == hash && strcmp(table[slot].name, names[i]) == 0)
+			{
+				FatalError("%s is in the .pak file twice!", names[i]);
+			}
+			slot = (slot + 1) & (slotCount - 1);
+		}
+		table[slot].hash = hash;
+		table[slot].offset = offsets[i];
+		table[slot].size = files[i].size;
+		table[slot].storedSize = storedSizes[i];
+		memcpy(table[slot].name, names[i], nameLength + 1);
+	}
+
+	FILE* output = fopen(outputName, "wb");
+	if (!output)
+	{
+		FatalError("failed to open %s for writing!", outputName);
+	}
+
+	PakHeader_t header = {0};
+	memcpy(header.magic, PAK_MAGIC, sizeof(header.magic));
+	header.version = PAK_VERSION;
+	header.fileCount = count;
+	header.slotCount = slotCount;
+	fwrite(&header, sizeof(PakHeader_t), 1, output);
+	fwrite(table, sizeof(PakEntry_t), slotCount, output);
+
+	// the gaps between files are filled in with zeroes
+	static const uint8_t padding[PAK_ALIGNMENT] = {0};
+	uint64_t position = tableEnd;
+	uint64_t totalSize = 0;
+	uint32_t compressedCount = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		fwrite(padding, 1, (size_t)(offsets[i] - position), output);
+		if (compressed[i])
+		{
+			fwrite(compressed[i], 1, (size_t)storedSizes[i], output);
+			free(compressed[i]);
+			compressedCount++;
+		}
+		else
+		{
+			fwrite(files[i].data, 1, files[i].size, output);
+		}
+		position = offsets[i] + storedSizes[i];
+		totalSize += files[i].size;
+		UnmapFile(&files[i]);
+	}
+
+	if (ferror(output))
+	{
+		FatalError("failed to write %s!", outputName);
+	}
+	fclose(output);
+
+	printf(
+		"Packed %u files (%.2f KiB) into %s (%.2f KiB, %u table slots), %u of them compressed\n",
+		count, totalSize / 1024.0, outputName, position / 1024.0, slotCount, compressedCount);
+
+	free(compressed);
+	free(storedSizes);
+	free(files);
+	free(offsets);
+	free(table);
+}
+
+bool OpenPak(const char* name)
+{
+	// MapFile fails if the file doesn't exist, but the .pak file is optional
+	FILE* file = fopen(name, "rb");
+	if (!file)
+	{
+		return false;
+	}
+	fclose(file);
+
+	// the mapping is page aligned, so the header and table are aligned too
+	MappedFile_t pak = MapFile(name);
+	const PakHeader_t* header = pak.data;
+	if (pak.size < sizeof(PakHeader_t) || memcmp(header->magic, PAK_MAGIC, 4) != 0)
+	{
+		FatalError("%s isn't a .pak file!", name);
+	}
+	if (header->version != PAK_VERSION)
+	{
+		FatalError(
+			"%s is version %u, but version %u is needed! it has to be packed again.", name,
+			header->version, PAK_VERSION);
+	}
+
+	// everything gets checked once here, so looking things up doesn't have to. the table has to
+	// have an empty slot, or looking for something that isn't there would never stop.
+	uint32_t slotCount = header->slotCount;
+	if (!slotCount || (slotCount & (slotCount - 1)) || header->fileCount >= slotCount ||
+		pak.size < sizeof(PakHeader_t) + (uint64_t)slotCount * sizeof(PakEntry_t))
+	{
+		FatalError("%s has a broken table!", name);
+	}
+	const PakEntry_t* table = (const PakEntry_t*)(header + 1);
+	uint32_t fileCount = 0;
+	for (uint32_t i = 0; i < slotCount; i++)
+	{
+		if (!table[i].hash)
+		{
+			continue;
+		}
+		if (table[i].offset > pak.size || table[i].storedSize > pak.size - table[i].offset ||
+			table[i].storedSize > table[i].size || table[i].name[PAK_NAME_SIZE - 1] != 0)
+		{
+			FatalError("%s has a broken entry in slot %u!", name, i);
+		}
+		fileCount++;
+	}
+	if (fileCount != header->fileCount)
+	{
+		FatalError("%s has %u files in its table, not %u!", name, fileCount, header->fileCount);
+	}
+
+	s_pak = pak;
+	s_pakName = name;
+	s_table = table;
+	s_slotCount = slotCount;
+	atomic_store(&s_readCount, 0);
+	atomic_store(&s_decompressedCount, 0);
+
+	printf("Opened %s with %u files (%.2f KiB)\n", name, fileCount, pak.size / 1024.0);
+	return true;
+}
+
+void ClosePak(void)
+{
+	if (!s_table)
+	{
+		return;
+	}
+
+	printf(
+		"Read %u files from %s, %u of them compressed\n", atomic_load(&s_readCount), s_pakName,
+		atomic_load(&s_decompressedCount));
+	s_table = NULL;
+	s_slotCount = 0;
+	UnmapFile(&s_pak);
+}
+
+bool FindPakFile(const char* name, MappedFile_t* file)
+{
+	// the table doesn't change once it's open, so this can be used from any thread
+	if (!s_table)
+	{
+		return false;
+	}
+
+	uint64_t hash = HashName(name);
+	for (uint32_t slot = (uint32_t)hash & (s_slotCount - 1); s_table[slot].hash;
+		 slot = (slot + 1) & (s_slotCount - 1))
+	{
+		const PakEntry_t* entry = &s_table[slot];
+		if (entry->hash == hash && strcmp(entry->name, name) == 0)
+		{
+			const uint8_t* data = (const uint8_t*)s_pak.data + entry->offset;
+			file->data = entry->size ? (const void*)data : "";
+			file->size = (size_t)entry->size;
+			file->packed = true;
+			file->decompressed = NULL;
+			if (entry->storedSize < entry->size)
+			{
+				file->decompressed = malloc(file->size);
+				if (!file->decompressed)
+				{
+					FatalError("failed to allocate %zu bytes to decompress %s!", file->size, name);
+				}
+				if (!DecompressBlocks(data, entry->storedSize, file->decompressed, file->size))
+				{
+					FatalError("%s is broken in %s!", name, s_pakName);
+				}
+				file->data = file->decompressed;
+				atomic_fetch_add(&s_decompressedCount, 1);
+			}
+			atomic_fetch_add(&s_readCount, 1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static uint64_t HashName(const char* name)
+{
+	// each byte gets xored in and then multiplied by a big prime, which mixes it into every bit
+	// above it
+	uint64_t hash = 0xcbf29ce484222325;
+	for (const char* c = name; *c; c++)
+	{
+		hash ^= (uint8_t)*c;
+		hash *= 0x100000001b3;
+	}
+	return hash ? hash : 1;
+}
@@ -0,0 +1,518 @@
+// this file implements the software renderer. it works the way most gpus do internally (and the
+// way llvmpipe does), just much simpler since it only has to draw what vertex.glsl and
+// fragment.glsl draw: positions that are already in clip space, and colours interpolated across
+// triangles. depth testing, blending, and culling are off by default in opengl and main.c doesn't
+// turn them on, so they aren't implemented.
+//
+// a triangle covers a pixel if the pixel's centre is on the inside of all three of its edges. the
+// edge function of an edge is positive on one side and negative on the other, and it's linear, so
+// it can be evaluated for a bunch of pixels at once with simd instructions, which do the same thing
+// to 4 (sse) or 8 (avx) values at the same time.
+
+#include "stuff.h"
+
+// simd intrinsics are functions that compile to specific instructions. they're different for every
+// instruction set, so these wrappers give them the same names and the rest of the file doesn't need
+// to care which one it's using. avx2 is only used when the compiler is told to use it (otherwise
+// the program wouldn't run on cpus without it), sse2 is part of x86_64 so it's always there, and
+// anything else (like arm) gets plain c that does one pixel at a time.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_WIDTH 8
+#define SIMD_NAME  "avx2"
+typedef __m256 VecFloat_t;
+typedef __m256i VecInt_t;
+#define VecSet(x)           _mm256_set1_ps(x)
+#define VecRamp()           _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f)
+#define VecAdd(a, b)        _mm256_add_ps(a, b)
+#define VecMul(a, b)        _mm256_mul_ps(a, b)
+#define VecMin(a, b)        _mm256_min_ps(a, b)
+#define VecMax(a, b)        _mm256_max_ps(a, b)
+#define VecGreater(a, b)    _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_GT_OQ))
+#define VecGreaterEq(a, b)  _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_GE_OQ))
+#define VecToInt(a)         _mm256_cvtps_epi32(a)
+#define VecIntSet(x)        _mm256_set1_epi32(x)
+#define VecAnd(a, b)        _mm256_and_si256(a, b)
+#define VecAndNot(a, b)     _mm256_andnot_si256(a, b)
+#define VecOr(a, b)         _mm256_or_si256(a, b)
+#define VecShiftLeft(a, n)  _mm256_slli_epi32(a, n)
+#define VecAny(mask)        (_mm256_movemask_epi8(mask) != 0)
+#define VecLoad(pointer)    _mm256_loadu_si256((const __m256i*)(pointer))
+#define VecStore(pointer, a) _mm256_storeu_si256((__m256i*)(pointer), a)
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD_WIDTH 4
+#define SIMD_NAME  "sse2"
+typedef __m128 VecFloat_t;
+typedef __m128i VecInt_t;
+#define VecSet(x)           _mm_set1_ps(x)
+#define VecRamp()           _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)
+#define VecAdd(a, b)        _mm_add_ps(a, b)
+#define VecMul(a, b)        _mm_mul_ps(a, b)
+#define VecMin(a, b)        _mm_min_ps(a, b)
+#define VecMax(a, b)        _mm_max_ps(a, b)
+#define VecGreater(a, b)    _mm_castps_si128(_mm_cmpgt_ps(a, b))
+#define VecGreaterEq(a, b)  _mm_castps_si128(_mm_cmpge_ps(a, b))
+#define VecToInt(a)         _mm_cvtps_epi32(a)
+#define VecIntSet(x)        _mm_set1_epi32(x)
+#define VecAnd(a, b)        _mm_and_si128(a, b)
+#define VecAndNot(a, b)     _mm_andnot_si128(a, b)
+#define VecOr(a, b)         _mm_or_si128(a, b)
+#define VecShiftLeft(a, n)  _mm_slli_epi32(a, n)
+#define VecAny(mask)        (_mm_movemask_epi8(mask) != 0)
+#define VecLoad(pointer)    _mm_loadu_si128((const __m128i*)(pointer))
+#define VecStore(pointer, a) _mm_storeu_si128((__m128i*)(pointer), a)
+#else
+#define SIMD_WIDTH 1
+#define SIMD_NAME  "scalar"
+typedef float VecFloat_t;
+typedef int32_t VecInt_t;
+#define VecSet(x)           (x)
+#define VecRamp()           0.0f
+#define VecAdd(a, b)        ((a) + (b))
+#define VecMul(a, b)        ((a) * (b))
+#define VecMin(a, b)        ((a) < (b) ? (a) : (b))
+#define VecMax(a, b)        ((a) > (b) ? (a) : (b))
+#define VecGreater(a, b)    ((a) > (b) ? -1 : 0)
+#define VecGreaterEq(a, b)  ((a) >= (b) ? -1 : 0)
+#define VecToInt(a)         ((int32_t)((a) + 0.5f))
+#define VecIntSet(x)        (x)
+#define VecAnd(a, b)        ((a) & (b))
+#define VecAndNot(a, b)     (~(a) & (b))
+#define VecOr(a, b)         ((a) | (b))
+#define VecShiftLeft(a, n)  ((int32_t)((uint32_t)(a) << (n)))
+#define VecAny(mask)        ((mask) != 0)
+#define VecLoad(pointer)    (*(const int32_t*)(pointer))
+#define VecStore(pointer, a) (*(int32_t*)(pointer) = (a))
+#endif
+
+// the size of a tile in pixels. it has to be a multiple of SIMD_WIDTH. 64x64 rgba pixels is 16 KiB,
+// which fits in the l1 cache of most cpus.
+#define TILE_SIZE 64
+
+// a mesh given to the software renderer
+typedef struct SoftwareMesh
+{
+	Vertex_t* vertices;
+	uint32_t vertexCount;
+	Index_t* indices;
+	uint32_t indexCount;
+} SoftwareMesh_t;
+
+// a triangle that's been set up for drawing. everything that's interpolated across the triangle
+// is stored as a plane equation, value = a * x + b * y + c, so it's just a multiply and add to get
+// it at any pixel.
+typedef struct SoftwareTriangle
+{
+	float edgeA[3];
+	float edgeB[3];
+	float edgeC[3];
+	bool topLeft[3]; // which edges own pixels that are exactly on them, see SetupTriangle
+	float colourA[4];
+	float colourB[4];
+	float colourC[4];
+	int32_t minX; // the bounding box of the triangle, in pixels
+	int32_t minY;
+	int32_t maxX;
+	int32_t maxY;
+} SoftwareTriangle_t;
+
+// the triangles that touch a tile, in the order they were drawn
+typedef struct SoftwareBin
+{
+	uint32_t* triangles;
+	uint32_t count;
+	uint32_t capacity;
+} SoftwareBin_t;
+
+// set up a triangle from three vertices and sort it into the tiles it touches
+static void SetupTriangle(const Vertex_t* v0, const Vertex_t* v1, const Vertex_t* v2);
+
+// draw every triangle in a tile, this is what runs on the job threads
+static void DrawTile(void* data, uint32_t index);
+
+// add a value to the end of an array, growing it if needed
+static void* GrowArray(void* array, uint32_t* capacity, uint32_t count, size_t elementSize);
+
+static int32_t s_width;   // the size of the framebuffer
+static int32_t s_height;
+static int32_t s_stride;  // the number of pixels in a row of the framebuffer
+static int32_t s_tilesX;  // the number of tiles across
+static int32_t s_tilesY;  // the number of tiles down
+static uint32_t* s_framebuffer;
+static uint32_t s_clearColour;
+
+static SoftwareMesh_t* s_meshes;
+static uint32_t s_meshCount;
+static uint32_t s_meshCapacity;
+
+static SoftwareTriangle_t* s_triangles; // the triangles drawn this frame
+static uint32_t s_triangleCount;
+static uint32_t s_triangleCapacity;
+static SoftwareBin_t* s_bins; // one per tile
+
+static char s_name[64];
+
+void CreateSoftwareRenderer(int32_t width, int32_t height)
+{
+	s_width = width;
+	s_height = height;
+
+	// the framebuffer is padded out to a whole number of tiles, so tiles on the edge can be drawn
+	// without checking if every pixel is inside the framebuffer
+	s_tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	s_tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	s_stride = s_tilesX * TILE_SIZE;
+
+	size_t size = (size_t)s_stride * s_tilesY * TILE_SIZE * sizeof(uint32_t);
+	s_framebuffer = calloc(1, size);
+	s_bins = calloc((size_t)s_tilesX * s_tilesY, sizeof(SoftwareBin_t));
+	if (!s_framebuffer || !s_bins)
+	{
+		FatalError("failed to allocate %zu bytes!", size);
+	}
+
+	snprintf(
+		s_name, sizeof(s_name), "gldemo software (%s, %u threads)", SIMD_NAME,
+		GetJobThreadCount());
+	printf(
+		"Created %dx%d software renderer with %dx%d tiles (%s)\n", width, height, s_tilesX,
+		s_tilesY, SIMD_NAME);
+}
+
+void DestroySoftwareRenderer(void)
+{
+	for (uint32_t i = 0; i < s_meshCount; i++)
+	{
+		free(s_meshes[i].vertices);
+		free(s_meshes[i].indices);
+	}
+	free(s_meshes);
+	s_meshes = NULL;
+	s_meshCount = 0;
+	s_meshCapacity = 0;
+
+	for (int32_t i = 0; i < s_tilesX * s_tilesY; i++)
+	{
+		free(s_bins[i].triangles);
+	}
+	free(s_bins);
+	s_bins = NULL;
+	free(s_triangles);
+	s_triangles = NULL;
+	s_triangleCount = 0;
+	s_triangleCapacity = 0;
+
+	free(s_framebuffer);
+	s_framebuffer = NULL;
+	s_name[0] = 0;
+}
+
+uint32_t CreateSoftwareMesh(
+	const Vertex_t* vertices, uint32_t vertexCount, const Index_t* indices, uint32_t indexCount)
+{
+	s_meshes = GrowArray(s_meshes, &s_meshCapacity, s_meshCount, sizeof(SoftwareMesh_t));
+	SoftwareMesh_t* mesh = &s_meshes[s_meshCount];
+
+	// the data is copied, like glBufferData does
+	mesh->vertices = calloc(vertexCount, sizeof(Vertex_t));
+	mesh->indices = calloc(indexCount, sizeof(Index_t));
+	if (!mesh->vertices || !mesh->indices)
+	{
+		FatalError("failed to allocate software mesh!");
+	}
+	memcpy(mesh->vertices, vertices, vertexCount * sizeof(Vertex_t));
+	memcpy(mesh->indices, indices, indexCount * sizeof(Index_t));
+	mesh->vertexCount = vertexCount;
+	mesh->indexCount = indexCount;
+
+	return s_meshCount++;
+}
+
+void ClearSoftware(float red, float green, float blue, float alpha)
+{
+	// the clear happens when each tile is drawn, so it's done in parallel too
+	s_clearColour = (uint32_t)(red * 255.0f + 0.5f) | (uint32_t)(green * 255.0f + 0.5f) << 8 |
+					(uint32_t)(blue * 255.0f + 0.5f) << 16 | (uint32_t)(alpha * 255.0f + 0.5f) << 24;
+
+	s_triangleCount = 0;
+	for (int32_t i = 0; i < s_tilesX * s_tilesY; i++)
+	{
+		s_bins[i].count = 0;
+	}
+}
+
+void DrawSoftwareMesh(uint32_t mesh)
+{
+	const SoftwareMesh_t* softwareMesh = &s_meshes[mesh];
+	for (uint32_t i = 0; i < softwareMesh->indexCount; i++)
+	{
+		const uint32_t* index = softwareMesh->indices[i];
+		if (index[0] >= softwareMesh->vertexCount || index[1] >= softwareMesh->vertexCount ||
+			index[2] >= softwareMesh->vertexCount)
+		{
+			continue;
+		}
+
+		SetupTriangle(
+			&softwareMesh->vertices[index[0]], &softwareMesh->vertices[index[1]],
+			&softwareMesh->vertices[index[2]]);
+	}
+}
+
+void PresentSoftware(void)
+{
+	// every tile only touches its own pixels, so they can all be drawn at the same time
+	RunJobs(DrawTile, NULL, (uint32_t)(s_tilesX * s_tilesY));
+}
+
+const uint32_t* GetSoftwareFramebuffer(int32_t* stride)
+{
+	if (stride)
+	{
+		*stride = s_stride;
+	}
+	return s_framebuffer;
+}
+
+const char* GetSoftwareRendererName(void)
+{
+	return s_framebuffer ? s_name : NULL;
+}
+
+static void SetupTriangle(const Vertex_t* v0, const Vertex_t* v1, const Vertex_t* v2)
+{
+	// this is what vertex.glsl does, plus what the gpu does after it: the position is already in
+	// clip space with w = 1, so it only has to be scaled to pixels. the y is flipped, because the
+	// framebuffer starts at the top and clip space goes up.
+	const Vertex_t* vertices[3] = {v0, v1, v2};
+	float x[3];
+	float y[3];
+	for (int32_t i = 0; i < 3; i++)
+	{
+		x[i] = (vertices[i]->position[0] * 0.5f + 0.5f) * s_width;
+		y[i] = (0.5f - vertices[i]->position[1] * 0.5f) * s_height;
+	}
+
+	// the edge function for the edge from i to j is
+	// (x - xi) * (yj - yi) - (y - yi) * (xj - xi)
+	// which as a plane equation is a = yj - yi, b = xi - xj, c = -(a * xi + b * yi). edge k is the one
+	// that doesn't touch vertex k, so its value divided by the area is vertex k's weight.
+	SoftwareTriangle_t triangle = {0};
+	for (int32_t k = 0; k < 3; k++)
+	{
+		int32_t i = (k + 1) % 3;
+		int32_t j = (k + 2) % 3;
+		triangle.edgeA[k] = y[j] - y[i];
+		triangle.edgeB[k] = x[i] - x[j];
+		triangle.edgeC[k] = -(triangle.edgeA[k] * x[i] + triangle.edgeB[k] * y[i]);
+	}
+
+	// the area (times 2) is the edge function of one edge at the opposite vertex. its sign says
+	// which way the triangle is wound, which doesn't matter without culling, so the edges get
+	// flipped if needed to make the inside positive.
+	float area = triangle.edgeA[0] * x[0] + triangle.edgeB[0] * y[0] + triangle.edgeC[0];
+	if (area == 0.0f)
+	{
+		return;
+	}
+	if (area < 0.0f)
+	{
+		area = -area;
+		for (int32_t k = 0; k < 3; k++)
+		{
+			triangle.edgeA[k] = -triangle.edgeA[k];
+			triangle.edgeB[k] = -triangle.edgeB[k];
+			triangle.edgeC[k] = -triangle.edgeC[k];
+		}
+	}
+
+	// when two triangles share an edge, a pixel exactly on it should only be drawn by one of them.
+	// the shared edge goes in opposite directions in each triangle, so its a and b have opposite
+	// signs, and picking based on the sign gives it to exactly one of them (this is basically the
+	// "top-left rule" gpus use).
+	for (int32_t k = 0; k < 3; k++)
+	{
+		triangle.topLeft[k] = triangle.edgeA[k] > 0.0f ||
+							  (triangle.edgeA[k] == 0.0f && triangle.edgeB[k] > 0.0f);
+	}
+
+	// the colour at a pixel is the vertex colours weighted by the edge functions divided by the
+	// area, and adding plane equations together gives another plane equation
+	for (int32_t channel = 0; channel < 4; channel++)
+	{
+		for (int32_t k = 0; k < 3; k++)
+		{
+			float weight = vertices[k]->colour[channel] / area;
+			triangle.colourA[channel] += triangle.edgeA[k] * weight;
+			triangle.colourB[channel] += triangle.edgeB[k] * weight;
+			triangle.colourC[channel] += triangle.edgeC[k] * weight;
+		}
+	}
+
+	// the bounding box, clamped to the framebuffer. the +1 is because maxX/maxY are exclusive.
+	float minX = fminf(fminf(x[0], x[1]), x[2]);
+	float minY = fminf(fminf(y[0], y[1]), y[2]);
+	float maxX = fmaxf(fmaxf(x[0], x[1]), x[2]);
+	float maxY = fmaxf(fmaxf(y[0], y[1]), y[2]);
+	triangle.minX = minX < 0.0f ? 0 : (int32_t)minX;
+	triangle.minY = minY < 0.0f ? 0 : (int32_t)minY;
+	triangle.maxX = maxX >= s_width ? s_width : (int32_t)maxX + 1;
+	triangle.maxY = maxY >= s_height ? s_height : (int32_t)maxY + 1;
+	if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY)
+	{
+		return;
+	}
+
+	s_triangles = GrowArray(
+		s_triangles, &s_triangleCapacity, s_triangleCount, sizeof(SoftwareTriangle_t));
+	uint32_t triangleIndex = s_triangleCount++;
+	s_triangles[triangleIndex] = triangle;
+
+	// put it in every tile its bounding box touches, unless the tile is completely outside one of
+	// the edges. the corner of the tile that's the furthest inside an edge is the one in the
+	// direction of a and b, so if that corner is outside, the whole tile is.
+	int32_t firstTileX = triangle.minX / TILE_SIZE;
+	int32_t firstTileY = triangle.minY / TILE_SIZE;
+	int32_t lastTileX = (triangle.maxX - 1) / TILE_SIZE;
+	int32_t lastTileY = (triangle.maxY - 1) / TILE_SIZE;
+	for (int32_t tileY = firstTileY; tileY <= lastTileY; tileY++)
+	{
+		for (int32_t tileX = firstTileX; tileX <= lastTileX; tileX++)
+		{
+			bool outside = false;
+			for (int32_t k = 0; k < 3 && !outside; k++)
+			{
+				float cornerX = (float)(tileX * TILE_SIZE + (triangle.edgeA[k] > 0 ? TILE_SIZE : 0));
+				float cornerY = (float)(tileY * TILE_SIZE + (triangle.edgeB[k] > 0 ? TILE_SIZE : 0));
+				outside = triangle.edgeA[k] * cornerX + triangle.edgeB[k] * cornerY +
+							  triangle.edgeC[k] <
+						  0.0f;
+			}
+			if (outside)
+			{
+				continue;
+			}
+
+			SoftwareBin_t* bin = &s_bins[tileY * s_tilesX + tileX];
+			bin->triangles = GrowArray(bin->triangles, &bin->capacity, bin->count, sizeof(uint32_t));
+			bin->triangles[bin->count++] = triangleIndex;
+		}
+	}
+}
+
+static void DrawTile(void* data, uint32_t index)
+{
+	(void)data;
+
+	int32_t tileX = (int32_t)index % s_tilesX;
+	int32_t tileY = (int32_t)index / s_tilesX;
+	int32_t startX = tileX * TILE_SIZE;
+	int32_t startY = tileY * TILE_SIZE;
+	const SoftwareBin_t* bin = &s_bins[index];
+
+	// clear the tile
+	for (int32_t y = startY; y < startY + TILE_SIZE; y++)
+	{
+		uint32_t* row = s_framebuffer + (size_t)y * s_stride + startX;
+		for (int32_t x = 0; x < TILE_SIZE; x++)
+		{
+			row[x] = s_clearColour;
+		}
+	}
+
+	const VecFloat_t ramp = VecRamp();
+	const VecFloat_t zero = VecSet(0.0f);
+	const VecFloat_t one = VecSet(1.0f);
+	const VecFloat_t scale = VecSet(255.0f);
+
+	for (uint32_t i = 0; i < bin->count; i++)
+	{
+		const SoftwareTriangle_t* triangle = &s_triangles[bin->triangles[i]];
+
+		// the part of the triangle's bounding box in this tile. the x range gets rounded out to
+		// whole vectors, the extra pixels are outside the triangle so the edge functions mask them
+		// off anyway.
+		int32_t minX = triangle->minX > startX ? triangle->minX : startX;
+		int32_t minY = triangle->minY > startY ? triangle->minY : startY;
+		int32_t maxX = triangle->maxX < startX + TILE_SIZE ? triangle->maxX : startX + TILE_SIZE;
+		int32_t maxY = triangle->maxY < startY + TILE_SIZE ? triangle->maxY : startY + TILE_SIZE;
+		minX -= (minX - startX) % SIMD_WIDTH;
+
+		// the edges that own pixels on them use >=, the others use >. both comparisons are done and
+		// this mask picks between them.
+		VecInt_t ownsEdge[3];
+		for (int32_t k = 0; k < 3; k++)
+		{
+			ownsEdge[k] = VecIntSet(triangle->topLeft[k] ? -1 : 0);
+		}
+
+		for (int32_t y = minY; y < maxY; y++)
+		{
+			uint32_t* row = s_framebuffer + (size_t)y * s_stride;
+
+			// pixel centres are at +0.5
+			VecFloat_t pixelY = VecSet(y + 0.5f);
+			for (int32_t x = minX; x < maxX; x += SIMD_WIDTH)
+			{
+				VecFloat_t pixelX = VecAdd(VecSet(x + 0.5f), ramp);
+
+				VecInt_t inside = VecIntSet(-1);
+				for (int32_t k = 0; k < 3; k++)
+				{
+					VecFloat_t edge = VecAdd(
+						VecAdd(
+							VecMul(VecSet(triangle->edgeA[k]), pixelX),
+							VecMul(VecSet(triangle->edgeB[k]), pixelY)),
+						VecSet(triangle->edgeC[k]));
+					VecInt_t onInside = VecOr(
+						VecGreater(edge, zero), VecAnd(ownsEdge[k], VecGreaterEq(edge, zero)));
+					inside = VecAnd(inside, onInside);
+				}
+				if (!VecAny(inside))
+				{
+					continue;
+				}
+
+				// this is what fragment.glsl does, the interpolated colour gets written out. the
+				// colour gets clamped because pixels right on the edge can be slightly outside the
+				// triangle, and then each channel is converted to 0-255 and shifted into place.
+				VecInt_t colour = VecIntSet(0);
+				for (int32_t channel = 0; channel < 4; channel++)
+				{
+					VecFloat_t value = VecAdd(
+						VecAdd(
+							VecMul(VecSet(triangle->colourA[channel]), pixelX),
+							VecMul(VecSet(triangle->colourB[channel]), pixelY)),
+						VecSet(triangle->colourC[channel]));
+					value = VecMul(VecMin(VecMax(value, zero), one), scale);
+					colour = VecOr(colour, VecShiftLeft(VecToInt(value), channel * 8));
+				}
+
+				// only the pixels inside the triangle get replaced
+				VecInt_t old = VecLoad(row + x);
+				VecStore(row + x, VecOr(VecAnd(inside, colour), VecAndNot(inside, old)));
+			}
+		}
+	}
+}
+
+static void* GrowArray(void* array, uint32_t* capacity, uint32_t count, size_t elementSize)
+{
+	if (count < *capacity)
+	{
+		return array;
+	}
+
+	// doubling the size every time means the total amount of copying stays proportional to the
+	// number of elements
+	uint32_t newCapacity = *capacity ? *capacity * 2 : 16;
+	void* newArray = realloc(array, newCapacity * elementSize);
+	if (!newArray)
+	{
+		FatalError("failed to allocate %zu bytes!", newCapacity * elementSize);
+	}
+
+	*capacity = newCapacity;
+	return newArray;
+}
@@ -0,0 +1,626 @@
+// this file implements the render thread. without it, the main thread figures out what to draw and
+// then makes all the opengl calls to draw it, one after the other. opengl calls take a while though
+// (especially with a software driver like llvmpipe), so the main thread would be sitting around
+// waiting for them when it could be working on the next frame.
+//
+// instead, the main thread writes down what to draw in a frame packet and hands it off, and the
+// render thread (which is the only one that has the opengl context) makes the calls. there are two
+// packets, so the main thread can fill one in while the render thread is drawing the other one.
+
+#include "stuff.h"
+
+// two packets is enough for the main thread to be one frame ahead. more would just add latency.
+#define FRAME_PACKET_COUNT 2
+
+// the size of the streaming buffer, for all the frames together
+#define STREAM_BUFFER_SIZE (12 * 1024 * 1024)
+
+// what glMultiDrawElementsIndirect reads for each draw. it's the same as the parameters of
+// glDrawElementsInstancedBaseVertexBaseInstance.
+typedef struct DrawElementsIndirectCommand
+{
+	uint32_t count;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t baseInstance;
+} DrawElementsIndirectCommand_t;
+
+// draw the packet
+static void ExecuteFramePacket(const FramePacket_t* packet);
+
+// draw some ranges of a draw's indices with one call
+static void DrawRanges(const FramePacket_t* packet, const DrawCommand_t* draw, size_t indexSize);
+
+// group the batched draws in a packet, and write their commands and transforms
+static void BuildBatches(FramePacket_t* packet);
+
+// whether two draws can be in the same batch
+static bool CanBatch(const DrawCommand_t* first, const DrawCommand_t* draw);
+
+// draw a batch with one call
+static void DrawBatch(const FramePacket_t* packet, const DrawBatch_t* batch);
+
+// what the render thread runs
+static void RenderThread(void* data);
+
+static FramePacket_t s_packets[FRAME_PACKET_COUNT];
+static bool s_ready[FRAME_PACKET_COUNT]; // whether a packet is waiting to be drawn
+static uint32_t s_buildIndex;            // the packet the main thread fills in next
+static uint32_t s_renderIndex;           // the packet the render thread draws next
+
+static bool s_threaded;
+static bool s_stopping;
+static Thread_t s_thread;
+static Mutex_t s_mutex;
+static Condition_t s_readyCondition; // signalled when a packet is ready to be drawn
+static Condition_t s_doneCondition;  // signalled when a packet has been drawn
+
+// the last shader that was used, to know when a new one needs its uniform block set up
+static uint32_t s_lastShader;
+
+// the arrays glMultiDrawElementsBaseVertex takes for drawing ranges, on the render thread
+static int32_t* s_multiCounts;
+static void** s_multiOffsets;
+static int32_t* s_multiBaseVertices;
+static uint32_t s_multiCapacity;
+
+// how many draws there were, how many opengl draw calls they took, and how long the render thread
+// spent issuing them, for comparing batching with not batching
+static uint64_t s_frameCount;
+static uint64_t s_drawCount;
+static uint64_t s_drawCallCount;
+static uint64_t s_submitTime;
+
+void StartRenderer(bool threaded)
+{
+	s_threaded = threaded;
+	s_stopping = false;
+	s_buildIndex = 0;
+	s_renderIndex = 0;
+	s_lastShader = 0;
+	memset(s_ready, 0, sizeof(s_ready));
+	s_frameCount = 0;
+	s_drawCount = 0;
+	s_drawCallCount = 0;
+	s_submitTime = 0;
+
+	// the streaming buffer is made here while this thread still has the context
+	StartStreamBuffer(STREAM_BUFFER_SIZE);
+
+	if (!s_threaded)
+	{
+		// the state cache doesn't know what anything before this did
+		InvalidateGlState();
+		printf("Rendering on the main thread\n");
+		return;
+	}
+
+	InitMutex(&s_mutex);
+	InitCondition(&s_readyCondition);
+	InitCondition(&s_doneCondition);
+
+	// the context has to be let go of here before the render thread can take it
+	MakeGlContextCurrent(false);
+	s_thread = StartThread(RenderThread, NULL, "Render thread");
+
+	printf("Started render thread with %u frame packets\n", FRAME_PACKET_COUNT);
+}
+
+void StopRenderer(void)
+{
+	if (s_threaded)
+	{
+		// the render thread finishes any packets that are left before it stops
+		LockMutex(&s_mutex);
+		s_stopping = true;
+		SignalCondition(&s_readyCondition);
+		UnlockMutex(&s_mutex);
+		JoinThread(s_thread);
+
+		DestroyCondition(&s_doneCondition);
+		DestroyCondition(&s_readyCondition);
+		DestroyMutex(&s_mutex);
+
+		// the main thread needs the context back to clean up
+		MakeGlContextCurrent(true);
+		s_threaded = false;
+	}
+
+	StopStreamBuffer();
+	PrintGlStateStats();
+	if (s_frameCount)
+	{
+		printf(
+			"Draws: %.1f draws in %.1f draw calls per frame (%.1f%% fewer calls), %.3f ms "
+			"submitting them per frame\n",
+			(double)s_drawCount / s_frameCount, (double)s_drawCallCount / s_frameCount,
+			s_drawCount ? 100.0 * (s_drawCount - s_drawCallCount) / s_drawCount : 0.0,
+			s_submitTime / 1e6 / s_frameCount);
+	}
+
+	for (uint32_t i = 0; i < FRAME_PACKET_COUNT; i++)
+	{
+		free(s_packets[i].draws);
+		free(s_packets[i].ranges);
+		free(s_packets[i].batches);
+		memset(&s_packets[i], 0, sizeof(FramePacket_t));
+	}
+
+	free(s_multiCounts);
+	free(s_multiOffsets);
+	free(s_multiBaseVertices);
+	s_multiCounts = NULL;
+	s_multiOffsets = NULL;
+	s_multiBaseVertices = NULL;
+	s_multiCapacity = 0;
+}
+
+FramePacket_t* BeginFramePacket(void)
+{
+	FramePacket_t* packet = &s_packets[s_buildIndex];
+
+	// if the render thread is still drawing this packet, the main thread is too far ahead and has
+	// to wait
+	if (s_threaded)
+	{
+		LockMutex(&s_mutex);
+		while (s_ready[s_buildIndex])
+		{
+			WaitCondition(&s_doneCondition, &s_mutex);
+		}
+		UnlockMutex(&s_mutex);
+	}
+
+	// the packet's uniforms go in the next region of the streaming buffer
+	BeginStreamFrame();
+
+	// the draw list's memory is kept between frames, so it stops allocating once it's big enough
+	packet->width = GetWindowWidth();
+	packet->height = GetWindowHeight();
+	packet->drawCount = 0;
+	packet->rangeCount = 0;
+	packet->batchCount = 0;
+	packet->resetGpuProfiler = false;
+	return packet;
+}
+
+void SetDrawMesh(DrawCommand_t* draw, const Mesh_t* mesh)
+{
+	draw->vertexArray = mesh->vertexArray;
+	draw->indexCount = mesh->indices.count;
+	draw->indexType = mesh->indexType;
+	draw->firstIndex = mesh->indices.offset;
+	draw->baseVertex = (int32_t)mesh->vertices.offset;
+	memcpy(draw->quantization, mesh->quantization, sizeof(draw->quantization));
+}
+
+void AddDraw(FramePacket_t* packet, const DrawCommand_t* draw)
+{
+	if (packet->drawCount >= packet->drawCapacity)
+	{
+		uint32_t capacity = packet->drawCapacity ? packet->drawCapacity * 2 : 16;
+		DrawCommand_t* draws = realloc(packet->draws, capacity * sizeof(DrawCommand_t));
+		if (!draws)
+		{
+			FatalError("failed to allocate %zu bytes!", capacity * sizeof(DrawCommand_t));
+		}
+		packet->draws = draws;
+		packet->drawCapacity = capacity;
+	}
+
+	// the uniforms go in the streaming buffer, so the render thread can bind them without copying
+	// them anywhere. batched draws' uniforms go in later, next to the rest of their batch's.
+	DrawCommand_t* added = &packet->draws[packet->drawCount++];
+	*added = *draw;
+	if (draw->batched)
+	{
+		added->uniformOffset = 0;
+		return;
+	}
+	StreamAllocation_t stream = AllocateStream(sizeof(DrawUniforms_t), GetStreamUniformAlignment());
+	DrawUniforms_t* uniforms = stream.data;
+	memcpy(uniforms->transform, draw->transform, sizeof(draw->transform));
+	memcpy(uniforms->quantization, draw->quantization, sizeof(draw->quantization));
+	added->uniformOffset = stream.offset;
+}
+
+void AddDrawRanges(
+	FramePacket_t* packet, const DrawCommand_t* draw, const IndexRange_t* ranges,
+	uint32_t rangeCount)
+{
+	if (!rangeCount)
+	{
+		return;
+	}
+
+	if (packet->rangeCount + rangeCount > packet->rangeCapacity)
+	{
+		uint32_t capacity = packet->rangeCapacity ? packet->rangeCapacity : 64;
+		while (capacity < packet->rangeCount + rangeCount)
+		{
+			capacity *= 2;
+		}
+		IndexRange_t* newRanges = realloc(packet->ranges, capacity * sizeof(IndexRange_t));
+		if (!newRanges)
+		{
+			FatalError("failed to allocate %zu bytes!", capacity * sizeof(IndexRange_t));
+		}
+		packet->ranges = newRanges;
+		packet->rangeCapacity = capacity;
+	}
+
+	DrawCommand_t ranged = *draw;
+	ranged.firstRange = packet->rangeCount;
+	ranged.rangeCount = rangeCount;
+	memcpy(packet->ranges + packet->rangeCount, ranges, rangeCount * sizeof(IndexRange_t));
+	packet->rangeCount += rangeCount;
+	AddDraw(packet, &ranged);
+}
+
+void AddDrawInstanced(
+	FramePacket_t* packet, const DrawCommand_t* draw, const InstanceBuffer_t* instances,
+	uint32_t instanceCount)
+{
+	if (!instanceCount)
+	{
+		return;
+	}
+	if (instanceCount > instances->count)
+	{
+		FatalError(
+			"can't draw %u instances from an instance buffer with %u!", instanceCount,
+			instances->count);
+	}
+
+	// the transform still goes in the streaming buffer like any other draw, but only once for all
+	// the instances
+	// instanced draws can't be batched, because batches use the instance to find the draw
+	DrawCommand_t instanced = *draw;
+	instanced.vertexArray = instances->vertexArray;
+	instanced.instanceCount = instanceCount;
+	instanced.batched = false;
+	AddDraw(packet, &instanced);
+}
+
+void AddDrawGpuCulled(
+	FramePacket_t* packet, const DrawCommand_t* draw, const GpuCullScene_t* scene)
+{
+	// the draws come from the gpu, so there's no batching, but the transform gets streamed like
+	// any other draw's
+	DrawCommand_t culled = *draw;
+	culled.vertexArray = scene->vertexArray;
+	culled.indexType = scene->indexType;
+	memcpy(culled.quantization, scene->quantization, sizeof(culled.quantization));
+	culled.cullScene = scene;
+	culled.batched = false;
+	AddDraw(packet, &culled);
+}
+
+void SubmitFramePacket(FramePacket_t* packet)
+{
+	// this is on the main thread, so it can write to the streaming buffer
+	CPU_ZONE_BEGIN("BuildBatches");
+	BuildBatches(packet);
+	CPU_ZONE_END();
+
+	if (!s_threaded)
+	{
+		ExecuteFramePacket(packet);
+		return;
+	}
+
+	LockMutex(&s_mutex);
+	s_ready[s_buildIndex] = true;
+	SignalCondition(&s_readyCondition);
+	UnlockMutex(&s_mutex);
+
+	s_buildIndex = (s_buildIndex + 1) % FRAME_PACKET_COUNT;
+}
+
+static void ExecuteFramePacket(const FramePacket_t* packet)
+{
+	CPU_ZONE_BEGIN("ExecuteFramePacket");
+
+	// anything that's done loading in the background gets uploaded here, because this is the
+	// thread with the context
+	CPU_ZONE_BEGIN("FinishLoads");
+	FinishLoads();
+	CPU_ZONE_END();
+
+	// the viewport is the area that gets rendered to, the scissor is the area of it that's visible.
+	// these and the other Set functions skip the call if the value is the same as last time.
+	SetViewport(0, 0, packet->width, packet->height);
+	SetScissor(0, 0, packet->width, packet->height);
+
+	// zones measure how long the gpu spends on the commands in them, if --gpu-profile was given.
+	// the profiler is only touched on this thread, so resetting it comes through the packet.
+	if (packet->resetGpuProfiler)
+	{
+		ResetGpuProfiler();
+	}
+	BeginGpuZone("Clear");
+
+	// glClearColor and glClearDepth set the clear value for those buffers, glClear clears the
+	// specified buffers
+	SetClearColour(
+		packet->clearColour[0], packet->clearColour[1], packet->clearColour[2],
+		packet->clearColour[3]);
+	SetClearDepth(1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	EndGpuZone();
+	BeginGpuZone("Draws");
+
+	uint64_t submitStart = GetTime();
+	uint32_t nextBatch = 0;
+	for (uint32_t i = 0; i < packet->drawCount; i++)
+	{
+		const DrawCommand_t* draw = &packet->draws[i];
+
+		// batches are in the same order as their draws
+		if (nextBatch < packet->batchCount && packet->batches[nextBatch].firstDraw == i)
+		{
+			const DrawBatch_t* batch = &packet->batches[nextBatch++];
+			DrawBatch(packet, batch);
+			i += batch->drawCount - 1;
+			continue;
+		}
+
+		// use the shader program. uniforms are values that are the same for everything in a draw,
+		// and these ones are in a uniform block, which reads them from a buffer. the block has to
+		// be told which binding point to read from, 0 in this case.
+		// gpu culled draws run the compute shader, and then draw what it wrote
+		if (draw->cullScene)
+		{
+			CullGpuScene(draw->cullScene, draw->uniformOffset);
+			DrawGpuScene(draw->cullScene, draw->shader, draw->cullBackFaces);
+			s_drawCallCount++;
+			continue;
+		}
+
+		SetProgram(draw->shader);
+		if (draw->shader != s_lastShader)
+		{
+			s_lastShader = draw->shader;
+			uint32_t block = glGetUniformBlockIndex(draw->shader, "Draw");
+			if (block != GL_INVALID_INDEX)
+			{
+				glUniformBlockBinding(draw->shader, block, 0);
+			}
+		}
+		SetBufferRange(
+			GL_UNIFORM_BUFFER, 0, GetStreamBuffer(), draw->uniformOffset, sizeof(DrawUniforms_t));
+
+		// bind the vertex array, and cull the back faces if the draw wants that
+		SetVertexArray(draw->vertexArray);
+		SetCapability(GL_CULL_FACE, draw->cullBackFaces);
+		// draw the mesh
+		// parameters:
+		// type of face to draw
+		// number of indices (should be faces * verts per face)
+		// the data type of the indices (16 or 32 bit, whichever the mesh has)
+		// the offset into the index buffer, in bytes
+		// the base vertex, which gets added to each index
+		size_t indexSize =
+			draw->indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+		s_drawCallCount++;
+		if (draw->rangeCount)
+		{
+			DrawRanges(packet, draw, indexSize);
+			continue;
+		}
+		if (draw->instanceCount)
+		{
+			// the same as below, but the mesh gets drawn instanceCount times, and the instance
+			// attributes move on to the next instance each time
+			glDrawElementsInstancedBaseVertex(
+				GL_TRIANGLES, (int32_t)draw->indexCount, draw->indexType,
+				(void*)(draw->firstIndex * indexSize), (int32_t)draw->instanceCount,
+				draw->baseVertex);
+			continue;
+		}
+		glDrawElementsBaseVertex(
+			GL_TRIANGLES, (int32_t)draw->indexCount, draw->indexType,
+			(void*)(draw->firstIndex * indexSize), draw->baseVertex);
+	}
+	s_submitTime += GetTime() - submitStart;
+	s_drawCount += packet->drawCount;
+	s_frameCount++;
+
+	EndGpuZone();
+
+	CPU_ZONE_BEGIN("CaptureFrame");
+	CaptureFrame(); // reads it back if --capture was given (this has to be before presenting,
+					// because the backbuffer's contents are gone after swapping)
+	CPU_ZONE_END();
+	CPU_ZONE_BEGIN("Present");
+	Present(); // presenting just means putting whatever you drew onto the screen
+	CPU_ZONE_END();
+	CPU_ZONE_BEGIN("FenceStreamFrame");
+	FenceStreamFrame(); // waits if the gpu is too far behind
+	CPU_ZONE_END();
+	EndGpuFrame();     // reads the gpu profiler's results from a few frames ago
+	EndGlStateFrame(); // counts how many calls the state cache skipped
+
+	CPU_ZONE_END();
+}
+
+static void DrawRanges(const FramePacket_t* packet, const DrawCommand_t* draw, size_t indexSize)
+{
+	if (draw->rangeCount > s_multiCapacity)
+	{
+		s_multiCapacity = draw->rangeCount;
+		s_multiCounts = realloc(s_multiCounts, s_multiCapacity * sizeof(int32_t));
+		s_multiOffsets = realloc(s_multiOffsets, s_multiCapacity * sizeof(void*));
+		s_multiBaseVertices = realloc(s_multiBaseVertices, s_multiCapacity * sizeof(int32_t));
+		if (!s_multiCounts || !s_multiOffsets || !s_multiBaseVertices)
+		{
+			FatalError("failed to allocate memory for %u draw ranges!", draw->rangeCount);
+		}
+	}
+
+	// this is the same as a glDrawElementsBaseVertex for each range, but it's one call, so the
+	// driver only has to check the state once
+	for (uint32_t i = 0; i < draw->rangeCount; i++)
+	{
+		const IndexRange_t* range = &packet->ranges[draw->firstRange + i];
+		s_multiCounts[i] = (int32_t)range->indexCount;
+		s_multiOffsets[i] = (void*)((draw->firstIndex + range->firstIndex) * indexSize);
+		s_multiBaseVertices[i] = draw->baseVertex;
+	}
+	glMultiDrawElementsBaseVertex(
+		GL_TRIANGLES, s_multiCounts, draw->indexType, (const void* const*)s_multiOffsets,
+		(int32_t)draw->rangeCount, s_multiBaseVertices);
+}
+
+static void BuildBatches(FramePacket_t* packet)
+{
+	packet->batchCount = 0;
+	for (uint32_t i = 0; i < packet->drawCount;)
+	{
+		const DrawCommand_t* first = &packet->draws[i];
+		if (!first->batched)
+		{
+			i++;
+			continue;
+		}
+
+		// only draws next to each other get batched, so everything still gets drawn in the same
+		// order
+		uint32_t end = i + 1;
+		uint32_t commandCount = first->rangeCount ? first->rangeCount : 1;
+		while (end < packet->drawCount && end - i < DRAW_BATCH_MAX &&
+			   CanBatch(first, &packet->draws[end]))
+		{
+			commandCount += packet->draws[end].rangeCount ? packet->draws[end].rangeCount : 1;
+			end++;
+		}
+
+		if (packet->batchCount >= packet->batchCapacity)
+		{
+			uint32_t capacity = packet->batchCapacity ? packet->batchCapacity * 2 : 16;
+			DrawBatch_t* batches = realloc(packet->batches, capacity * sizeof(DrawBatch_t));
+			if (!batches)
+			{
+				FatalError("failed to allocate %zu bytes!", capacity * sizeof(DrawBatch_t));
+			}
+			packet->batches = batches;
+			packet->batchCapacity = capacity;
+		}
+
+		// each draw's uniforms go in an array, and its commands use the draw's place in the array
+		// as their base instance. the vertex array has an attribute with one number for each
+		// instance, which is the instance's number, so the shader gets the base instance (the draw
+		// index) from it, and reads the uniforms with it.
+		StreamAllocation_t commands = AllocateStream(
+			commandCount * sizeof(DrawElementsIndirectCommand_t), sizeof(uint32_t));
+		StreamAllocation_t transforms =
+			AllocateStream((end - i) * sizeof(DrawUniforms_t), GetStreamStorageAlignment());
+		DrawElementsIndirectCommand_t* command = commands.data;
+		DrawUniforms_t* uniforms = transforms.data;
+		for (uint32_t j = i; j < end; j++)
+		{
+			const DrawCommand_t* draw = &packet->draws[j];
+			memcpy(uniforms[j - i].transform, draw->transform, sizeof(draw->transform));
+			memcpy(uniforms[j - i].quantization, draw->quantization, sizeof(draw->quantization));
+
+			uint32_t rangeCount = draw->rangeCount ? draw->rangeCount : 1;
+			for (uint32_t k = 0; k < rangeCount; k++)
+			{
+				command->count = draw->indexCount;
+				command->firstIndex = draw->firstIndex;
+				if (draw->rangeCount)
+				{
+					const IndexRange_t* range = &packet->ranges[draw->firstRange + k];
+					command->count = range->indexCount;
+					command->firstIndex += range->firstIndex;
+				}
+				command->instanceCount = 1;
+				command->baseVertex = draw->baseVertex;
+				command->baseInstance = j - i;
+				command++;
+			}
+		}
+
+		DrawBatch_t* batch = &packet->batches[packet->batchCount++];
+		batch->firstDraw = i;
+		batch->drawCount = end - i;
+		batch->commandCount = commandCount;
+		batch->commandOffset = commands.offset;
+		batch->transformOffset = transforms.offset;
+		i = end;
+	}
+}
+
+static bool CanBatch(const DrawCommand_t* first, const DrawCommand_t* draw)
+{
+	return draw->batched && draw->shader == first->shader &&
+		   draw->vertexArray == first->vertexArray && draw->indexType == first->indexType &&
+		   draw->cullBackFaces == first->cullBackFaces;
+}
+
+static void DrawBatch(const FramePacket_t* packet, const DrawBatch_t* batch)
+{
+	const DrawCommand_t* first = &packet->draws[batch->firstDraw];
+
+	// the vertex array's draw index attribute has to go up to the last draw in the batch. this
+	// changes vertex arrays the first time a batch is bigger than before, so it goes first.
+	ReserveDrawIndices(batch->drawCount);
+
+	// the same state as a single draw, except the transforms are a storage buffer, and the
+	// commands come from the indirect buffer
+	SetProgram(first->shader);
+	SetBufferRange(
+		GL_SHADER_STORAGE_BUFFER, 0, GetStreamBuffer(), batch->transformOffset,
+		batch->drawCount * sizeof(DrawUniforms_t));
+	SetVertexArray(first->vertexArray);
+	SetCapability(GL_CULL_FACE, first->cullBackFaces);
+	SetBuffer(GL_DRAW_INDIRECT_BUFFER, GetStreamBuffer());
+
+	// parameters:
+	// type of face to draw
+	// the data type of the indices
+	// the offset of the first command in the indirect buffer, in bytes
+	// the number of commands
+	// the stride between commands (0 means they're right next to each other)
+	glMultiDrawElementsIndirect(
+		GL_TRIANGLES, first->indexType, (void*)batch->commandOffset,
+		(int32_t)batch->commandCount, 0);
+	s_drawCallCount++;
+}
+
+static void RenderThread(void* data)
+{
+	(void)data;
+
+	MakeGlContextCurrent(true);
+	InvalidateGlState();
+
+	LockMutex(&s_mutex);
+	while (true)
+	{
+		while (!s_ready[s_renderIndex] && !s_stopping)
+		{
+			WaitCondition(&s_readyCondition, &s_mutex);
+		}
+		if (!s_ready[s_renderIndex])
+		{
+			// stopping, and there's nothing left to draw
+			break;
+		}
+
+		// the main thread won't touch a packet that's ready, so the mutex doesn't need to be held
+		// while drawing it
+		UnlockMutex(&s_mutex);
+		ExecuteFramePacket(&s_packets[s_renderIndex]);
+		LockMutex(&s_mutex);
+
+		s_ready[s_renderIndex] = false;
+		s_renderIndex = (s_renderIndex + 1) % FRAME_PACKET_COUNT;
+		SignalCondition(&s_doneCondition);
+	}
+	UnlockMutex(&s_mutex);
+
+	MakeGlContextCurrent(false);
+}
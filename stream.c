@@ -0,0 +1,220 @@
+// this file implements a streaming buffer, for data that changes every frame. the usual way to
+// update a buffer is glBufferData or glBufferSubData, but the driver has to copy the data somewhere
+// first, and if the gpu is still using the buffer it either has to wait or secretly make a new one.
+//
+// a persistent mapping is a pointer to the buffer's memory that stays valid forever, so data can be
+// written straight into it, by any thread. the catch is that nothing stops the cpu from writing
+// over something the gpu hasn't read yet. so the buffer is split into a region for each frame, and
+// a fence after each frame's draws says when the gpu is done with that frame's region.
+//
+// there are 3 regions: one the main thread is filling in, one the render thread is drawing, and one
+// the gpu can still be working on. the render thread waits for the oldest one to be done after
+// drawing each frame, which only actually waits if the gpu is more than a frame behind.
+
+#include "stuff.h"
+
+// the number of regions
+#define STREAM_REGIONS 3
+
+// a frame's region
+typedef struct StreamRegion
+{
+	size_t start;
+	GLsync fence; // signalled when the gpu is done with this region, or NULL
+} StreamRegion_t;
+
+static uint32_t s_buffer;
+static uint8_t* s_memory;
+static size_t s_regionSize;
+static StreamRegion_t s_regions[STREAM_REGIONS];
+static size_t s_uniformAlignment;
+static size_t s_storageAlignment;
+
+// the main thread's side, the region being filled in and how much of it is used
+static uint32_t s_writeRegion;
+static size_t s_writeOffset;
+static size_t s_peakUsage; // the most any frame has used
+
+// the render thread's side, the region being drawn
+static uint32_t s_fenceRegion;
+static uint64_t s_stallCount; // the number of times the gpu wasn't done with a region
+static uint64_t s_stallTime;  // how long the render thread spent waiting for it
+
+void StartStreamBuffer(size_t size)
+{
+	// glBufferStorage is from opengl 4.4, it's the only way to make a buffer that can stay mapped
+	if (!GLAD_GL_VERSION_4_4 && !GLAD_GL_ARB_buffer_storage)
+	{
+		FatalError("the streaming buffer needs OpenGL 4.4 or GL_ARB_buffer_storage!");
+	}
+
+	// every region starts at a multiple of the uniform and storage alignments (which are powers of
+	// 2, so the bigger one is a multiple of the other), so the first allocation in a region is
+	// always aligned
+	int32_t alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	s_uniformAlignment = alignment > 0 ? (size_t)alignment : 256;
+	alignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	s_storageAlignment = alignment > 0 ? (size_t)alignment : 256;
+	size_t regionAlignment =
+		s_uniformAlignment > s_storageAlignment ? s_uniformAlignment : s_storageAlignment;
+	s_regionSize = size / STREAM_REGIONS / regionAlignment * regionAlignment;
+
+	glGenBuffers(1, &s_buffer);
+	SetBuffer(GL_COPY_WRITE_BUFFER, s_buffer);
+
+	// persistent means it can be used while it's mapped, and coherent means writes show up for the
+	// gpu without having to flush them
+	uint32_t flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glBufferStorage(GL_COPY_WRITE_BUFFER, s_regionSize * STREAM_REGIONS, NULL, flags);
+	s_memory = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, s_regionSize * STREAM_REGIONS, flags);
+	SetBuffer(GL_COPY_WRITE_BUFFER, 0);
+	if (!s_memory)
+	{
+		FatalError("failed to map streaming buffer: %d!", glGetError());
+	}
+	glObjectLabel(GL_BUFFER, s_buffer, 16, "Streaming buffer");
+
+	for (uint32_t i = 0; i < STREAM_REGIONS; i++)
+	{
+		s_regions[i].start = i * s_regionSize;
+		s_regions[i].fence = NULL;
+	}
+	s_writeRegion = STREAM_REGIONS - 1;
+	s_writeOffset = 0;
+	s_fenceRegion = 0;
+	s_peakUsage = 0;
+	s_stallCount = 0;
+	s_stallTime = 0;
+
+	printf(
+		"Created %u streaming buffer regions of %.2f KiB\n", STREAM_REGIONS, s_regionSize / 1024.0);
+}
+
+void StopStreamBuffer(void)
+{
+	if (!s_buffer)
+	{
+		return;
+	}
+
+	s_peakUsage = s_writeOffset > s_peakUsage ? s_writeOffset : s_peakUsage;
+	printf(
+		"Streaming buffer: peak %.2f KiB of %.2f KiB per frame, waited for the GPU %" PRIu64
+		" times (%.3f ms)\n",
+		s_peakUsage / 1024.0, s_regionSize / 1024.0, s_stallCount, s_stallTime / 1e6);
+
+	for (uint32_t i = 0; i < STREAM_REGIONS; i++)
+	{
+		if (s_regions[i].fence)
+		{
+			glDeleteSync(s_regions[i].fence);
+			s_regions[i].fence = NULL;
+		}
+	}
+
+	SetBuffer(GL_COPY_WRITE_BUFFER, s_buffer);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	SetBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &s_buffer);
+	s_buffer = 0;
+	s_memory = NULL;
+}
+
+uint32_t GetStreamBuffer(void)
+{
+	return s_buffer;
+}
+
+size_t GetStreamUniformAlignment(void)
+{
+	return s_uniformAlignment;
+}
+
+size_t GetStreamStorageAlignment(void)
+{
+	return s_storageAlignment;
+}
+
+void BeginStreamFrame(void)
+{
+	if (!s_buffer)
+	{
+		return;
+	}
+
+	// there's no waiting here, the render thread already made sure the gpu is done with the
+	// region before the main thread can start another frame
+	s_peakUsage = s_writeOffset > s_peakUsage ? s_writeOffset : s_peakUsage;
+	s_writeRegion = (s_writeRegion + 1) % STREAM_REGIONS;
+	s_writeOffset = 0;
+}
+
+StreamAllocation_t AllocateStream(size_t size, size_t alignment)
+{
+	if (!s_buffer)
+	{
+		FatalError("the streaming buffer hasn't been created!");
+	}
+
+	// alignment has to be a power of 2, so rounding up is adding alignment - 1 and clearing the
+	// bits below it
+	size_t offset = s_writeOffset;
+	if (alignment > 1)
+	{
+		offset = (offset + alignment - 1) & ~(alignment - 1);
+	}
+	if (offset + size > s_regionSize)
+	{
+		FatalError(
+			"the streaming buffer ran out of space (%zu bytes needed, %zu used of %zu)!", size,
+			s_writeOffset, s_regionSize);
+	}
+	s_writeOffset = offset + size;
+
+	StreamAllocation_t allocation;
+	allocation.offset = s_regions[s_writeRegion].start + offset;
+	allocation.data = s_memory + allocation.offset;
+	allocation.buffer = s_buffer;
+	return allocation;
+}
+
+void FenceStreamFrame(void)
+{
+	if (!s_buffer)
+	{
+		return;
+	}
+
+	// the fence goes after everything that used this frame's region
+	StreamRegion_t* region = &s_regions[s_fenceRegion];
+	region->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	s_fenceRegion = (s_fenceRegion + 1) % STREAM_REGIONS;
+
+	// the region after the next one is the oldest, and the main thread could start on it as soon
+	// as this frame is done. checking with a timeout of 0 first means stalls can be counted.
+	StreamRegion_t* oldest = &s_regions[(s_fenceRegion + 1) % STREAM_REGIONS];
+	if (!oldest->fence)
+	{
+		return;
+	}
+	uint32_t result = glClientWaitSync(oldest->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		uint64_t start = GetTime();
+		s_stallCount++;
+		while (result == GL_TIMEOUT_EXPIRED)
+		{
+			result = glClientWaitSync(oldest->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		}
+		s_stallTime += GetTime() - start;
+	}
+	if (result == GL_WAIT_FAILED)
+	{
+		FatalError("failed to wait for streaming buffer fence: %d!", glGetError());
+	}
+
+	glDeleteSync(oldest->fence);
+	oldest->fence = NULL;
+}
@@ -15,9 +15,13 @@
 
 // these are standard headers, people typically include all the ones they use in
 // the whole project in one header somewhere
+#include <float.h>    // FLT_MAX and other limits of floats
 #include <inttypes.h> // uint32_t and stuff
+#include <math.h>     // sqrtf, fminf, and other maths functions
 #include <stdarg.h> // for variadic functions (functions that take a variable number of arguments, like printf)
+#include <stdatomic.h> // atomic variables, which multiple threads can change at the same time safely
 #include <stdbool.h> // bool and true/false
+#include <stddef.h>  // offsetof, for where a member of a struct is
 #include <stdio.h>   // printf and files
 #include <stdlib.h>  // miscellaneous stuff
 #include <string.h>  // string functions, also memset/memcpy (they're here because
@@ -33,6 +37,18 @@
 	1                // excludes obscure stuff that doesn't matter, it
 					 // matters so little i don't even know what it excludes
 #include <windows.h> // has everything for windows almost
+#else
+// these are posix/linux headers, the equivalent of windows.h is split across a bunch of them
+#include <dlfcn.h>  // dlopen and dlsym, like LoadLibrary and GetProcAddress
+#include <errno.h>  // error codes like EINTR
+#include <fcntl.h>  // open
+#include <signal.h> // signal handlers, the closest thing to a window being closed on a headless box
+#include <time.h>   // clock_gettime
+#include <pthread.h> // threads, mutexes, and condition variables
+#include <sched.h>   // sched_getaffinity, for counting cpus
+#include <unistd.h>  // sysconf and other random posix stuff
+#include <sys/mman.h> // mmap, for mapping files into memory
+#include <sys/stat.h> // fstat, for getting the size of a file
 #endif
 
 // these are other headers, people usually use quotes instead of angle brackets for non-system ones
@@ -43,7 +59,13 @@
 // windows and you can directly use it) it has autogenerated opengl headers generated from an xml
 // version of the specification that khronos maintains
 #include "glad/gl.h"
+#ifdef _WIN32
 #include "glad/wgl.h"
+#else
+// egl is the linux (and android and everything else) equivalent of wgl, except it can also make
+// contexts that don't have a window at all
+#include "glad/egl.h"
+#endif
 
 // function declarations, basically it's the first line of the function and the extern keyword.
 // although it's technically not always necessary, you should use extern
@@ -52,7 +74,11 @@
 // should write void in the brackets, because the compiler can't assume it has no arguments if you
 // don't put it, because of ancient pre-standard code
 
-// win32.c
+// win32.c/linux.c
+
+// these are implemented once per platform, and only the one for the platform being compiled for is
+// built (see CMakeLists.txt). linux.c is headless, the "window" is a framebuffer object that has
+// the same size a window would.
 
 // for functions that are critical to the program being successful, it is common
 // to exit the program from within the function when it fails rather than
@@ -71,6 +97,10 @@ extern void CreateGlContext(void);
 // update the window
 extern bool Update(void);
 
+// a context can only be current on one thread at a time, so to use it on another thread, it has to
+// be made not current first
+extern void MakeGlContextCurrent(bool current);
+
 // swap the framebuffer and the backbuffer
 extern void Present(void);
 
@@ -80,6 +110,81 @@ extern int32_t GetWindowWidth(void);
 // get the window height
 extern int32_t GetWindowHeight(void);
 
+// threads let multiple things happen at the same time. each platform has its own types for them, so
+// these typedefs give them one name. a mutex makes sure only one thread at a time can do something,
+// and a condition variable lets a thread sleep until another one tells it something changed.
+#ifdef _WIN32
+typedef HANDLE Thread_t;
+typedef SRWLOCK Mutex_t;
+typedef CONDITION_VARIABLE Condition_t;
+#else
+typedef pthread_t Thread_t;
+typedef pthread_mutex_t Mutex_t;
+typedef pthread_cond_t Condition_t;
+#endif
+
+// thread local variables have a separate copy for every thread. msvc has its own way of saying it.
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+// the function a thread runs, data is whatever was given to StartThread
+typedef void (*ThreadFunction_t)(void* data);
+
+// get the number of cpus (including hyperthreads) the program can use
+extern uint32_t GetCpuCount(void);
+
+// start a thread that runs function(data). the name shows up in debuggers and profilers.
+extern Thread_t StartThread(ThreadFunction_t function, void* data, const char* name);
+
+// wait for a thread to return
+extern void JoinThread(Thread_t thread);
+
+// mutex functions
+extern void InitMutex(Mutex_t* mutex);
+extern void DestroyMutex(Mutex_t* mutex);
+extern void LockMutex(Mutex_t* mutex);
+extern void UnlockMutex(Mutex_t* mutex);
+
+// condition variable functions. waiting unlocks the mutex while sleeping, and locks it again
+// before returning. it can wake up without being signalled, so it should always be in a loop that
+// checks whatever is being waited for.
+extern void InitCondition(Condition_t* condition);
+extern void DestroyCondition(Condition_t* condition);
+extern void WaitCondition(Condition_t* condition, Mutex_t* mutex);
+extern void SignalCondition(Condition_t* condition);
+extern void BroadcastCondition(Condition_t* condition);
+
+// a read only view of a whole file. reading a file normally copies it from the os's file cache into
+// a buffer, but a mapping is the file cache's pages themselves, so nothing gets copied, and pages
+// only get read from disk the first time they're touched. the data can be given straight to things
+// like glBufferData. it isn't nul terminated, LoadFile is for things that need that.
+typedef struct MappedFile
+{
+	const void* data; // an empty string for an empty file, so it's never NULL
+	size_t size;
+	bool packed; // it's part of the .pak file's mapping, see pak.c
+	void* decompressed; // it was compressed in the .pak file, and this is where it got decompressed
+} MappedFile_t;
+
+// map a whole file, from the .pak file if it's in there. the os is told it'll be read from start
+// to end and to start reading it in right away, so it reads ahead of wherever it's being read.
+extern MappedFile_t MapFile(const char* name);
+
+// unmap a file, data can't be used after this
+extern void UnmapFile(MappedFile_t* file);
+
+// get the current time in nanoseconds. it's relative to some arbitrary point (like boot), so it's
+// only useful for measuring how long something took, but it never goes backwards, even if the
+// system clock gets changed
+extern uint64_t GetTime(void);
+
+// sleep until GetTime would return time. the os can wake it up late (by anything from a few
+// microseconds to a few milliseconds), but never early.
+extern void SleepUntil(uint64_t time);
+
 // misc.c
 
 // in newer versions of C, the _Noreturn keyword lets you say a function doesn't
@@ -92,10 +197,275 @@ extern int32_t GetWindowHeight(void);
 // show an error message (this function works like printf)
 extern void FatalError(const char* format, ...);
 
-// read a file
+// read a file into a buffer with a nul terminator after it (which isn't included in size), for text
+// that needs one. the buffer has to be freed. MapFile is better for anything that doesn't.
 extern void* LoadFile(const char* name, size_t* size);
 
-// opengl.c
+// benchmark.c
+
+// the benchmark mode runs a fixed number of frames and measures how long they took. warmup frames
+// are drawn first and not measured, because the first few frames are usually slower (the driver
+// compiles shaders lazily, memory gets paged in, caches are cold, etc).
+
+// start measuring frames. startTime is when the program started, for measuring startup time.
+// if frameCount is 0, the benchmark functions don't do anything.
+extern void StartBenchmark(uint32_t frameCount, uint32_t warmupCount, uint64_t startTime);
+
+// call right before drawing a frame. returns true for the first frame that gets measured, which is
+// when the gpu profiler's averages should start over.
+extern bool BeginBenchmarkFrame(void);
+
+// call right after presenting a frame, returns false once enough frames have been measured
+extern bool EndBenchmarkFrame(void);
+
+// wait for the gpu to finish, calculate the results, print them, and write them to outputName as
+// json (if it isn't NULL)
+extern void FinishBenchmark(const char* outputName);
+
+// capture.c
+
+// capturing reads every frame back from the gpu and writes it to a file. reading pixels normally
+// makes the cpu wait for the gpu to finish drawing, so this copies them into a ring of pixel buffer
+// objects instead, and only looks at each one a few frames later when it's definitely done. a
+// separate thread writes the frames out so the disk doesn't slow down rendering either.
+//
+// if the name ends in .y4m, the frames are written as a yuv4mpeg2 video (which ffmpeg and most
+// video players understand), otherwise they're ppm images. if the name has a printf-style number
+// in it (like frame%04u.ppm), every frame gets its own file, otherwise they're all in one.
+
+// start capturing frames, ringSize is the number of pixel buffers (at least 3)
+extern void StartCapture(const char* outputName, uint32_t ringSize);
+
+// read back the current frame, call it after drawing and before presenting
+extern void CaptureFrame(void);
+
+// finish writing all the frames, and print how fast it was
+extern void StopCapture(void);
+
+// jobs.c
+
+// a job is called with the data given to RunJobs and the index of the job
+typedef void (*JobFunction_t)(void* data, uint32_t index);
+
+// start the job threads, 0 means one per cpu
+extern void StartJobs(uint32_t threadCount);
+
+// stop the job threads
+extern void StopJobs(void);
+
+// get the number of threads that run jobs
+extern uint32_t GetJobThreadCount(void);
+
+// call function(data, i) for every i from 0 to count - 1 on the job threads, and wait for all of
+// them to finish. jobs can't call RunJobs themselves.
+extern void RunJobs(JobFunction_t function, void* data, uint32_t count);
+
+// compress.c
+
+// files are compressed in separate blocks of this size, so they can be decompressed in parallel
+#define COMPRESS_BLOCK_SIZE (64 * 1024)
+
+// the most CompressBlock can write for size bytes, which is a bit more than size
+extern size_t GetCompressBound(size_t size);
+
+// get the number of blocks a file of size bytes gets compressed in
+extern uint32_t GetBlockCount(size_t size);
+
+// compress a block of at most COMPRESS_BLOCK_SIZE bytes into output, which needs room for
+// GetCompressBound(size) bytes. returns the compressed size.
+extern size_t CompressBlock(const uint8_t* input, size_t size, uint8_t* output);
+
+// decompress a block into exactly outputSize bytes, returns false if it's broken
+extern bool DecompressBlock(
+	const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputSize);
+
+// compress a whole file in blocks, output needs room for GetBlockCount(size) * (4 +
+// GetCompressBound(COMPRESS_BLOCK_SIZE)) bytes. returns the compressed size, which is at most 4
+// bytes per block bigger than size if it doesn't compress at all.
+extern size_t CompressBlocks(const uint8_t* input, size_t size, uint8_t* output);
+
+// decompress a file that was compressed by CompressBlocks into exactly outputSize bytes, with the
+// blocks spread across the job threads. returns false if it's broken.
+extern bool DecompressBlocks(
+	const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputSize);
+
+// compress a file, decompress it on one thread and on the job threads, and print how fast it was
+extern void BenchmarkCompression(const char* name);
+
+// pak.c
+
+// put files in a .pak file, under the names they're given by. with compress, files that get
+// smaller are stored compressed (see compress.c).
+extern void WritePak(
+	const char* outputName, const char* const* names, uint32_t count, bool compress);
+
+// map a .pak file, after which MapFile (and LoadFile) look in it before looking for a loose file.
+// returns false if it doesn't exist.
+extern bool OpenPak(const char* name);
+
+// unmap the .pak file, nothing that came from it can be used after this
+extern void ClosePak(void);
+
+// look for a file in the .pak file, returns false if it isn't in there or there isn't one open.
+// compressed files get decompressed into memory that UnmapFile frees.
+extern bool FindPakFile(const char* name, MappedFile_t* file);
+
+// loader.c
+
+// loads happen in two parts. the load function runs on a loader thread, and does everything that
+// doesn't need opengl (reading files, building meshes, etc). then the finish function runs on the
+// thread with the opengl context, and uploads whatever the load function made.
+
+// runs on a loader thread, returns whatever gets given to the finish function. long loads should
+// check the request's cancelled flag now and then, and stop early if it's set.
+typedef void* (*LoadFunction_t)(void* data);
+
+// runs on the thread with the opengl context. if the load was cancelled while it was loading,
+// cancelled is true and it should only free the result (which is NULL if the load function didn't
+// get to run).
+typedef void (*FinishLoadFunction_t)(void* data, void* result, bool cancelled);
+
+// what a load is doing
+typedef enum LoadState
+{
+	LoadStateNone,      // it hasn't been queued
+	LoadStateQueued,    // it's waiting for a loader thread
+	LoadStateLoading,   // a loader thread is running the load function
+	LoadStateLoaded,    // it's waiting to be finished on the context thread
+	LoadStateDone,      // it's finished, and whatever it loaded can be used
+	LoadStateCancelled, // it was cancelled, and the finish function has cleaned up if it had to
+} LoadState_t;
+
+// a load. whatever queues it owns it, and it has to stay around until it's done or cancelled. the
+// first part gets filled in before QueueLoad, the rest is for the loader.
+typedef struct LoadRequest
+{
+	const char* name; // for printing
+	LoadFunction_t load;
+	FinishLoadFunction_t finish;
+	void* data;       // given to both functions
+	int32_t priority; // higher priorities get loaded first
+
+	void* result;
+	uint64_t queueTime;
+	atomic_uint state; // a LoadState_t
+	atomic_bool cancelled;    // set if the program is stopping while it loads
+	struct LoadRequest* next; // the next one in the completion queue
+} LoadRequest_t;
+
+// start the loader threads
+extern void StartLoader(void);
+
+// cancel everything that isn't done, and stop the loader threads. this has to be called on the
+// context thread, because it finishes any cancelled loads that need cleaning up.
+extern void StopLoader(void);
+
+// queue a load
+extern void QueueLoad(LoadRequest_t* request);
+
+// get what a load is doing, whatever it loaded can be used once this is LoadStateDone
+extern LoadState_t GetLoadState(const LoadRequest_t* request);
+
+// run the finish functions of everything that's been loaded, on the context thread
+extern void FinishLoads(void);
+
+// wait for everything that's been queued to load, and then finish it, on the context thread
+extern void WaitForLoads(void);
+
+// cpuprofile.c
+
+// the cpu profiler records how long the code between CPU_ZONE_BEGIN and CPU_ZONE_END takes, on
+// every thread, and writes it as a chrome trace (open it in chrome://tracing or ui.perfetto.dev).
+// zones can be nested, and the names have to be string literals.
+//
+// the macros are used instead of the functions so they can be compiled out completely by turning
+// off GLDEMO_PROFILE in cmake. when it's on but the profiler isn't started, a zone is just a
+// function call and a branch.
+#ifdef GLDEMO_PROFILE
+#define CPU_ZONE_BEGIN(name) BeginCpuZone(name)
+#define CPU_ZONE_END() EndCpuZone()
+#else
+#define CPU_ZONE_BEGIN(name) ((void)0)
+#define CPU_ZONE_END() ((void)0)
+#endif
+
+// start profiling, the trace is written to outputName when it stops
+extern void StartCpuProfiler(const char* outputName);
+
+// write the trace and stop profiling, every other thread has to be stopped first
+extern void StopCpuProfiler(void);
+
+// set the name the current thread has in the trace (StartThread does this)
+extern void NameCpuProfilerThread(const char* name);
+
+// start a zone
+extern void BeginCpuZone(const char* name);
+
+// end the current thread's most recent zone
+extern void EndCpuZone(void);
+
+// write everything that's been recorded so far, this can be called at any time
+extern void WriteCpuTrace(const char* outputName);
+
+// pacing.c
+
+// frame pacing limits the frame rate by waiting at the end of every frame until it's time for the
+// next one, instead of drawing as fast as possible and using a whole cpu for nothing. it sleeps for
+// most of the wait, then spins for the last bit because sleeping isn't precise.
+
+// start limiting to rate frames per second (0 means no limit)
+extern void StartFramePacing(double rate);
+
+// wait until it's time for the next frame
+extern void PaceFrame(void);
+
+// print how well the pacing went
+extern void StopFramePacing(void);
+
+// gpuprofile.c
+
+// the gpu profiler measures how long the gpu spends on the commands between BeginGpuZone and
+// EndGpuZone. the results are a few frames behind, because waiting for them would make the cpu wait
+// for the gpu. zones can be nested, and the same name can be used more than once in a frame (the
+// times get added up). the names have to stay valid, so they should be string literals.
+//
+// zones are also debug groups, so they show up in tools like renderdoc.
+
+// start profiling, the zone functions don't do anything until this is called
+extern void StartGpuProfiler(void);
+
+// stop profiling and delete the queries
+extern void StopGpuProfiler(void);
+
+// start a zone
+extern void BeginGpuZone(const char* name);
+
+// end the most recent zone
+extern void EndGpuZone(void);
+
+// call this after presenting
+extern void EndGpuFrame(void);
+
+// wait for every frame's results, only do this after glFinish
+extern void FlushGpuProfiler(void);
+
+// reset the averages, and ignore frames from before this. like the other functions, this has to
+// be called on the thread with the context (the render thread, when there is one).
+extern void ResetGpuProfiler(void);
+
+// get the number of different zones there have been
+extern uint32_t GetGpuZoneCount(void);
+
+// get the name of a zone
+extern const char* GetGpuZoneName(uint32_t zone);
+
+// get how long a zone took in the most recent frame that has results, in milliseconds
+extern double GetGpuZoneTime(uint32_t zone);
+
+// get the average time a zone took since the last reset, in milliseconds
+extern double GetGpuZoneAverage(uint32_t zone);
+
+// vertexformat.c
 
 // a vertex
 //
@@ -106,19 +476,740 @@ typedef struct Vertex
 {
 	float position[3];
 	float colour[4];
+	float normal[3]; // doesn't have to be normalized, (0, 0, 0) means it faces the camera
 } Vertex_t;
 
-// create a vertex buffer
-extern uint32_t CreateVertexBuffer(const Vertex_t* vertices, uint32_t vertexCount);
+// vertex formats say how vertices are stored on the gpu. the float format is the same as Vertex_t
+// without the normal, the others are smaller: half floats or normalized 16 bit integers for
+// positions, 8 bits per colour channel, and octahedral encoded normals. positions that aren't
+// floats are quantized: they're stored relative to the mesh's bounds, between -1 and 1, and the
+// vertex shader puts them back (see GetVertexQuantization).
+
+// what an attribute is, this is also its location in the shader
+typedef enum VertexSemantic
+{
+	VertexSemanticPosition,
+	VertexSemanticColour,
+	VertexSemanticNormal,
+	VertexSemanticInstanceTransform, // these two come from an instance buffer, see instance.c
+	VertexSemanticInstanceColour,
+	VertexSemanticDrawIndex, // which draw in a batch a vertex is from, see render.c
+} VertexSemantic_t;
+
+// how an attribute is stored. normalized integers (snorm and unorm) get mapped to [-1, 1] and
+// [0, 1] in the shader, and octahedral is a normal encoded as 2 snorm components.
+typedef enum VertexType
+{
+	VertexTypeFloat,
+	VertexTypeHalf,
+	VertexTypeSnorm16,
+	VertexTypeUnorm16,
+	VertexTypeSnorm8,
+	VertexTypeUnorm8,
+	VertexTypeOctahedral16,
+	VertexTypeOctahedral8,
+} VertexType_t;
+
+// one part of a vertex
+typedef struct VertexAttribute
+{
+	VertexSemantic_t semantic;
+	VertexType_t type;
+	uint32_t components;
+	uint32_t offset; // in bytes, from the start of the vertex
+} VertexAttribute_t;
+
+// the most attributes a format can have
+#define VERTEX_MAX_ATTRIBUTES 8
+
+// a vertex format
+typedef struct VertexFormat
+{
+	const char* name;
+	uint32_t attributeCount;
+	uint32_t stride; // the size of a vertex
+	VertexAttribute_t attributes[VERTEX_MAX_ATTRIBUTES];
+} VertexFormat_t;
+
+// the formats there are
+typedef enum VertexFormatId
+{
+	VertexFormatFloat,   // float position and colour, 28 bytes
+	VertexFormatHalf,    // half float position and 8 bit colour, 12 bytes
+	VertexFormatSnorm16, // 16 bit normalized position and 8 bit colour, 12 bytes
+	VertexFormatLit,     // half float position, octahedral normal, and 8 bit colour, 16 bytes
+	VertexFormatCount,
+} VertexFormatId_t;
+
+// get a format
+extern const VertexFormat_t* GetVertexFormat(VertexFormatId_t id);
+
+// get a format by its name, or NULL if there isn't one with that name
+extern const VertexFormat_t* FindVertexFormat(const char* name);
+
+// call glVertexAttribPointer for each attribute, the vertex array and buffer have to be bound
+extern void SetVertexAttributes(const VertexFormat_t* format);
+
+// work out how a mesh's positions get stored in a format. they're stored as (position - xyz) / w,
+// where xyz is the middle of the bounding box and w is half of its biggest side, so they're between
+// -1 and 1. for float positions it's (0, 0, 0, 1), which doesn't change them.
+extern void GetVertexQuantization(
+	const VertexFormat_t* format, const Vertex_t* vertices, uint32_t vertexCount,
+	float quantization[4]);
+
+// pack vertices into a format, with their positions quantized by quantization
+extern void ConvertVertices(
+	const VertexFormat_t* format, const Vertex_t* vertices, uint32_t vertexCount,
+	const float quantization[4], void* output);
+
+// bufferpool.c
+
+// buffer pools put lots of meshes in a few big buffers, so drawing different meshes doesn't mean
+// binding different buffers. the space is handed out by a buddy allocator, which rounds everything
+// up to a power of 2 elements.
+
+// a piece of a pool. offset and count are in elements (vertices or indices), not bytes, because
+// that's what the draw functions take.
+typedef struct BufferAllocation
+{
+	uint32_t buffer;
+	uint32_t offset;
+	uint32_t count;
+} BufferAllocation_t;
+
+// put count elements of stride bytes in a pool for target (GL_ARRAY_BUFFER or
+// GL_ELEMENT_ARRAY_BUFFER). a new pool is made if none of them have space, and it's bigger than
+// normal if count is too big for a normal one.
+extern BufferAllocation_t AllocateBuffer(
+	uint32_t target, uint32_t stride, const void* data, uint32_t count);
+
+// give an allocation's space back to its pool
+extern void FreeBuffer(BufferAllocation_t* allocation);
+
+// get the vertex array for a pair of pools and a format, it gets made the first time
+extern uint32_t GetSharedVertexArray(
+	const VertexFormat_t* format, uint32_t vertexBuffer, uint32_t indexBuffer);
+
+// make sure the shared vertex arrays' draw index attribute goes up to at least count (which can't
+// be more than DRAW_BATCH_MAX), for drawing a batch of that many draws
+extern void ReserveDrawIndices(uint32_t count);
+
+// print how full and fragmented the pools are
+extern void PrintBufferPoolStats(void);
+
+// delete the pools and their vertex arrays
+extern void DestroyBufferPools(void);
+
+// opengl.c
+
+// convert vertices to a format and put them in a vertex pool
+extern BufferAllocation_t CreateVertexBuffer(
+	const VertexFormat_t* format, const Vertex_t* vertices, uint32_t vertexCount,
+	const float quantization[4]);
 
 // indices basically are indices into a vertex buffer that form faces of a mesh
 typedef uint32_t Index_t[3];
 
-// create an index buffer
-extern uint32_t CreateIndexBuffer(const Index_t* indices, uint32_t indexCount);
+// create an index buffer, in an index pool. indexCount is the number of triangles. the indices are
+// stored as 16 bits if they fit, and indexType is set to GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+extern BufferAllocation_t CreateIndexBuffer(
+	const Index_t* indices, uint32_t indexCount, uint32_t* indexType);
 
 // create a vertex array object
-extern uint32_t CreateVertexArray(uint32_t vertexBuffer, uint32_t indexBuffer);
+extern uint32_t CreateVertexArray(
+	const VertexFormat_t* format, uint32_t vertexBuffer, uint32_t indexBuffer);
+
+// a mesh's vertices and indices, and the vertex array to draw them with. to draw it, the index
+// count is indices.count, the first index is indices.offset, and the base vertex (which gets added
+// to every index) is vertices.offset.
+typedef struct Mesh
+{
+	const VertexFormat_t* format;
+	BufferAllocation_t vertices;
+	BufferAllocation_t indices;
+	uint32_t indexType; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	uint32_t vertexArray;
+	float quantization[4]; // how the positions are stored, see GetVertexQuantization
+} Mesh_t;
+
+// upload a mesh in a format, indexCount is the number of triangles
+extern Mesh_t CreateMesh(
+	const VertexFormat_t* format, const Vertex_t* vertices, uint32_t vertexCount,
+	const Index_t* indices, uint32_t indexCount);
+
+// free a mesh's space in the pools
+extern void DestroyMesh(Mesh_t* mesh);
 
 // load and compile a shader program
 extern uint32_t LoadShaders(const char* vertexName, const char* fragmentName);
+
+// compile a shader program from files that have already been mapped, the names are for errors
+extern uint32_t CreateShaderProgram(
+	const char* vertexName, const MappedFile_t* vertexSource, const char* fragmentName,
+	const MappedFile_t* fragmentSource);
+
+// a shader program that's being loaded in the background. the files get mapped on a loader thread,
+// and compiled on the context thread.
+typedef struct ShaderLoad
+{
+	LoadRequest_t request;
+	const char* vertexName;
+	const char* fragmentName;
+	MappedFile_t vertexFile;
+	MappedFile_t fragmentFile;
+	uint32_t program;
+} ShaderLoad_t;
+
+// queue a shader program to be loaded in the background
+extern void QueueLoadShaders(
+	ShaderLoad_t* load, const char* vertexName, const char* fragmentName, int32_t priority);
+
+// get a shader program that was loaded in the background, or 0 if it isn't done
+extern uint32_t GetLoadedShaders(const ShaderLoad_t* load);
+
+// load and compile a compute shader program
+extern uint32_t LoadComputeShader(const char* name);
+
+// instance.c
+
+// what's different about each copy of a mesh in an instanced draw. the transform works like a
+// DrawCommand_t's, and gets applied before the draw's. the colour gets multiplied with the
+// vertices' colours.
+typedef struct Instance
+{
+	float transform[4];
+	float colour[4];
+} Instance_t;
+
+// instances on the gpu, and a vertex array that reads them along with a mesh's vertices
+typedef struct InstanceBuffer
+{
+	uint32_t buffer;
+	uint32_t count;
+	uint32_t vertexArray;
+} InstanceBuffer_t;
+
+// upload instances of a mesh. the vertex array only works for that mesh (or others in the same
+// pools with the same format).
+extern InstanceBuffer_t CreateInstanceBuffer(
+	const Mesh_t* mesh, const Instance_t* instances, uint32_t instanceCount);
+
+// delete an instance buffer and its vertex array
+extern void DestroyInstanceBuffer(InstanceBuffer_t* instanceBuffer);
+
+// meshopt.c
+
+// a mesh on the cpu, before it's uploaded. indexCount is the number of triangles, like everywhere
+// else.
+typedef struct MeshData
+{
+	Vertex_t* vertices;
+	uint32_t vertexCount;
+	Index_t* indices;
+	uint32_t indexCount;
+} MeshData_t;
+
+// how much optimizing a mesh helped. acmr is misses / triangles, and atvr is misses / vertices.
+typedef struct MeshOptimizeStats
+{
+	uint64_t triangleCount;
+	uint64_t vertexCountBefore; // only counting vertices that are used
+	uint64_t vertexCountAfter;
+	uint64_t missesBefore; // vertex cache misses
+	uint64_t missesAfter;
+	uint64_t clusterCount;
+	uint64_t time;
+} MeshOptimizeStats_t;
+
+// reorder a mesh's triangles for the vertex cache and overdraw, then its vertices for fetching them
+// in order. unused vertices get removed. stats can be NULL.
+extern void OptimizeMesh(MeshData_t* mesh, MeshOptimizeStats_t* stats);
+
+// optimize lots of meshes in parallel on the job threads (one mesh per job, so a single mesh only
+// uses one thread), and print the total stats
+extern void OptimizeMeshes(MeshData_t* meshes, uint32_t meshCount);
+
+// count the vertex cache misses drawing some indices would have
+extern uint64_t SimulateVertexCache(
+	const Index_t* indices, uint32_t indexCount, uint32_t vertexCount);
+
+// list the triangles using each vertex. offsets needs vertexCount + 1 elements and triangles needs
+// triangleCount * 3, and the triangles using vertex v are triangles[offsets[v]] up to
+// triangles[offsets[v + 1]].
+extern void BuildMeshAdjacency(
+	const uint32_t* indices, uint32_t triangleCount, uint32_t vertexCount, uint32_t* offsets,
+	uint32_t* triangles);
+
+// make a copy of a mesh that can be changed
+extern void CopyMeshData(
+	MeshData_t* mesh, const Vertex_t* vertices, uint32_t vertexCount, const Index_t* indices,
+	uint32_t indexCount);
+
+// free a mesh's memory
+extern void FreeMeshData(MeshData_t* mesh);
+
+// meshlet.c
+
+// meshlets are clusters of up to 64 vertices and 124 triangles, with a bounding sphere and a cone
+// that all their triangles' normals are inside. every frame, the ones that are off screen or facing
+// away from the camera get culled, and the rest are drawn as ranges of the index buffer.
+
+// a meshlet. its triangles are contiguous in the mesh's index buffer.
+typedef struct Meshlet
+{
+	uint32_t firstIndex; // relative to the start of the mesh's indices
+	uint32_t triangleCount;
+	float center[3]; // the bounding sphere
+	float radius;
+	float coneAxis[3];
+	float coneCutoff; // the meshlet faces away if dot(coneAxis, view direction) is at least this
+} Meshlet_t;
+
+// a range of a mesh's indices to draw
+typedef struct IndexRange
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+} IndexRange_t;
+
+// how much culling meshlets got rid of
+typedef struct MeshletCullStats
+{
+	uint64_t meshletCount;
+	uint64_t triangleCount;
+	uint64_t backFacingTriangles;
+	uint64_t offScreenTriangles;
+	uint64_t rangeCount; // the ranges that were left after merging neighbours
+} MeshletCullStats_t;
+
+// split a mesh into meshlets, it should be optimized first so neighbouring triangles are next to
+// each other. returns the number of meshlets, and the array has to be freed.
+extern uint32_t BuildMeshlets(const MeshData_t* mesh, Meshlet_t** meshlets);
+
+// cull meshlets drawn with a DrawCommand_t transform, and write the ranges to draw. ranges needs
+// room for meshletCount ranges, and the number used is returned.
+extern uint32_t CullMeshlets(
+	const Meshlet_t* meshlets, uint32_t meshletCount, const float transform[4], bool cullBackFaces,
+	IndexRange_t* ranges);
+
+// call at the end of every frame to keep track of the culling per frame
+extern void EndMeshletCullFrame(void);
+
+// get what was culled in the last frame
+extern MeshletCullStats_t GetMeshletCullStats(void);
+
+// print the average culling per frame since the last time this was called
+extern void PrintMeshletCullStats(void);
+
+// lod.c
+
+// a lod chain is a list of simpler versions of a mesh that all use its vertices, and every frame
+// the simplest one that's still accurate to within a few pixels gets drawn.
+
+// the most levels a chain can have, including the full mesh
+#define LOD_MAX_LEVELS 8
+
+// one level of detail, a range of the mesh's indices
+typedef struct LodLevel
+{
+	uint32_t firstIndex; // relative to the start of the mesh's indices
+	uint32_t indexCount;
+	float error; // how far the surface might have moved from the full mesh, in model units
+} LodLevel_t;
+
+// all the levels of a mesh, from the full mesh to the simplest one
+typedef struct LodChain
+{
+	LodLevel_t levels[LOD_MAX_LEVELS];
+	uint32_t levelCount;
+	float center[3]; // the bounding sphere
+	float radius;
+} LodChain_t;
+
+// simplify triangles from a mesh by collapsing edges, until there are targetCount triangles left
+// or the error would go over maxError. the new triangles only use the mesh's existing vertices, so
+// they can share its vertex buffer. output needs room for indexCount triangles, the number used is
+// returned, and the error is written to resultError if it isn't NULL. if cancelled isn't NULL and
+// gets set, it stops early with whatever it has so far.
+extern uint32_t SimplifyMesh(
+	const MeshData_t* mesh, const Index_t* indices, uint32_t indexCount, uint32_t targetCount,
+	float maxError, Index_t* output, float* resultError, const atomic_bool* cancelled);
+
+// build a lod chain for a mesh. the levels get added to the end of the mesh's indices, so it has to
+// be done before the mesh is uploaded, and after BuildMeshlets if it has meshlets. if cancelled
+// isn't NULL and gets set, the chain stops at the levels that are already done.
+extern void BuildLodChain(MeshData_t* mesh, LodChain_t* chain, const atomic_bool* cancelled);
+
+// pick the level to draw a mesh with a DrawCommand_t transform, for a window of the given size
+extern uint32_t SelectLod(
+	const LodChain_t* chain, const float transform[4], int32_t width, int32_t height,
+	float pixelError);
+
+// call at the end of every frame to keep track of the levels picked per frame
+extern void EndLodFrame(void);
+
+// print the average triangles saved per frame since the last time this was called
+extern void PrintLodStats(void);
+
+// meshfile.c
+
+// mesh files have a mesh's vertices and indices already in the layout they have on the gpu, so
+// loading one is just mapping it and uploading straight from the mapping, with no parsing.
+
+// a range of a mesh's indices with a bounding sphere, like a part with its own material
+typedef struct Submesh
+{
+	uint32_t firstIndex; // in indices, relative to the start of the mesh's indices
+	uint32_t indexCount;
+	float center[3];
+	float radius;
+} Submesh_t;
+
+// a mesh that was loaded from a mesh file, and what its header said about it
+typedef struct MeshFile
+{
+	Mesh_t mesh;
+	Submesh_t* submeshes;
+	uint32_t submeshCount;
+	float boundsMin[3]; // the bounding box
+	float boundsMax[3];
+	float center[3]; // the bounding sphere
+	float radius;
+} MeshFile_t;
+
+// write a mesh file, with the vertices converted to a format and the indices in 16 bits if they
+// fit. submeshes are ranges of the indices (firstIndex and indexCount are in indices), and if
+// there aren't any, the whole mesh is one. this doesn't need opengl.
+extern void WriteMeshFile(
+	const char* name, const VertexFormat_t* format, const Vertex_t* vertices, uint32_t vertexCount,
+	const Index_t* indices, uint32_t indexCount, const IndexRange_t* submeshes,
+	uint32_t submeshCount);
+
+// load a mesh file and upload it, on the context thread
+extern void LoadMeshFile(const char* name, MeshFile_t* mesh);
+
+// free a mesh file's mesh and submeshes
+extern void DestroyMeshFile(MeshFile_t* mesh);
+
+// a mesh file that's being loaded in the background. it gets mapped and checked on a loader
+// thread, and uploaded on the context thread.
+typedef struct MeshFileLoad
+{
+	LoadRequest_t request;
+	const char* name;
+	MappedFile_t file;
+	MeshFile_t mesh;
+} MeshFileLoad_t;
+
+// queue a mesh file to be loaded in the background
+extern void QueueLoadMeshFile(MeshFileLoad_t* load, const char* name, int32_t priority);
+
+// get a mesh file that was loaded in the background, or NULL if it isn't done
+extern const MeshFile_t* GetLoadedMeshFile(const MeshFileLoad_t* load);
+
+// objimport.c
+
+// import a wavefront .obj file, parsing it in parallel on the job threads, and print how fast it
+// went. corners with the same position and normal become one vertex, and the colours come from the
+// file, or the normals, or the positions, whichever there is. faces with more than 3 corners get
+// split into triangles. a broken file is a fatal error.
+extern void ImportObj(const char* name, MeshData_t* mesh);
+
+// glstate.c
+
+// these do the same thing as the opengl functions they wrap, but they skip the call if it wouldn't
+// change anything. they should only be used on the thread that has the context.
+
+// the number of opengl calls that were made, and the number that were skipped
+typedef struct GlStateStats
+{
+	uint64_t issued;
+	uint64_t elided;
+} GlStateStats_t;
+
+// forget everything, this has to be called when the context changes threads, or when something
+// changes the cached state without going through these functions
+extern void InvalidateGlState(void);
+
+// glUseProgram
+extern void SetProgram(uint32_t program);
+
+// glBindVertexArray
+extern void SetVertexArray(uint32_t vertexArray);
+
+// glBindBuffer
+extern void SetBuffer(uint32_t target, uint32_t buffer);
+
+// glBindBufferRange
+extern void SetBufferRange(
+	uint32_t target, uint32_t index, uint32_t buffer, size_t offset, size_t size);
+
+// glActiveTexture and glBindTexture
+extern void SetTexture(uint32_t unit, uint32_t target, uint32_t texture);
+
+// glEnable or glDisable
+extern void SetCapability(uint32_t capability, bool enabled);
+
+// glBlendFunc
+extern void SetBlendFunction(uint32_t source, uint32_t destination);
+
+// glDepthFunc
+extern void SetDepthFunction(uint32_t function);
+
+// glDepthMask
+extern void SetDepthMask(bool write);
+
+// glViewport
+extern void SetViewport(int32_t x, int32_t y, int32_t width, int32_t height);
+
+// glScissor
+extern void SetScissor(int32_t x, int32_t y, int32_t width, int32_t height);
+
+// glClearColor
+extern void SetClearColour(float red, float green, float blue, float alpha);
+
+// glClearDepth
+extern void SetClearDepth(float depth);
+
+// call this at the end of every frame to keep track of the calls per frame
+extern void EndGlStateFrame(void);
+
+// get the number of calls made and skipped in the last frame
+extern GlStateStats_t GetGlStateStats(void);
+
+// print the average calls made and skipped per frame since the last time this was called
+extern void PrintGlStateStats(void);
+
+// stream.c
+
+// the streaming buffer is for data that changes every frame, like uniforms, particles, or debug
+// drawing. it's a buffer that's always mapped, split into a region for each frame in flight. the
+// main thread allocates space in the current frame's region and writes to it directly, and it gets
+// reused 3 frames later.
+
+// a piece of the streaming buffer. data is where to write, and buffer and offset are what to bind
+// or draw from.
+typedef struct StreamAllocation
+{
+	void* data;
+	uint32_t buffer;
+	size_t offset;
+} StreamAllocation_t;
+
+// create the streaming buffer, size is split between the regions
+extern void StartStreamBuffer(size_t size);
+
+// delete the streaming buffer
+extern void StopStreamBuffer(void);
+
+// get the buffer
+extern uint32_t GetStreamBuffer(void);
+
+// get the alignment uniform buffer offsets need
+extern size_t GetStreamUniformAlignment(void);
+
+// get the alignment shader storage buffer offsets need
+extern size_t GetStreamStorageAlignment(void);
+
+// move on to the next frame's region, on the thread that allocates
+extern void BeginStreamFrame(void);
+
+// get space for size bytes with an offset that's a multiple of alignment (a power of 2)
+extern StreamAllocation_t AllocateStream(size_t size, size_t alignment);
+
+// fence the current frame's region on the opengl thread, and wait until the gpu is done with the
+// oldest one
+extern void FenceStreamFrame(void);
+
+// gpucull.c
+
+// gpu culling moves the per-object loop off the cpu completely. a compute shader checks every
+// object's bounding sphere against the screen, and writes draw commands for the ones that are on
+// it, which get drawn with one indirect draw without the cpu ever seeing them.
+
+// an object for gpu culling, some of a mesh's indices with a transform (like a DrawCommand_t's)
+// and a bounding sphere around them. the layout is the same as the one in cull.glsl.
+typedef struct GpuCullObject
+{
+	float transform[4];
+	float center[3];
+	float radius;
+	uint32_t indexCount;
+	uint32_t firstIndex; // in indices, like DrawCommand_t
+	int32_t baseVertex;
+	uint32_t padding;
+} GpuCullObject_t;
+
+// the objects and the buffers the compute shader fills in for drawing them. every object has to
+// use the same vertex array and index type.
+typedef struct GpuCullScene
+{
+	uint32_t objectCount;
+	uint32_t vertexArray;
+	uint32_t indexType;
+	uint32_t program;         // cull.glsl
+	uint32_t objectBuffer;    // the objects
+	uint32_t transformBuffer; // the visible objects' transforms, for batched.glsl
+	uint32_t commandBuffer;   // the visible objects' draw commands
+	uint32_t countBuffer;     // the number of visible objects
+	float quantization[4];    // the mesh's
+} GpuCullScene_t;
+
+// upload objects that use a mesh's vertex array for gpu culling
+extern GpuCullScene_t CreateGpuCullScene(
+	const Mesh_t* mesh, const GpuCullObject_t* objects, uint32_t objectCount);
+
+// print how many objects were visible in the last frame and delete the scene. this reads from the
+// gpu, so it waits for it to finish.
+extern void DestroyGpuCullScene(GpuCullScene_t* scene);
+
+// cull the objects, moved by the transform in the streaming buffer at uniformOffset. this is on
+// the render thread.
+extern void CullGpuScene(const GpuCullScene_t* scene, size_t uniformOffset);
+
+// draw the visible objects from the last CullGpuScene, with a shader that reads transforms like
+// batched.glsl does
+extern void DrawGpuScene(const GpuCullScene_t* scene, uint32_t shader, bool cullBackFaces);
+
+// render.c
+
+// the most draws in one batch. shared vertex arrays have a draw index for each draw in the
+// biggest batch so far (see ReserveDrawIndices), which is a 4 MiB buffer at this size. batches
+// from the cpu are split at this, but gpu culling (see gpucull.c) draws every visible object in
+// one batch, so it's also the most objects a gpu cull scene can have. that's why it's this big,
+// batches alone would be fine with 65536.
+#define DRAW_BATCH_MAX (1024 * 1024)
+
+// one draw in a frame packet
+typedef struct DrawCommand
+{
+	uint32_t shader;
+	uint32_t vertexArray;
+	uint32_t indexCount;
+	uint32_t indexType;  // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	uint32_t firstIndex; // where the indices start in the index buffer, in indices
+	int32_t baseVertex;  // added to every index, so meshes can share a vertex buffer
+	uint32_t firstRange; // ranges of the indices in the packet to draw, instead of all of them
+	uint32_t rangeCount;
+	uint32_t instanceCount;          // if this isn't 0, the draw is instanced, see AddDrawInstanced
+	const GpuCullScene_t* cullScene; // if this isn't NULL, see AddDrawGpuCulled
+	bool cullBackFaces;              // whether triangles facing away from the camera are skipped
+	bool batched;                    // can be drawn along with the draws next to it, see AddDraw
+	float transform[4];              // the mesh gets scaled by zw and then moved by xy
+	float quantization[4];           // the mesh's, SetDrawMesh copies it
+	size_t uniformOffset;            // where AddDraw put the uniforms in the streaming buffer
+} DrawCommand_t;
+
+// what a draw's shader gets, the Draw uniform block in vertex.glsl, and an element of the Batch
+// storage block in batched.glsl
+typedef struct DrawUniforms
+{
+	float transform[4];
+	float quantization[4];
+} DrawUniforms_t;
+
+// batched draws next to each other with the same shader, vertex array, index type and culling
+// are drawn with one glMultiDrawElementsIndirect. their commands and transforms are in the
+// streaming buffer.
+typedef struct DrawBatch
+{
+	uint32_t firstDraw;
+	uint32_t drawCount;
+	uint32_t commandCount; // one for each draw, or for each range of a draw with ranges
+	size_t commandOffset;
+	size_t transformOffset;
+} DrawBatch_t;
+
+// everything the render thread needs to know to draw a frame. the main thread fills it in and then
+// doesn't touch it until the render thread is done with it, so none of it needs locking.
+typedef struct FramePacket
+{
+	int32_t width; // the viewport size
+	int32_t height;
+	float clearColour[4];
+	DrawCommand_t* draws;
+	uint32_t drawCount;
+	uint32_t drawCapacity;
+	IndexRange_t* ranges; // for draws that only draw some of their indices
+	uint32_t rangeCount;
+	uint32_t rangeCapacity;
+	DrawBatch_t* batches; // made from the batched draws by SubmitFramePacket
+	uint32_t batchCount;
+	uint32_t batchCapacity;
+	bool resetGpuProfiler; // reset the gpu profiler's averages before drawing this
+} FramePacket_t;
+
+// start the renderer. if threaded is true, the render thread takes the opengl context from the
+// calling thread, otherwise packets get drawn as soon as they're submitted. this also creates the
+// streaming buffer.
+extern void StartRenderer(bool threaded);
+
+// draw any packets that are left, stop the render thread, and give the context back
+extern void StopRenderer(void);
+
+// get the next packet to fill in, this waits if the render thread is behind
+extern FramePacket_t* BeginFramePacket(void);
+
+// fill in the parts of a draw that come from a mesh
+extern void SetDrawMesh(DrawCommand_t* draw, const Mesh_t* mesh);
+
+// add a draw to a packet. if it's batched, its shader has to read its transform from the Batch
+// storage block with the draw index attribute, like batched.glsl does.
+extern void AddDraw(FramePacket_t* packet, const DrawCommand_t* draw);
+
+// add a draw that only draws some ranges of its indices, which are relative to firstIndex. nothing
+// is added if there aren't any ranges.
+extern void AddDrawRanges(
+	FramePacket_t* packet, const DrawCommand_t* draw, const IndexRange_t* ranges,
+	uint32_t rangeCount);
+
+// add a draw of instanceCount copies of its mesh, using the instances in an instance buffer. the
+// draw's vertex array is replaced with the instance buffer's, and its shader has to read the
+// instance attributes, like instanced.glsl does.
+extern void AddDrawInstanced(
+	FramePacket_t* packet, const DrawCommand_t* draw, const InstanceBuffer_t* instances,
+	uint32_t instanceCount);
+
+// add a draw of the objects in a scene that the gpu decides are visible. the draw's transform moves
+// all of them, and its shader has to read transforms like batched.glsl. the scene has to stay
+// around until the packet is drawn.
+extern void AddDrawGpuCulled(
+	FramePacket_t* packet, const DrawCommand_t* draw, const GpuCullScene_t* scene);
+
+// hand a packet to the render thread (or draw it, without one). this includes capturing, presenting
+// and the end of the gpu profiler's frame.
+extern void SubmitFramePacket(FramePacket_t* packet);
+
+// raster.c
+
+// the software renderer draws the same meshes as opengl, but on the cpu, into a framebuffer in
+// memory. it splits the screen into tiles, sorts triangles into the tiles they touch, and then
+// draws every tile in parallel using simd (sse2, or avx2 if it's enabled in CMakeLists.txt) to do
+// several pixels at once. it draws the same thing vertex.glsl and fragment.glsl do.
+
+// create the framebuffer and start drawing with the software renderer
+extern void CreateSoftwareRenderer(int32_t width, int32_t height);
+
+// free everything the software renderer has
+extern void DestroySoftwareRenderer(void);
+
+// give the software renderer a copy of a mesh, works like CreateVertexBuffer, CreateIndexBuffer,
+// and CreateVertexArray in one
+extern uint32_t CreateSoftwareMesh(
+	const Vertex_t* vertices, uint32_t vertexCount, const Index_t* indices, uint32_t indexCount);
+
+// start a new frame and clear it to this colour
+extern void ClearSoftware(float red, float green, float blue, float alpha);
+
+// draw a mesh (this only sorts its triangles into tiles, they get drawn in PresentSoftware)
+extern void DrawSoftwareMesh(uint32_t mesh);
+
+// draw all the tiles into the framebuffer
+extern void PresentSoftware(void);
+
+// get the framebuffer, which has rgba pixels from the top left. stride is the number of pixels in
+// a row in memory, which is more than the width.
+extern const uint32_t* GetSoftwareFramebuffer(int32_t* stride);
+
+// get a description of the software renderer, or NULL if it isn't being used
+extern const char* GetSoftwareRendererName(void);
@@ -5,11 +5,23 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec4 colour;
 
+// uniforms are the same for every vertex in a draw. a uniform block gets them from a buffer, this
+// one has a transform that moves (xy) and scales (zw) the mesh, and how the mesh's positions are
+// stored (they're (position - xyz) / w, see GetVertexQuantization).
+layout (std140) uniform Draw
+{
+    vec4 transform;
+    vec4 quantization;
+};
+
 // this has to be passed along to the fragment shader
 out vec4 vertexColour;
 
 void main()
 {
-    gl_Position = vec4(position, 1.0);
+    // the camera looks down -z like it usually does, but clip space has z going into the screen, so
+    // z gets flipped
+    vec3 meshPosition = position * quantization.w + quantization.xyz;
+    gl_Position = vec4(meshPosition.xy * transform.zw + transform.xy, -meshPosition.z, 1.0);
     vertexColour = colour;
 }
@@ -0,0 +1,357 @@
+// this file implements vertex formats. Vertex_t is easy to fill in, but it's 40 bytes, and most of
+// that is wasted: colours are always between 0 and 1, so 8 bits each is plenty, and positions don't
+// need 32 bit floats unless the mesh is huge. the gpu has to read every vertex of every draw, so
+// smaller vertices mean less memory and less bandwidth.
+//
+// a format is a list of attributes, each with a type and an offset. CreateVertexArray sets up the
+// attribute pointers from it, and ConvertVertices packs Vertex_ts into it, so adding a format is
+// just adding another entry to the table below.
+//
+// half floats and normalized integers only have a few bits, and normalized integers only go from
+// -1 to 1. so positions are stored relative to the mesh's bounding box, scaled to fit between -1
+// and 1, and the mesh keeps the offset and scale for the vertex shader to put them back. that way a
+// mesh anywhere and of any size gets all the bits, instead of snorm16 squashing everything outside
+// the unit cube onto its sides, and half floats getting coarse far from the origin.
+//
+// normals are octahedral encoded: the unit sphere is folded out into a square, so a normal only
+// needs 2 numbers instead of 3. the shader gets it back like this:
+//
+//     vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+//     float t = max(-n.z, 0.0);
+//     n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+//     n = normalize(n);
+
+#include "stuff.h"
+
+// the formats. position always has 4 components even though only 3 are used, because attributes
+// are faster to read when they start on a multiple of 4 bytes.
+// clang-format off
+static const VertexFormat_t VERTEX_FORMATS[VertexFormatCount] = {
+	[VertexFormatFloat] = {
+		"float", 2, 28, {
+			{VertexSemanticPosition, VertexTypeFloat, 3, 0},
+			{VertexSemanticColour, VertexTypeFloat, 4, 12},
+		},
+	},
+	[VertexFormatHalf] = {
+		"half", 2, 12, {
+			{VertexSemanticPosition, VertexTypeHalf, 4, 0},
+			{VertexSemanticColour, VertexTypeUnorm8, 4, 8},
+		},
+	},
+	[VertexFormatSnorm16] = {
+		"snorm16", 2, 12, {
+			{VertexSemanticPosition, VertexTypeSnorm16, 4, 0},
+			{VertexSemanticColour, VertexTypeUnorm8, 4, 8},
+		},
+	},
+	[VertexFormatLit] = {
+		"lit", 3, 16, {
+			{VertexSemanticPosition, VertexTypeHalf, 4, 0},
+			{VertexSemanticNormal, VertexTypeOctahedral16, 2, 8},
+			{VertexSemanticColour, VertexTypeUnorm8, 4, 12},
+		},
+	},
+};
+// clang-format on
+
+// the size of one component of a type
+static uint32_t GetComponentSize(VertexType_t type);
+
+// convert a float to a half float
+static uint16_t FloatToHalf(float value);
+
+// encode a normal as 2 numbers between -1 and 1
+static void EncodeOctahedral(const float normal[3], float encoded[2]);
+
+// write one attribute of one vertex
+static void PackAttribute(const VertexAttribute_t* attribute, const float* values, uint8_t* output);
+
+const VertexFormat_t* GetVertexFormat(VertexFormatId_t id)
+{
+	return &VERTEX_FORMATS[id];
+}
+
+const VertexFormat_t* FindVertexFormat(const char* name)
+{
+	for (uint32_t i = 0; i < VertexFormatCount; i++)
+	{
+		if (strcmp(VERTEX_FORMATS[i].name, name) == 0)
+		{
+			return &VERTEX_FORMATS[i];
+		}
+	}
+
+	return NULL;
+}
+
+void SetVertexAttributes(const VertexFormat_t* format)
+{
+	// vertex attributes describe each part of a vertex, so the driver knows how to understand the
+	// vertex data it's given.
+	// parameters:
+	// index (basically an id for this attribute, the location in the shader)
+	// count (the number of elements in this attribute)
+	// type (the type of data)
+	// normalized (whether integers get mapped to [-1.0, 1.0] or [0.0, 1.0], instead of just being
+	// converted)
+	// vertex size
+	// offset (into a vertex)
+	for (uint32_t i = 0; i < format->attributeCount; i++)
+	{
+		const VertexAttribute_t* attribute = &format->attributes[i];
+
+		uint32_t type = GL_FLOAT;
+		bool normalized = true;
+		switch (attribute->type)
+		{
+		case VertexTypeFloat:
+			type = GL_FLOAT;
+			normalized = false;
+			break;
+		case VertexTypeHalf:
+			type = GL_HALF_FLOAT;
+			normalized = false;
+			break;
+		case VertexTypeSnorm16:
+		case VertexTypeOctahedral16:
+			type = GL_SHORT;
+			break;
+		case VertexTypeUnorm16:
+			type = GL_UNSIGNED_SHORT;
+			break;
+		case VertexTypeSnorm8:
+		case VertexTypeOctahedral8:
+			type = GL_BYTE;
+			break;
+		case VertexTypeUnorm8:
+			type = GL_UNSIGNED_BYTE;
+			break;
+		}
+
+		glVertexAttribPointer(
+			attribute->semantic, (int32_t)attribute->components, type, normalized, format->stride,
+			(void*)(size_t)attribute->offset);
+		glEnableVertexAttribArray(attribute->semantic);
+	}
+}
+
+void GetVertexQuantization(
+	const VertexFormat_t* format, const Vertex_t* vertices, uint32_t vertexCount,
+	float quantization[4])
+{
+	quantization[0] = 0.0f;
+	quantization[1] = 0.0f;
+	quantization[2] = 0.0f;
+	quantization[3] = 1.0f;
+	bool quantized = false;
+	for (uint32_t i = 0; i < format->attributeCount; i++)
+	{
+		quantized |= format->attributes[i].semantic == VertexSemanticPosition &&
+					 format->attributes[i].type != VertexTypeFloat;
+	}
+	if (!quantized || !vertexCount)
+	{
+		return;
+	}
+
+	float boundsMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+	float boundsMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			boundsMin[j] = fminf(boundsMin[j], vertices[i].position[j]);
+			boundsMax[j] = fmaxf(boundsMax[j], vertices[i].position[j]);
+		}
+	}
+
+	// the same scale on every axis keeps it to one vec4 in the shader, and a mesh that's flat on
+	// one axis doesn't need more precision on that axis anyway
+	float scale = 0.0f;
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		quantization[i] = (boundsMin[i] + boundsMax[i]) * 0.5f;
+		scale = fmaxf(scale, (boundsMax[i] - boundsMin[i]) * 0.5f);
+	}
+	quantization[3] = scale > 0.0f ? scale : 1.0f;
+}
+
+void ConvertVertices(
+	const VertexFormat_t* format, const Vertex_t* vertices, uint32_t vertexCount,
+	const float quantization[4], void* output)
+{
+	uint8_t* vertex = output;
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		for (uint32_t j = 0; j < format->attributeCount; j++)
+		{
+			const VertexAttribute_t* attribute = &format->attributes[j];
+
+			// the unused 4th component of the position is 1, like it would be in the shader
+			float values[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+			switch (attribute->semantic)
+			{
+			case VertexSemanticPosition:
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					values[k] = (vertices[i].position[k] - quantization[k]) / quantization[3];
+				}
+				break;
+			case VertexSemanticColour:
+				memcpy(values, vertices[i].colour, sizeof(vertices[i].colour));
+				break;
+			case VertexSemanticNormal:
+				memcpy(values, vertices[i].normal, sizeof(vertices[i].normal));
+				break;
+			default:
+				break;
+			}
+
+			PackAttribute(attribute, values, vertex + attribute->offset);
+		}
+
+		vertex += format->stride;
+	}
+}
+
+static uint32_t GetComponentSize(VertexType_t type)
+{
+	switch (type)
+	{
+	case VertexTypeFloat:
+		return 4;
+	case VertexTypeHalf:
+	case VertexTypeSnorm16:
+	case VertexTypeUnorm16:
+	case VertexTypeOctahedral16:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+static uint16_t FloatToHalf(float value)
+{
+	// a half has 1 sign bit, 5 exponent bits (biased by 15), and 10 mantissa bits, where a float
+	// has 8 exponent bits (biased by 127) and 23 mantissa bits
+	uint32_t bits = 0;
+	memcpy(&bits, &value, sizeof(bits));
+	uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+	int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (((bits >> 23) & 0xFF) == 0xFF)
+	{
+		// infinity stays infinity, and nan stays nan
+		return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+	}
+	if (exponent >= 31)
+	{
+		// too big, so it's infinity
+		return sign | 0x7C00;
+	}
+	if (exponent <= 0)
+	{
+		// too small for a normal half, so it's a denormal (or 0). the implicit 1 bit has to be
+		// added to the mantissa before shifting it down.
+		if (exponent < -10)
+		{
+			return sign;
+		}
+		mantissa |= 0x800000;
+		uint32_t shift = (uint32_t)(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t midpoint = 1u << (shift - 1);
+		if (remainder > midpoint || (remainder == midpoint && (half & 1)))
+		{
+			half++;
+		}
+		return sign | (uint16_t)half;
+	}
+
+	// round to nearest even. if rounding carries out of the mantissa it goes into the exponent,
+	// which is still the right answer (even if it makes it infinity).
+	uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1FFF;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+	{
+		half++;
+	}
+	return sign | (uint16_t)half;
+}
+
+static void EncodeOctahedral(const float normal[3], float encoded[2])
+{
+	// project onto the octahedron |x| + |y| + |z| = 1, then fold the bottom half over the top half
+	// a normal of (0, 0, 0) becomes (0, 0, 1), so it faces the camera
+	float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+	if (length == 0.0f)
+	{
+		encoded[0] = 0.0f;
+		encoded[1] = 0.0f;
+		return;
+	}
+
+	float x = normal[0] / length;
+	float y = normal[1] / length;
+	if (normal[2] < 0.0f)
+	{
+		float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	encoded[0] = x;
+	encoded[1] = y;
+}
+
+static void PackAttribute(const VertexAttribute_t* attribute, const float* values, uint8_t* output)
+{
+	float encoded[2];
+	if (attribute->type == VertexTypeOctahedral16 || attribute->type == VertexTypeOctahedral8)
+	{
+		EncodeOctahedral(values, encoded);
+		values = encoded;
+	}
+
+	uint32_t size = GetComponentSize(attribute->type);
+	for (uint32_t i = 0; i < attribute->components; i++)
+	{
+		// normalized types get rounded to the nearest step, and clamped because anything outside
+		// the range can't be stored
+		float value = values[i];
+		uint8_t* component = output + i * size;
+		switch (attribute->type)
+		{
+		case VertexTypeFloat:
+			memcpy(component, &value, sizeof(float));
+			break;
+		case VertexTypeHalf: {
+			uint16_t half = FloatToHalf(value);
+			memcpy(component, &half, sizeof(uint16_t));
+			break;
+		}
+		case VertexTypeSnorm16:
+		case VertexTypeOctahedral16: {
+			int16_t snorm = (int16_t)lroundf(fminf(fmaxf(value, -1.0f), 1.0f) * 32767.0f);
+			memcpy(component, &snorm, sizeof(int16_t));
+			break;
+		}
+		case VertexTypeUnorm16: {
+			uint16_t unorm = (uint16_t)lroundf(fminf(fmaxf(value, 0.0f), 1.0f) * 65535.0f);
+			memcpy(component, &unorm, sizeof(uint16_t));
+			break;
+		}
+		case VertexTypeSnorm8:
+		case VertexTypeOctahedral8:
+			*(int8_t*)component = (int8_t)lroundf(fminf(fmaxf(value, -1.0f), 1.0f) * 127.0f);
+			break;
+		case VertexTypeUnorm8:
+			*component = (uint8_t)lroundf(fminf(fmaxf(value, 0.0f), 1.0f) * 255.0f);
+			break;
+		}
+	}
+}
@@ -310,7 +310,9 @@ void CreateGlContext(void)
 	wglMakeCurrent(s_deviceContext, s_glContext);
 
 	// load the rest of opengl
+	CPU_ZONE_BEGIN("gladLoadGL");
 	gladLoadGL(GetGlFunction);
+	CPU_ZONE_END();
 
 	// glGetString is a very handy function for getting information about the OpenGL context
 	printf(
@@ -338,13 +340,19 @@ bool Update(void)
 		DispatchMessageA(&message);
 	}
 
-	// the viewport is the area that gets rendered to, the scissor is the area of it that's visible
-	glViewport(0, 0, s_windowWidth, s_windowHeight);
-	glScissor(0, 0, s_windowWidth, s_windowHeight);
-
 	return !s_windowClosed;
 }
 
+void MakeGlContextCurrent(bool current)
+{
+	if (!wglMakeCurrent(s_deviceContext, current ? s_glContext : NULL))
+	{
+		FatalError(
+			"failed to make OpenGL context %s: error %d!", current ? "current" : "not current",
+			GetLastError());
+	}
+}
+
 void Present(void)
 {
 	// this copies the backbuffer to the front (visible, drawn to the window) buffer
@@ -361,6 +369,229 @@ int32_t GetWindowHeight(void)
 	return s_windowHeight;
 }
 
+uint64_t GetTime(void)
+{
+	// the performance counter is the highest resolution clock on windows, it counts ticks at a
+	// frequency that never changes while the system is running
+	static LARGE_INTEGER frequency;
+	if (!frequency.QuadPart)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	// converting the whole and fractional seconds separately avoids overflowing 64 bits
+	uint64_t seconds = counter.QuadPart / frequency.QuadPart;
+	uint64_t remainder = counter.QuadPart % frequency.QuadPart;
+	return seconds * 1000000000 + remainder * 1000000000 / frequency.QuadPart;
+}
+
+void SleepUntil(uint64_t time)
+{
+	uint64_t now = GetTime();
+	if (time <= now)
+	{
+		return;
+	}
+
+	// Sleep only has millisecond precision (and usually worse), but high resolution waitable timers
+	// are much better. the timer is only made once, so only one thread should use this.
+	static HANDLE timer;
+	if (!timer)
+	{
+		timer = CreateWaitableTimerExW(
+			NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	}
+
+	// negative times are relative, in units of 100 nanoseconds
+	LARGE_INTEGER dueTime;
+	dueTime.QuadPart = -(int64_t)((time - now) / 100);
+	if (!timer || !SetWaitableTimer(timer, &dueTime, 0, NULL, NULL, FALSE))
+	{
+		Sleep((DWORD)((time - now) / 1000000));
+		return;
+	}
+	WaitForSingleObject(timer, INFINITE);
+}
+
+uint32_t GetCpuCount(void)
+{
+	SYSTEM_INFO info = {0};
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+}
+
+MappedFile_t MapFile(const char* name)
+{
+	MappedFile_t file = {0};
+
+	// files in the .pak file are already mapped
+	if (FindPakFile(name, &file))
+	{
+		return file;
+	}
+
+	// FILE_FLAG_SEQUENTIAL_SCAN is the same as MADV_SEQUENTIAL on linux, it makes the cache manager
+	// read further ahead
+	HANDLE handle = CreateFileA(
+		name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		FatalError("failed to open file %s: error %lu!", name, GetLastError());
+	}
+	LARGE_INTEGER size = {0};
+	if (!GetFileSizeEx(handle, &size))
+	{
+		FatalError("failed to get the size of file %s: error %lu!", name, GetLastError());
+	}
+	file.size = (size_t)size.QuadPart;
+
+	// file mappings can't be empty
+	file.data = "";
+	if (file.size)
+	{
+		// on windows, a file mapping is an object of its own, and views of it get mapped into the
+		// process (a size of 0 means the whole file)
+		HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping)
+		{
+			FatalError("failed to create mapping of file %s: error %lu!", name, GetLastError());
+		}
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!data)
+		{
+			FatalError("failed to map file %s: error %lu!", name, GetLastError());
+		}
+		// the view keeps its own reference to the mapping
+		CloseHandle(mapping);
+
+		// PrefetchVirtualMemory is the same as MADV_WILLNEED, it starts reading the whole thing in
+		// now. it's only a hint, so it doesn't matter if it fails.
+		WIN32_MEMORY_RANGE_ENTRY range = {data, file.size};
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+		file.data = data;
+	}
+
+	CloseHandle(handle);
+
+	return file;
+}
+
+void UnmapFile(MappedFile_t* file)
+{
+	// files from the .pak file are part of its mapping, so they stay mapped until it's closed.
+	// compressed ones aren't, they got decompressed into memory of their own.
+	if (file->decompressed)
+	{
+		free(file->decompressed);
+	}
+	else if (file->size && !file->packed)
+	{
+		UnmapViewOfFile(file->data);
+	}
+	memset(file, 0, sizeof(MappedFile_t));
+}
+
+// windows threads run a function that takes void* and returns a DWORD, so this is what actually
+// gets run and it calls the real function
+typedef struct ThreadStart
+{
+	ThreadFunction_t function;
+	void* data;
+	char name[32];
+} ThreadStart_t;
+
+static DWORD WINAPI ThreadMain(void* data)
+{
+	ThreadStart_t start = *(ThreadStart_t*)data;
+	free(data);
+	NameCpuProfilerThread(start.name);
+	start.function(start.data);
+	return 0;
+}
+
+Thread_t StartThread(ThreadFunction_t function, void* data, const char* name)
+{
+	// this has to be on the heap, because this function can return before the thread starts
+	ThreadStart_t* start = calloc(1, sizeof(ThreadStart_t));
+	if (!start)
+	{
+		FatalError("failed to allocate %zu bytes!", sizeof(ThreadStart_t));
+	}
+	start->function = function;
+	start->data = data;
+	snprintf(start->name, sizeof(start->name), "%s", name);
+
+	HANDLE thread = CreateThread(NULL, 0, ThreadMain, start, 0, NULL);
+	if (!thread)
+	{
+		FatalError("failed to create thread %s: error %d!", name, GetLastError());
+	}
+
+	// SetThreadDescription only takes wide strings
+	wchar_t wideName[64] = {0};
+	MultiByteToWideChar(CP_UTF8, 0, name, -1, wideName, 63);
+	SetThreadDescription(thread, wideName);
+
+	return thread;
+}
+
+void JoinThread(Thread_t thread)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+// slim reader/writer locks are the fastest mutex on windows, and they don't need to be destroyed
+
+void InitMutex(Mutex_t* mutex)
+{
+	InitializeSRWLock(mutex);
+}
+
+void DestroyMutex(Mutex_t* mutex)
+{
+	(void)mutex;
+}
+
+void LockMutex(Mutex_t* mutex)
+{
+	AcquireSRWLockExclusive(mutex);
+}
+
+void UnlockMutex(Mutex_t* mutex)
+{
+	ReleaseSRWLockExclusive(mutex);
+}
+
+void InitCondition(Condition_t* condition)
+{
+	InitializeConditionVariable(condition);
+}
+
+void DestroyCondition(Condition_t* condition)
+{
+	(void)condition;
+}
+
+void WaitCondition(Condition_t* condition, Mutex_t* mutex)
+{
+	SleepConditionVariableSRW(condition, mutex, INFINITE, 0);
+}
+
+void SignalCondition(Condition_t* condition)
+{
+	WakeConditionVariable(condition);
+}
+
+void BroadcastCondition(Condition_t* condition)
+{
+	WakeAllConditionVariable(condition);
+}
+
 LRESULT WindowProcedure(HWND window, UINT message, WPARAM wparam, LPARAM lparam)
 {
 	// there are different kinds of messages a window can get, for all sorts of things like moving,